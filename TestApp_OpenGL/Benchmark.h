@@ -0,0 +1,193 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include "SceneUtils.h"
+#include "Profiler.h"
+
+/*
+* Frame-time benchmark over one scene:
+*
+*   TestApp_OpenGL --benchmark --scene Dragon [--frames 300] [--warmup 30] [--report benchmark_Dragon.json]
+*
+* Runs headless (see Headless.h) along the scripted orbit with the fixed settings of Apply(), skips the warmup frames
+* and writes CPU frame times, the per-pass CPU/GPU timings from the Profiler, draw calls, triangles and render target
+* memory as JSON. Built with WORKBENCH_EGL and LIBGL_ALWAYS_SOFTWARE=1 it runs on llvmpipe, which makes the numbers
+* comparable between machines (and slow: keep --size small).
+*
+* --scene is honored in every mode, the benchmark only adds the report.
+*
+*   TestApp_OpenGL --jobs-benchmark
+*
+* prints the job system throughput from one thread to every core (JobSystem::Scalability) and exits.
+*
+*   TestApp_OpenGL --bounds-benchmark
+*
+* times the world bounds kernel on the Dragon and Nefertiti meshes (SceneLoader::BoundsBenchmark) and exits.
+*/
+namespace Benchmark
+{
+    struct Options
+    {
+        bool Enabled = false;
+        bool Jobs = false;          // --jobs-benchmark: job system scalability only, no window and no scene
+        bool Bounds = false;        // --bounds-benchmark: bounds kernel only, no window
+        std::string Scene = "Jinx";
+        int Frames = 300;
+        int Warmup = 30;
+        std::string ReportPath;
+    };
+
+    Options Parse(int argc, char** argv)
+    {
+        Options options;
+        for (int i = 1; i < argc; i++)
+        {
+            bool hasValue = i + 1 < argc;
+            if (!strcmp(argv[i], "--benchmark"))
+                options.Enabled = true;
+            else if (!strcmp(argv[i], "--jobs-benchmark"))
+                options.Jobs = true;
+            else if (!strcmp(argv[i], "--bounds-benchmark"))
+                options.Bounds = true;
+            else if (!strcmp(argv[i], "--scene") && hasValue)
+                options.Scene = argv[++i];
+            else if (!strcmp(argv[i], "--frames") && hasValue)
+                options.Frames = std::max(1, atoi(argv[++i]));
+            else if (!strcmp(argv[i], "--warmup") && hasValue)
+                options.Warmup = std::max(0, atoi(argv[++i]));
+            else if (!strcmp(argv[i], "--report") && hasValue)
+                options.ReportPath = argv[++i];
+        }
+
+        if (options.ReportPath.empty())
+            options.ReportPath = "benchmark_" + options.Scene + ".json";
+
+        return options;
+    }
+
+    // Every pass enabled, independent of the UI defaults
+    void Apply(SceneParams& sceneParams)
+    {
+        sceneParams.drawParams.doShadows = true;
+        sceneParams.sceneLights.Ambient.aoStrength = 1.0f;
+        sceneParams.sceneLights.Ambient.aoRadius = 0.2f;
+        sceneParams.sceneLights.Ambient.aoSamples = 16;
+        sceneParams.sceneLights.Ambient.aoSteps = 16;
+        sceneParams.sceneLights.Ambient.aoBlurAmount = 3;
+        sceneParams.sceneLights.Ambient.aoTemporal = true;
+        sceneParams.sceneLights.Ambient.aoHistoryWeight = 0.85f;
+    }
+
+    struct Memory
+    {
+        size_t RenderTargetsPeak = 0;
+        size_t RenderTargetsAllocated = 0;
+        size_t FrameBuffers = 0;
+    };
+
+    class Recorder
+    {
+        Options _options;
+        int _frame = 0;
+        std::vector<float> _cpuFrameMs;
+        std::vector<float> _drawCalls;
+        std::vector<float> _triangles;
+
+        static void WriteStats(std::ostream& out, Profiler::Stats stats)
+        {
+            out << "{\"avg\":" << stats.Average << ",\"p95\":" << stats.P95 << ",\"max\":" << stats.Max << "}";
+        }
+
+    public:
+        Recorder(const Options& options) : _options(options) {}
+
+        int TotalFrames() { return _options.Warmup + _options.Frames; }
+
+        // Once per frame, after the swap (or readback) and Profiler::EndFrame. The profiler history restarts with the
+        // first measured frame, so the GPU and pass numbers cover the same frames as the CPU ones.
+        void Frame(Profiler& profiler, double cpuFrameMs, int drawCalls, long long triangles)
+        {
+            if (_frame++ < _options.Warmup)
+            {
+                if (_frame == _options.Warmup)
+                    profiler.ClearHistory();
+                return;
+            }
+
+            _cpuFrameMs.push_back(cpuFrameMs);
+            _drawCalls.push_back(drawCalls);
+            _triangles.push_back(triangles);
+        }
+
+        // Pass statistics cover the last Profiler::HistorySize measured frames
+        bool Write(Profiler& profiler, const SceneParams& sceneParams, const char* aoType, int width, int height, Memory memory)
+        {
+            profiler.Flush();
+
+            std::ofstream out(_options.ReportPath);
+            if (!out.is_open())
+            {
+                std::cout << "ERROR::BENCHMARK::REPORT_NOT_WRITTEN " << _options.ReportPath << std::endl;
+                return false;
+            }
+
+            const AmbientLight& ambient = sceneParams.sceneLights.Ambient;
+            out << "{\n"
+                << "  \"scene\": \"" << _options.Scene << "\",\n"
+                << "  \"frames\": " << _cpuFrameMs.size() << ",\n"
+                << "  \"warmup\": " << _options.Warmup << ",\n"
+                << "  \"width\": " << width << ",\n"
+                << "  \"height\": " << height << ",\n"
+                << "  \"renderer\": \"" << (const char*)glGetString(GL_RENDERER) << "\",\n"
+                << "  \"version\": \"" << (const char*)glGetString(GL_VERSION) << "\",\n"
+                << "  \"settings\": {\"shadows\":" << (sceneParams.drawParams.doShadows ? "true" : "false")
+                << ",\"ao\":\"" << aoType << "\",\"aoSamples\":" << ambient.aoSamples << ",\"aoSteps\":" << ambient.aoSteps
+                << ",\"aoRadius\":" << ambient.aoRadius << ",\"aoBlur\":" << ambient.aoBlurAmount
+                << ",\"aoTemporal\":" << (ambient.aoTemporal ? "true" : "false") << "},\n";
+
+            out << "  \"cpuFrameMs\": ";
+            WriteStats(out, Profiler::Compute(_cpuFrameMs, _cpuFrameMs.size()));
+            out << ",\n  \"drawCalls\": ";
+            WriteStats(out, Profiler::Compute(_drawCalls, _drawCalls.size()));
+            out << ",\n  \"triangles\": ";
+            WriteStats(out, Profiler::Compute(_triangles, _triangles.size()));
+
+            const Profiler::History& frame = profiler.FrameHistory();
+            out << ",\n  \"gpuFrameMs\": ";
+            WriteStats(out, Profiler::Compute(frame.Gpu, frame.Count));
+
+            out << ",\n  \"passes\": {";
+            bool first = true;
+            for (auto& scope : profiler.Scopes())
+            {
+                out << (first ? "\n" : ",\n") << "    \"" << scope.first << "\": {\"cpuMs\":";
+                WriteStats(out, profiler.CpuStats(scope.first));
+                out << ",\"gpuMs\":";
+                WriteStats(out, profiler.GpuStats(scope.first));
+                out << "}";
+                first = false;
+            }
+            out << "\n  },\n";
+
+            out << "  \"memory\": {\"renderTargetsPeakBytes\":" << memory.RenderTargetsPeak
+                << ",\"renderTargetsAllocatedBytes\":" << memory.RenderTargetsAllocated
+                << ",\"frameBuffersBytes\":" << memory.FrameBuffers << "}\n"
+                << "}\n";
+
+            std::cout << "BENCHMARK::REPORT " << _options.ReportPath << std::endl;
+            return true;
+        }
+    };
+}
+
+#endif
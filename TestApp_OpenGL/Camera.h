@@ -82,6 +82,17 @@ public:
         Reset();
     }
 
+    // rotates around CameraOrigin by the given angles (radians), for scripted camera paths
+    void Orbit(float phi, float theta)
+    {
+        Theta = theta;
+        Phi = phi;
+
+        updateCameraVectors();
+        updateCameraPosition();
+        Reset();
+    }
+
     // processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
     void ProcessMouseScroll(float yoffset)
     {
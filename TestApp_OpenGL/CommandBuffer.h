@@ -0,0 +1,187 @@
+#ifndef COMMANDBUFFER_H
+#define COMMANDBUFFER_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "JobSystem.h"
+#include "SceneUtils.h"
+#include "Mesh.h"
+
+/*
+* Deferred scene draws. Record() turns the MeshRenderers into compact DrawCommands on the job system, one slice of
+* the scene per job (stale normal matrices are refreshed there, one batch per slice), and sorts them by program and
+* VAO. The render thread then replays them: per-frame uniforms and texture bindings once per program switch,
+* per-object uniforms and the draw call for every command. Uniform locations are looked up on the render thread only,
+* cached per shader.
+*
+*   commands.Record(sceneMeshCollection, doShadows);   // returns at once
+*   ...
+*   commands.Replay(view, proj, eye, sceneParams);      // waits for the recording, then draws
+*
+* The renderers must not change between Record() and the last Replay() of the frame.
+*/
+class CommandBuffer
+{
+public:
+    struct DrawCommand
+    {
+        ShaderBase* Shader;
+        unsigned int Vao;
+        int NumIndices;
+        glm::mat4 Model;
+        glm::mat4 Normal;
+        Material Mat;
+    };
+
+    static const int Grain = 256;  // renderers per job
+
+private:
+    struct Locations
+    {
+        unsigned int Program;   // the locations belong to this program only
+        int Model, Normal, Diffuse, Specular, Shininess;
+    };
+
+    std::vector<DrawCommand> _commands;
+    JobSystem::Handle _recording;
+    // By shader, not by program id: GL hands the ids of deleted programs out again. A shader's new program (hot
+    // reload, placeholder swapped out in Poll) is created while the old one is alive, so its id always differs from
+    // the one cached and the entry is looked up again.
+    std::map<ShaderBase*, Locations> _locations;
+
+    Locations& LocationsOf(ShaderBase* shader)
+    {
+        unsigned int program = shader->ShaderCodeId();
+        auto found = _locations.find(shader);
+        if (found != _locations.end() && found->second.Program == program)
+            return found->second;
+
+        Locations& locations = _locations[shader];
+        locations.Program = program;
+        locations.Model = shader->UniformLocation(shader->UniformName_ModelMatrix());
+        locations.Normal = shader->UniformLocation(shader->UniformName_NormalMatrix());
+        locations.Diffuse = shader->UniformLocation(shader->UniformName_MaterialDiffuse());
+        locations.Specular = shader->UniformLocation(shader->UniformName_MaterialSpecular());
+        locations.Shininess = shader->UniformLocation(shader->UniformName_MaterialShininess());
+        return locations;
+    }
+
+    void Wait()
+    {
+        if (_recording)
+            Jobs().Wait(_recording);
+        _recording = nullptr;
+    }
+
+public:
+    CommandBuffer() = default;
+    ~CommandBuffer() { Wait(); }
+
+    CommandBuffer(const CommandBuffer&) = delete;
+    CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+    // Starts recording on the job system and returns, the first Replay waits for it
+    void Record(std::vector<MeshRenderer>& renderers, bool shadows)
+    {
+        Wait();
+        _commands.resize(renderers.size());
+
+        std::vector<MeshRenderer>* source = &renderers;
+        _recording = Jobs().Schedule([this, source, shadows]
+        {
+            Jobs().ParallelFor(source->size(), Grain, [this, source, shadows](int begin, int end)
+            {
+                MeshRenderer::UpdateNormalMatrices(&(*source)[begin], end - begin);
+                for (int i = begin; i < end; i++)
+                {
+                    MeshRenderer& renderer = (*source)[i];
+                    DrawCommand& command = _commands[i];
+                    command.Shader = renderer.GetShader(shadows);
+                    command.Vao = renderer.Vao();
+                    command.NumIndices = renderer.NumIndices();
+                    command.Model = renderer.ModelMatrix();
+                    command.Normal = glm::mat4(renderer.NormalMatrix());
+                    command.Mat = renderer.GetMaterial();
+                }
+            });
+
+            // Fewer program switches and VAO binds, scene order kept within a group
+            std::stable_sort(_commands.begin(), _commands.end(), [](const DrawCommand& a, const DrawCommand& b)
+            {
+                return a.Shader != b.Shader ? a.Shader < b.Shader : a.Vao < b.Vao;
+            });
+        });
+    }
+
+    int Size() { Wait(); return _commands.size(); }
+
+    // Same uniforms as MeshRenderer::Draw
+    void Replay(glm::mat4 view, glm::mat4 proj, glm::vec3 eye, SceneParams& sceneParams)
+    {
+        Wait();
+
+        ShaderBase* current = nullptr;
+        Locations locations;
+        unsigned int vao = 0;
+        for (const DrawCommand& command : _commands)
+        {
+            if (command.Shader != current)
+            {
+                current = command.Shader;
+                current->SetCurrent();
+                MeshRenderer::SetFrameUniforms(current, view, proj, eye, sceneParams);
+                locations = LocationsOf(current);
+            }
+
+            glUniformMatrix4fv(locations.Model, 1, GL_FALSE, glm::value_ptr(command.Model));
+            glUniformMatrix4fv(locations.Normal, 1, GL_FALSE, glm::value_ptr(command.Normal));
+            glUniform4fv(locations.Diffuse, 1, glm::value_ptr(command.Mat.Diffuse));
+            glUniform4fv(locations.Specular, 1, glm::value_ptr(command.Mat.Specular));
+            glUniform1f(locations.Shininess, command.Mat.Shininess);
+
+            if (command.Vao != vao)
+                glBindVertexArray(vao = command.Vao);
+            glDrawElements(GL_TRIANGLES, command.NumIndices, GL_UNSIGNED_INT, nullptr);
+            DrawStats::DrawCalls++;
+            DrawStats::Triangles += command.NumIndices / 3;
+        }
+        glBindVertexArray(0);
+
+        MeshRenderer::CheckOGLErrors();
+    }
+
+    // Same uniforms as MeshRenderer::DrawCustom, every command with one shader
+    void ReplayCustom(glm::mat4 view, glm::mat4 proj, ShaderBase* shader)
+    {
+        Wait();
+
+        shader->SetCurrent();
+        glUniformMatrix4fv(shader->UniformLocation(shader->UniformName_ViewMatrix()), 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(shader->UniformLocation(shader->UniformName_ProjectionMatrix()), 1, GL_FALSE, glm::value_ptr(proj));
+        Locations locations = LocationsOf(shader);
+
+        unsigned int vao = 0;
+        for (const DrawCommand& command : _commands)
+        {
+            glUniformMatrix4fv(locations.Model, 1, GL_FALSE, glm::value_ptr(command.Model));
+            glUniformMatrix4fv(locations.Normal, 1, GL_FALSE, glm::value_ptr(command.Normal));
+
+            if (command.Vao != vao)
+                glBindVertexArray(vao = command.Vao);
+            glDrawElements(GL_TRIANGLES, command.NumIndices, GL_UNSIGNED_INT, nullptr);
+            DrawStats::DrawCalls++;
+            DrawStats::Triangles += command.NumIndices / 3;
+        }
+        glBindVertexArray(0);
+
+        MeshRenderer::CheckOGLErrors();
+    }
+};
+
+#endif
@@ -0,0 +1,630 @@
+#ifndef ENVIRONMENTLIGHTING_H
+#define ENVIRONMENTLIGHTING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <future>
+#include <random>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+
+#include "SceneUtils.h"
+#include "Shader.h"
+#include "TextureLoader.h"
+
+/*
+* Image based lighting from the skybox cubemap, computed once at load:
+* - diffuse: the cubemap projected on 9 spherical harmonics and convolved with the clamped cosine, so the
+*   irradiance for a normal is a dot product of the coefficients with the SH basis (see FragmentSource_Geometry::DEFS_IBL).
+* - specular: a RGB16F cubemap whose mips hold the cubemap prefiltered with GGX lobes of increasing roughness,
+*   level i is roughness i / (levels - 1). It is rendered on the GPU, face by face.
+*
+* Both are stored in TextureLoader::CacheDirectory, keyed by the face files and the prefilter settings.
+* The CPU functions (SampleCube, IrradianceReference, PrefilterReference) are the reference used by
+* CompareWithReference(), they are far too slow to be used for the actual maps.
+* Like the rest of the renderer, texel values are used as they are, without sRGB decoding.
+*/
+namespace EnvironmentLighting
+{
+    static int PrefilteredSize = 128;
+    static int PrefilteredLevels = 6;
+    static int PrefilterSamples = 256;
+
+    // faces are reduced to this size before the SH projection
+    static int ProjectionSize = 64;
+
+    constexpr float PI = 3.14159265358979323846f;
+
+    // CPU cubemap ========================================================================================================== //
+    struct Cubemap
+    {
+        int Size = 0;
+        std::vector<glm::vec3> Faces[6];
+
+        bool Valid() { return Size > 0; }
+        glm::vec3 Texel(int face, int x, int y) const { return Faces[face][y * Size + x]; }
+    };
+
+    // Direction through (s, t) in [-1, 1] of a face, GL cubemap convention, faces in the +X, -X, +Y, -Y, +Z, -Z order
+    glm::vec3 FaceDirection(int face, float s, float t)
+    {
+        switch (face)
+        {
+        case 0:  return glm::vec3(1, -t, -s);
+        case 1:  return glm::vec3(-1, -t, s);
+        case 2:  return glm::vec3(s, 1, t);
+        case 3:  return glm::vec3(s, -1, -t);
+        case 4:  return glm::vec3(s, -t, 1);
+        default: return glm::vec3(-s, -t, -1);
+        }
+    }
+
+    glm::vec3 TexelDirection(int face, int x, int y, int size)
+    {
+        return glm::normalize(FaceDirection(face, 2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (y + 0.5f) / size - 1.0f));
+    }
+
+    // Solid angle of a texel, from the area element of the unit cube projected on the sphere
+    float TexelSolidAngle(int x, int y, int size)
+    {
+        auto areaElement = [](float s, float t) { return std::atan2(s * t, std::sqrt(s * s + t * t + 1.0f)); };
+
+        float s0 = 2.0f * x / size - 1.0f, s1 = 2.0f * (x + 1) / size - 1.0f;
+        float t0 = 2.0f * y / size - 1.0f, t1 = 2.0f * (y + 1) / size - 1.0f;
+        return areaElement(s0, t0) - areaElement(s0, t1) - areaElement(s1, t0) + areaElement(s1, t1);
+    }
+
+    // Nearest texel in the direction dir
+    glm::vec3 SampleCube(const Cubemap& cube, glm::vec3 dir)
+    {
+        glm::vec3 a = glm::abs(dir);
+        int face;
+        float s, t, ma;
+        if (a.x >= a.y && a.x >= a.z)
+        {
+            face = dir.x > 0 ? 0 : 1; ma = a.x;
+            s = dir.x > 0 ? -dir.z : dir.z; t = -dir.y;
+        }
+        else if (a.y >= a.z)
+        {
+            face = dir.y > 0 ? 2 : 3; ma = a.y;
+            s = dir.x; t = dir.y > 0 ? dir.z : -dir.z;
+        }
+        else
+        {
+            face = dir.z > 0 ? 4 : 5; ma = a.z;
+            s = dir.z > 0 ? dir.x : -dir.x; t = -dir.y;
+        }
+
+        int x = std::clamp((int)((s / ma * 0.5f + 0.5f) * cube.Size), 0, cube.Size - 1);
+        int y = std::clamp((int)((t / ma * 0.5f + 0.5f) * cube.Size), 0, cube.Size - 1);
+        return cube.Texel(face, x, y);
+    }
+
+    // First mip of each face no larger than maxSize, as floats in [0, 1]. Images must be uncompressed.
+    Cubemap ToCubemap(std::vector<TextureLoader::Image>& faces, int maxSize)
+    {
+        Cubemap cube;
+        if (faces.size() != 6)
+            return cube;
+
+        for (int f = 0; f < 6; f++)
+        {
+            if (!faces[f].Valid() || faces[f].Compressed)
+                return Cubemap();
+
+            int level = 0;
+            while (level + 1 < faces[f].Levels.size() && faces[f].Levels[level].Width > maxSize)
+                level++;
+
+            const TextureLoader::MipLevel& mip = faces[f].Levels[level];
+            if (f > 0 && mip.Width != cube.Size)
+                return Cubemap();
+
+            cube.Size = mip.Width;
+            cube.Faces[f].resize(mip.Width * mip.Height);
+            for (int i = 0; i < cube.Faces[f].size(); i++)
+                cube.Faces[f][i] = glm::vec3(mip.Data[i * 3], mip.Data[i * 3 + 1], mip.Data[i * 3 + 2]) / 255.0f;
+        }
+
+        return cube;
+    }
+
+    Cubemap DecodeCubemap(std::vector<std::string> faces, int maxSize)
+    {
+        std::vector<std::future<TextureLoader::Image>> decoding;
+        for (int i = 0; i < faces.size(); i++)
+            decoding.push_back(TextureLoader::DecodeAsync(faces[i], false));
+
+        std::vector<TextureLoader::Image> images;
+        for (int i = 0; i < decoding.size(); i++)
+            images.push_back(decoding[i].get());
+
+        return ToCubemap(images, maxSize);
+    }
+
+    // Spherical harmonics ================================================================================================== //
+    void SHBasis(glm::vec3 d, float basis[9])
+    {
+        basis[0] = 0.282095f;
+        basis[1] = 0.488603f * d.y;
+        basis[2] = 0.488603f * d.z;
+        basis[3] = 0.488603f * d.x;
+        basis[4] = 1.092548f * d.x * d.y;
+        basis[5] = 1.092548f * d.y * d.z;
+        basis[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+        basis[7] = 1.092548f * d.x * d.z;
+        basis[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+    }
+
+    // Projects the radiance and convolves it with the clamped cosine (A0 = pi, A1 = 2pi/3, A2 = pi/4).
+    // The result is divided by pi: EvaluateSH() times the diffuse color is the reflected radiance.
+    void ProjectSH(const Cubemap& cube, glm::vec3 sh[9])
+    {
+        for (int i = 0; i < 9; i++)
+            sh[i] = glm::vec3(0);
+
+        float basis[9];
+        float totalWeight = 0;
+        for (int f = 0; f < 6; f++)
+            for (int y = 0; y < cube.Size; y++)
+                for (int x = 0; x < cube.Size; x++)
+                {
+                    float weight = TexelSolidAngle(x, y, cube.Size);
+                    SHBasis(TexelDirection(f, x, y, cube.Size), basis);
+
+                    glm::vec3 radiance = cube.Texel(f, x, y);
+                    for (int i = 0; i < 9; i++)
+                        sh[i] += radiance * (basis[i] * weight);
+
+                    totalWeight += weight;
+                }
+
+        // the solid angles add up to 4pi up to rounding
+        float normalization = 4.0f * PI / totalWeight;
+        const float band[3] = { 1.0f, 2.0f / 3.0f, 1.0f / 4.0f };
+        for (int i = 0; i < 9; i++)
+            sh[i] *= normalization * band[i == 0 ? 0 : i < 4 ? 1 : 2];
+    }
+
+    glm::vec3 EvaluateSH(const glm::vec3 sh[9], glm::vec3 n)
+    {
+        float basis[9];
+        SHBasis(n, basis);
+
+        glm::vec3 result(0);
+        for (int i = 0; i < 9; i++)
+            result += sh[i] * basis[i];
+
+        return glm::max(result, glm::vec3(0));
+    }
+
+    // Brute force cosine convolution over every texel, what EvaluateSH() approximates
+    glm::vec3 IrradianceReference(const Cubemap& cube, glm::vec3 n)
+    {
+        glm::vec3 result(0);
+        for (int f = 0; f < 6; f++)
+            for (int y = 0; y < cube.Size; y++)
+                for (int x = 0; x < cube.Size; x++)
+                {
+                    float cosine = glm::dot(n, TexelDirection(f, x, y, cube.Size));
+                    if (cosine > 0)
+                        result += cube.Texel(f, x, y) * (cosine * TexelSolidAngle(x, y, cube.Size));
+                }
+
+        return result / PI;
+    }
+
+    // GGX prefilter ======================================================================================================== //
+    glm::vec2 Hammersley(unsigned int i, unsigned int n)
+    {
+        unsigned int bits = i;
+        bits = (bits << 16u) | (bits >> 16u);
+        bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+        bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+        bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+        bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+        return glm::vec2((float)i / n, bits * 2.3283064365386963e-10f);
+    }
+
+    // Half vector around n for the GGX distribution, roughness is perceptual (alpha = roughness^2)
+    glm::vec3 ImportanceSampleGGX(glm::vec2 xi, glm::vec3 n, float roughness)
+    {
+        float a = roughness * roughness;
+        float phi = 2.0f * PI * xi.x;
+        float cosTheta = std::sqrt((1.0f - xi.y) / (1.0f + (a * a - 1.0f) * xi.y));
+        float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+
+        glm::vec3 up = std::abs(n.z) < 0.999f ? glm::vec3(0, 0, 1) : glm::vec3(1, 0, 0);
+        glm::vec3 tangentX = glm::normalize(glm::cross(up, n));
+        glm::vec3 tangentY = glm::cross(n, tangentX);
+        return glm::normalize(tangentX * (std::cos(phi) * sinTheta) + tangentY * (std::sin(phi) * sinTheta) + n * cosTheta);
+    }
+
+    // Same integral as the GPU prefilter (n = v = r), without the mip filtering, so it needs many more samples
+    glm::vec3 PrefilterReference(const Cubemap& cube, glm::vec3 n, float roughness, int samples)
+    {
+        if (roughness == 0)
+            return SampleCube(cube, n);
+
+        glm::vec3 result(0);
+        float weight = 0;
+        for (int i = 0; i < samples; i++)
+        {
+            glm::vec3 h = ImportanceSampleGGX(Hammersley(i, samples), n, roughness);
+            glm::vec3 l = 2.0f * glm::dot(n, h) * h - n;
+
+            float nDotL = glm::dot(n, l);
+            if (nDotL > 0)
+            {
+                result += SampleCube(cube, l) * nDotL;
+                weight += nDotL;
+            }
+        }
+
+        return weight > 0 ? result / weight : result;
+    }
+
+    constexpr std::string_view PREFILTER_VERTEX =
+        R"(
+    #version 330 core
+    void main()
+    {
+        // fullscreen triangle, no vertex buffer
+        vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+    }
+    )";
+
+    constexpr std::string_view PREFILTER_FRAGMENT =
+        R"(
+    #version 330 core
+    out vec4 FragColor;
+
+    uniform samplerCube environment;
+    uniform int face;
+    uniform float faceSize;
+    uniform float roughness;
+    uniform float sourceSize;
+    uniform int sampleCount;
+
+    #define PI 3.14159265358979323846
+
+    vec3 FaceDirection(int f, vec2 st)
+    {
+        if (f == 0) return vec3(1.0, -st.y, -st.x);
+        if (f == 1) return vec3(-1.0, -st.y, st.x);
+        if (f == 2) return vec3(st.x, 1.0, st.y);
+        if (f == 3) return vec3(st.x, -1.0, -st.y);
+        if (f == 4) return vec3(st.x, -st.y, 1.0);
+        return vec3(-st.x, -st.y, -1.0);
+    }
+
+    vec2 Hammersley(uint i, uint n)
+    {
+        uint bits = i;
+        bits = (bits << 16u) | (bits >> 16u);
+        bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+        bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+        bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+        bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+        return vec2(float(i) / float(n), float(bits) * 2.3283064365386963e-10);
+    }
+
+    vec3 ImportanceSampleGGX(vec2 xi, vec3 n, float a)
+    {
+        float phi = 2.0 * PI * xi.x;
+        float cosTheta = sqrt((1.0 - xi.y) / (1.0 + (a * a - 1.0) * xi.y));
+        float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+
+        vec3 up = abs(n.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+        vec3 tangentX = normalize(cross(up, n));
+        vec3 tangentY = cross(n, tangentX);
+        return normalize(tangentX * cos(phi) * sinTheta + tangentY * sin(phi) * sinTheta + n * cosTheta);
+    }
+
+    void main()
+    {
+        vec3 n = normalize(FaceDirection(face, gl_FragCoord.xy / faceSize * 2.0 - 1.0));
+        if (roughness == 0.0)
+        {
+            FragColor = vec4(textureLod(environment, n, 0.0).rgb, 1.0);
+            return;
+        }
+
+        float a = roughness * roughness;
+        float texelSolidAngle = 4.0 * PI / (6.0 * sourceSize * sourceSize);
+        vec3 color = vec3(0.0);
+        float weight = 0.0;
+        for (int i = 0; i < sampleCount; i++)
+        {
+            vec3 h = ImportanceSampleGGX(Hammersley(uint(i), uint(sampleCount)), n, a);
+            vec3 l = 2.0 * dot(n, h) * h - n;
+            float nDotL = dot(n, l);
+            if (nDotL > 0.0)
+            {
+                // sample the mip whose texels cover the solid angle of the sample, removes most of the noise
+                float nDotH = max(dot(n, h), 0.0);
+                float d = (a * a) / (PI * pow(nDotH * nDotH * (a * a - 1.0) + 1.0, 2.0));
+                float pdf = d / 4.0 + 0.0001;
+                float sampleSolidAngle = 1.0 / (float(sampleCount) * pdf + 0.0001);
+                float mip = 0.5 * log2(sampleSolidAngle / texelSolidAngle);
+
+                color += textureLod(environment, l, max(mip, 0.0)).rgb * nDotL;
+                weight += nDotL;
+            }
+        }
+        FragColor = vec4(color / max(weight, 0.0001), 1.0);
+    }
+    )";
+
+    float LevelRoughness(int level) { return PrefilteredLevels > 1 ? (float)level / (PrefilteredLevels - 1) : 0.0f; }
+    int LevelSize(int level) { return std::max(1, PrefilteredSize >> level); }
+
+    unsigned int CreatePrefilteredMap()
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        for (int level = 0; level < PrefilteredLevels; level++)
+            for (int f = 0; f < 6; f++)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, level, GL_RGB16F, LevelSize(level), LevelSize(level), 0, GL_RGB, GL_FLOAT, NULL);
+
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, PrefilteredLevels - 1);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        return textureID;
+    }
+
+    // Renders every face and level of a new prefiltered map from sourceCubemap, which must have a full mip chain
+    unsigned int PrefilterGPU(unsigned int sourceCubemap)
+    {
+        ShaderCode program{ std::string(PREFILTER_VERTEX), std::string(PREFILTER_FRAGMENT) };
+        if (!program.Linked())
+        {
+            program.Release();
+            return 0;
+        }
+
+        int sourceSize = 0;
+        glBindTexture(GL_TEXTURE_CUBE_MAP, sourceCubemap);
+        glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_WIDTH, &sourceSize);
+
+        unsigned int textureID = CreatePrefilteredMap();
+
+        // the caller's state is restored at the end
+        int previousFramebuffer = 0, previousViewport[4];
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glGetIntegerv(GL_VIEWPORT, previousViewport);
+        bool depthTest = glIsEnabled(GL_DEPTH_TEST);
+
+        unsigned int fbo, vao;
+        glGenFramebuffers(1, &fbo);
+        glGenVertexArrays(1, &vao);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glBindVertexArray(vao);
+        glDisable(GL_DEPTH_TEST);
+
+        glUseProgram(program.ID);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, sourceCubemap);
+        glUniform1i(glGetUniformLocation(program.ID, "environment"), 0);
+        glUniform1f(glGetUniformLocation(program.ID, "sourceSize"), (float)sourceSize);
+        glUniform1i(glGetUniformLocation(program.ID, "sampleCount"), PrefilterSamples);
+
+        for (int level = 0; level < PrefilteredLevels; level++)
+        {
+            glViewport(0, 0, LevelSize(level), LevelSize(level));
+            glUniform1f(glGetUniformLocation(program.ID, "faceSize"), (float)LevelSize(level));
+            glUniform1f(glGetUniformLocation(program.ID, "roughness"), LevelRoughness(level));
+
+            for (int f = 0; f < 6; f++)
+            {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, textureID, level);
+                glUniform1i(glGetUniformLocation(program.ID, "face"), f);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            }
+        }
+
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+
+        glDeleteVertexArrays(1, &vao);
+        glDeleteFramebuffers(1, &fbo);
+        program.Release();
+        return textureID;
+    }
+
+    // Texels of one face of one level, RGB floats
+    std::vector<float> ReadFace(unsigned int textureID, int face, int level)
+    {
+        std::vector<float> data(LevelSize(level) * LevelSize(level) * 3);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB, GL_FLOAT, data.data());
+        return data;
+    }
+
+    // Disk cache =========================================================================================================== //
+    std::string CachePath(std::vector<std::string> faces)
+    {
+        std::string key = std::to_string(PrefilteredSize) + "|" + std::to_string(PrefilteredLevels) + "|" + std::to_string(PrefilterSamples) + "|" + std::to_string(ProjectionSize);
+        for (int i = 0; i < faces.size(); i++)
+            key += "|" + TextureLoader::CachePath(faces[i]);
+
+        return TextureLoader::CacheDirectory + std::to_string(std::hash<std::string>()(key)) + ".env";
+    }
+
+    bool ReadCache(std::string cachePath, EnvironmentLight* environment)
+    {
+        std::ifstream file(cachePath, std::ios::binary);
+        if (!file)
+            return false;
+
+        int size = 0, levels = 0;
+        file.read((char*)environment->IrradianceSH, sizeof(environment->IrradianceSH));
+        file.read((char*)&size, sizeof(size));
+        file.read((char*)&levels, sizeof(levels));
+        if (!file || size != PrefilteredSize || levels != PrefilteredLevels)
+            return false;
+
+        std::vector<std::vector<float>> faces;
+        for (int level = 0; level < levels; level++)
+            for (int f = 0; f < 6; f++)
+            {
+                std::vector<float> data(LevelSize(level) * LevelSize(level) * 3);
+                file.read((char*)data.data(), data.size() * sizeof(float));
+                faces.push_back(data);
+            }
+
+        if (!file)
+            return false;
+
+        environment->PrefilteredMapId = CreatePrefilteredMap();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int level = 0; level < levels; level++)
+            for (int f = 0; f < 6; f++)
+                glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, level, 0, 0, LevelSize(level), LevelSize(level), GL_RGB, GL_FLOAT, faces[level * 6 + f].data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        return true;
+    }
+
+    void WriteCache(std::string cachePath, EnvironmentLight& environment)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(TextureLoader::CacheDirectory, error);
+
+        std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return;
+
+        file.write((char*)environment.IrradianceSH, sizeof(environment.IrradianceSH));
+        file.write((char*)&PrefilteredSize, sizeof(PrefilteredSize));
+        file.write((char*)&PrefilteredLevels, sizeof(PrefilteredLevels));
+        for (int level = 0; level < PrefilteredLevels; level++)
+            for (int f = 0; f < 6; f++)
+            {
+                std::vector<float> data = ReadFace(environment.PrefilteredMapId, f, level);
+                file.write((char*)data.data(), data.size() * sizeof(float));
+            }
+    }
+
+    // Load ================================================================================================================= //
+    // faces are the files sourceCubemap was loaded from, in the +X, -X, +Y, -Y, +Z, -Z order
+    EnvironmentLight Load(std::vector<std::string> faces, unsigned int sourceCubemap)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        EnvironmentLight environment;
+        environment.MaxLod = PrefilteredLevels - 1;
+
+        std::string cachePath = CachePath(faces);
+        if (ReadCache(cachePath, &environment))
+        {
+            environment.Enabled = true;
+            std::cout << "ENVIRONMENT::LOADED cache " << TextureLoader::ElapsedMs(start) << " ms" << std::endl;
+            return environment;
+        }
+
+        if (sourceCubemap == 0)
+        {
+            std::cout << "ERROR::ENVIRONMENT::NO_SOURCE_CUBEMAP" << std::endl;
+            return environment;
+        }
+
+        Cubemap cube = DecodeCubemap(faces, ProjectionSize);
+        if (!cube.Valid())
+        {
+            std::cout << "ERROR::ENVIRONMENT::INVALID_FACES" << std::endl;
+            return environment;
+        }
+        ProjectSH(cube, environment.IrradianceSH);
+
+        environment.PrefilteredMapId = PrefilterGPU(sourceCubemap);
+        if (environment.PrefilteredMapId == 0)
+        {
+            std::cout << "ERROR::ENVIRONMENT::PREFILTER_FAILED" << std::endl;
+            return environment;
+        }
+
+        WriteCache(cachePath, environment);
+        environment.Enabled = true;
+        std::cout << "ENVIRONMENT::LOADED computed " << TextureLoader::ElapsedMs(start) << " ms" << std::endl;
+        return environment;
+    }
+
+    // Reference check ====================================================================================================== //
+    struct ReferenceError
+    {
+        float IrradianceMax = 0;
+        float IrradianceAverage = 0;
+        std::vector<float> PrefilterMax;
+        std::vector<float> PrefilterAverage;
+    };
+
+    // Compares the loaded maps with the CPU reference at random texels, errors are per channel in [0, 1] units
+    ReferenceError CompareWithReference(EnvironmentLight& environment, std::vector<std::string> faces, int directions = 32, int referenceSamples = 2048)
+    {
+        ReferenceError result;
+        Cubemap irradianceCube = DecodeCubemap(faces, ProjectionSize);
+        Cubemap prefilterCube = DecodeCubemap(faces, 256);
+        if (!irradianceCube.Valid() || !prefilterCube.Valid() || !environment.Enabled)
+            return result;
+
+        std::mt19937 generator(1234);
+        std::uniform_int_distribution<int> faceDistribution(0, 5);
+        std::uniform_real_distribution<float> unitDistribution(0.0f, 1.0f);
+        auto maxChannel = [](glm::vec3 v) { return std::max(v.x, std::max(v.y, v.z)); };
+
+        for (int i = 0; i < directions; i++)
+        {
+            glm::vec3 n = TexelDirection(faceDistribution(generator), 0, 0, 1);
+            n = glm::normalize(n + glm::vec3(unitDistribution(generator), unitDistribution(generator), unitDistribution(generator)) - 0.5f);
+            float error = maxChannel(glm::abs(EvaluateSH(environment.IrradianceSH, n) - IrradianceReference(irradianceCube, n)));
+            result.IrradianceMax = std::max(result.IrradianceMax, error);
+            result.IrradianceAverage += error / directions;
+        }
+
+        for (int level = 0; level < PrefilteredLevels; level++)
+        {
+            int size = LevelSize(level);
+            float maxError = 0, averageError = 0;
+            std::vector<float> faceData[6];
+            for (int f = 0; f < 6; f++)
+                faceData[f] = ReadFace(environment.PrefilteredMapId, f, level);
+
+            for (int i = 0; i < directions; i++)
+            {
+                int f = faceDistribution(generator);
+                int x = std::min(size - 1, (int)(unitDistribution(generator) * size));
+                int y = std::min(size - 1, (int)(unitDistribution(generator) * size));
+                const float* texel = &faceData[f][(y * size + x) * 3];
+
+                glm::vec3 reference = PrefilterReference(prefilterCube, TexelDirection(f, x, y, size), LevelRoughness(level), referenceSamples);
+                float error = maxChannel(glm::abs(glm::vec3(texel[0], texel[1], texel[2]) - reference));
+                maxError = std::max(maxError, error);
+                averageError += error / directions;
+            }
+
+            result.PrefilterMax.push_back(maxError);
+            result.PrefilterAverage.push_back(averageError);
+        }
+
+        return result;
+    }
+}
+
+#endif
@@ -8,8 +8,50 @@
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <utility>
+#include <algorithm>
 
 
+// Descriptors ============================================================================================================ //
+struct AttachmentDesc
+{
+	GLenum InternalFormat;
+
+	// Renderbuffers cannot be sampled, use them for targets that are only written or resolved (e.g. MSAA depth)
+	bool Renderbuffer = false;
+
+	// Texture attachments only, ignored when multisampled
+	int Mips = 1;
+};
+
+struct FrameBufferDesc
+{
+	unsigned int Width = 0, Height = 0;
+
+	// > 1 makes every attachment multisampled, see FrameBuffer::ResolveTo
+	int Samples = 1;
+
+	std::vector<AttachmentDesc> Color;
+	bool HasDepth = false;
+	AttachmentDesc Depth = { GL_DEPTH_COMPONENT32F };
+
+	FrameBufferDesc() {}
+	FrameBufferDesc(unsigned int width, unsigned int height, int samples = 1) : Width(width), Height(height), Samples(samples) {}
+
+	FrameBufferDesc& AddColor(GLenum internalFormat, bool renderbuffer = false, int mips = 1)
+	{
+		Color.push_back({ internalFormat, renderbuffer, mips });
+		return *this;
+	}
+
+	FrameBufferDesc& WithDepth(GLenum internalFormat = GL_DEPTH_COMPONENT32F, bool renderbuffer = false)
+	{
+		HasDepth = true;
+		Depth = { internalFormat, renderbuffer, 1 };
+		return *this;
+	}
+};
+
 class FrameBuffer
 {
 private:
@@ -17,67 +59,189 @@ private:
 	unsigned int _idTexDepth;
 	std::vector<unsigned int> _idTexCol;
 	unsigned int _width, _height;
-	bool _depth, _color;
-	
-	void Initialize(unsigned int width, unsigned int height, bool depth, bool color, int colorAttachments)
-	{
-		//TODO: hardcoded formats are not the best, right?
-		glGenFramebuffers(1, &_id);
+	FrameBufferDesc _desc;
 
-		if (depth)
+public:
+	// Format helpers, shared with RenderTargetPool =================================================================== //
+	static bool IsDepthFormat(GLenum internalFormat)
+	{
+		switch (internalFormat)
 		{
-			glGenTextures(1, &_idTexDepth);
-			glBindTexture(GL_TEXTURE_2D, _idTexDepth);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-				width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		case GL_DEPTH_COMPONENT:
+		case GL_DEPTH_COMPONENT16:
+		case GL_DEPTH_COMPONENT24:
+		case GL_DEPTH_COMPONENT32:
+		case GL_DEPTH_COMPONENT32F:
+		case GL_DEPTH_STENCIL:
+		case GL_DEPTH24_STENCIL8:
+		case GL_DEPTH32F_STENCIL8:
+			return true;
+		default:
+			return false;
+		}
+	}
 
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	static bool HasStencil(GLenum internalFormat)
+	{
+		return internalFormat == GL_DEPTH_STENCIL || internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8;
+	}
 
-			glBindTexture(GL_TEXTURE_2D, 0);
-		}
+	static GLenum PixelFormat(GLenum internalFormat)
+	{
+		if (HasStencil(internalFormat))
+			return GL_DEPTH_STENCIL;
+		if (IsDepthFormat(internalFormat))
+			return GL_DEPTH_COMPONENT;
 
-		if (color)
+		switch (internalFormat)
 		{
-			for (int i = 0; i < colorAttachments; i++)
-			{
-				unsigned int id = 0;
-				glGenTextures(1, &id);
-				glBindTexture(GL_TEXTURE_2D, id);
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F,
-					width, height, 0, GL_RGB, GL_FLOAT, NULL);
-
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-				glBindTexture(GL_TEXTURE_2D, 0);
-
-				_idTexCol.push_back(id);
-			}
+		case GL_R8:
+		case GL_R16F:
+		case GL_R32F:
+			return GL_RED;
+		case GL_RG8:
+		case GL_RG16F:
+		case GL_RG32F:
+			return GL_RG;
+		case GL_RGBA8:
+		case GL_SRGB8_ALPHA8:
+		case GL_RGBA16F:
+		case GL_RGBA32F:
+			return GL_RGBA;
+		default:
+			return GL_RGB;
 		}
+	}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, _id);
+	// Type of the (null) data passed at allocation, it only has to be valid for the format
+	static GLenum PixelType(GLenum internalFormat)
+	{
+		if (internalFormat == GL_DEPTH32F_STENCIL8)
+			return GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
+		if (HasStencil(internalFormat))
+			return GL_UNSIGNED_INT_24_8;
 
+		return GL_FLOAT;
+	}
 
-		if (color)
+	// Bytes per sample, for the memory reports
+	static int BytesPerPixel(GLenum internalFormat)
+	{
+		switch (internalFormat)
 		{
-			for (int i = 0; i < colorAttachments; i++)
-			{
-				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, _idTexCol[i], 0);
-			}
+		case GL_R8:                 return 1;
+		case GL_RG8:
+		case GL_R16F:
+		case GL_DEPTH_COMPONENT16:  return 2;
+		case GL_RGB8:               return 3;
+		case GL_RGBA8:
+		case GL_SRGB8_ALPHA8:
+		case GL_RG16F:
+		case GL_R32F:
+		case GL_R11F_G11F_B10F:
+		case GL_DEPTH_COMPONENT24:
+		case GL_DEPTH_COMPONENT32:
+		case GL_DEPTH_COMPONENT32F:
+		case GL_DEPTH24_STENCIL8:   return 4;
+		case GL_RGB16F:             return 6;
+		case GL_RG32F:
+		case GL_RGBA16F:
+		case GL_DEPTH32F_STENCIL8:  return 8;
+		case GL_RGB32F:             return 12;
+		case GL_RGBA32F:            return 16;
+		default:                    return 4;
+		}
+	}
+
+private:
+	bool Multisampled()
+	{
+		return _desc.Samples > 1;
+	}
 
-			if (depth)
-				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _idTexDepth, 0);
+	// (Re)allocates the storage of an attachment at the current size, the object name is kept
+	void Allocate(unsigned int id, const AttachmentDesc& attachment)
+	{
+		if (attachment.Renderbuffer)
+		{
+			glBindRenderbuffer(GL_RENDERBUFFER, id);
+			if (Multisampled())
+				glRenderbufferStorageMultisample(GL_RENDERBUFFER, _desc.Samples, attachment.InternalFormat, _width, _height);
+			else
+				glRenderbufferStorage(GL_RENDERBUFFER, attachment.InternalFormat, _width, _height);
+			glBindRenderbuffer(GL_RENDERBUFFER, 0);
+			return;
+		}
 
+		if (Multisampled())
+		{
+			glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, id);
+			glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, _desc.Samples, attachment.InternalFormat, _width, _height, GL_TRUE);
+			glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+			return;
 		}
-		else if (depth)
+
+		int mips = std::max(1, attachment.Mips);
+		glBindTexture(GL_TEXTURE_2D, id);
+		for (int level = 0; level < mips; level++)
 		{
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _idTexDepth, 0);
+			glTexImage2D(GL_TEXTURE_2D, level, attachment.InternalFormat,
+				std::max(1u, _width >> level), std::max(1u, _height >> level), 0, PixelFormat(attachment.InternalFormat), PixelType(attachment.InternalFormat), NULL);
+		}
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mips - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mips > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mips > 1 ? GL_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	unsigned int Create(const AttachmentDesc& attachment)
+	{
+		unsigned int id = 0;
+		if (attachment.Renderbuffer)
+			glGenRenderbuffers(1, &id);
+		else
+			glGenTextures(1, &id);
+
+		Allocate(id, attachment);
+		return id;
+	}
+
+	void Attach(GLenum target, GLenum attachmentPoint, unsigned int id, const AttachmentDesc& attachment)
+	{
+		if (attachment.Renderbuffer)
+			glFramebufferRenderbuffer(target, attachmentPoint, GL_RENDERBUFFER, id);
+		else
+			glFramebufferTexture2D(target, attachmentPoint, Multisampled() ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D, id, 0);
+	}
+
+	GLenum DepthAttachmentPoint()
+	{
+		return HasStencil(_desc.Depth.InternalFormat) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+	}
+
+	void Initialize()
+	{
+		glGenFramebuffers(1, &_id);
 
+		for (int i = 0; i < _desc.Color.size(); i++)
+			_idTexCol.push_back(Create(_desc.Color[i]));
+
+		if (_desc.HasDepth)
+			_idTexDepth = Create(_desc.Depth);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, _id);
+
+		for (int i = 0; i < _idTexCol.size(); i++)
+			Attach(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, _idTexCol[i], _desc.Color[i]);
+
+		if (_desc.HasDepth)
+			Attach(GL_FRAMEBUFFER, DepthAttachmentPoint(), _idTexDepth, _desc.Depth);
+
+		if (_idTexCol.empty())
+		{
 			glDrawBuffer(GL_NONE);
 			glReadBuffer(GL_NONE);
 		}
@@ -86,15 +250,30 @@ private:
 			std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
 
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
 
+	static FrameBufferDesc LegacyDesc(unsigned int width, unsigned int height, bool color, int colorAttachments, bool depth, GLenum colorFormat)
+	{
+		FrameBufferDesc desc(width, height);
+		for (int i = 0; color && i < colorAttachments; i++)
+			desc.AddColor(colorFormat);
+		if (depth)
+			desc.WithDepth();
+		return desc;
 	}
+
 public:
-	FrameBuffer(unsigned int width, unsigned int height, bool color, int colorAttachments, bool depth)
-		:_width(width), _height(height), _depth(depth), _color(color)
+	FrameBuffer(FrameBufferDesc desc)
+		:_id(0), _idTexDepth(0), _width(desc.Width), _height(desc.Height), _desc(desc)
+	{
+		Initialize();
+	}
+
+	FrameBuffer(unsigned int width, unsigned int height, bool color, int colorAttachments, bool depth, GLenum colorFormat = GL_RGB32F)
+		:FrameBuffer(LegacyDesc(width, height, color, colorAttachments, depth, colorFormat))
 	{
-		Initialize(_width, _height, _depth, _color, colorAttachments);
 	}
-	
+
 	//~FrameBuffer()
 	//{
 	//	FreeUnmanagedResources();
@@ -102,18 +281,21 @@ public:
 
 	void FreeUnmanagedResources()
 	{
-		if (_idTexCol[0] != 0)
+		auto release = [](unsigned int id, const AttachmentDesc& attachment)
 		{
-			for (int i = 0; i < _idTexCol.size(); i++)
-			{
-				glDeleteTextures(1, &_idTexCol[i]);
-			}
+			if (attachment.Renderbuffer)
+				glDeleteRenderbuffers(1, &id);
+			else
+				glDeleteTextures(1, &id);
+		};
+
+		for (int i = 0; i < _idTexCol.size(); i++)
+			release(_idTexCol[i], _desc.Color[i]);
+		_idTexCol.clear();
 
-			_idTexCol.clear();
-		}
 		if (_idTexDepth != 0)
 		{
-			glDeleteTextures(1, &_idTexDepth);
+			release(_idTexDepth, _desc.Depth);
 			_idTexDepth = 0;
 		}
 		if (_id != 0)
@@ -122,6 +304,28 @@ public:
 			_id = 0;
 		}
 	}
+
+	// Reallocates the attachments at the new size in place: same FBO, same texture names, contents undefined
+	void Resize(unsigned int width, unsigned int height)
+	{
+		if (width == _width && height == _height)
+			return;
+
+		_width = _desc.Width = width;
+		_height = _desc.Height = height;
+
+		for (int i = 0; i < _idTexCol.size(); i++)
+			Allocate(_idTexCol[i], _desc.Color[i]);
+		if (_desc.HasDepth)
+			Allocate(_idTexDepth, _desc.Depth);
+
+		// renderbuffers and textures keep their attachment, completeness only depends on the sizes matching again
+		glBindFramebuffer(GL_FRAMEBUFFER, _id);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete after resize!" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
 	void Bind(bool read, bool write)
 	{
 		int mask = (read ? GL_READ_FRAMEBUFFER : 0) | (write ? GL_DRAW_FRAMEBUFFER : 0);
@@ -138,6 +342,12 @@ public:
 		return _id;
 	}
 
+	const FrameBufferDesc& Desc()
+	{
+		return _desc;
+	}
+
+	// Texture (or renderbuffer) names, GL_TEXTURE_2D_MULTISAMPLE textures when Samples > 1
 	unsigned int DepthTextureId()
 	{
 		return _idTexDepth;
@@ -153,6 +363,61 @@ public:
 		return _idTexCol[attachment];
 	}
 
+	int ColorAttachmentsCount()
+	{
+		return _idTexCol.size();
+	}
+
+	// GPU memory of the attachments, mips and samples included
+	size_t MemorySize()
+	{
+		auto attachmentSize = [this](const AttachmentDesc& attachment)
+		{
+			size_t size = 0;
+			int levels = (Multisampled() || attachment.Renderbuffer) ? 1 : std::max(1, attachment.Mips);
+			for (int level = 0; level < levels; level++)
+				size += (size_t)std::max(1u, _width >> level) * std::max(1u, _height >> level) * BytesPerPixel(attachment.InternalFormat);
+			return size * std::max(1, _desc.Samples);
+		};
+
+		size_t size = 0;
+		for (int i = 0; i < _desc.Color.size(); i++)
+			size += attachmentSize(_desc.Color[i]);
+		if (_desc.HasDepth)
+			size += attachmentSize(_desc.Depth);
+		return size;
+	}
+
+	// Fills the mip chain of a color attachment from level 0
+	void GenerateMips(int attachment)
+	{
+		if (Multisampled() || _desc.Color[attachment].Renderbuffer || _desc.Color[attachment].Mips <= 1)
+			return;
+
+		glBindTexture(GL_TEXTURE_2D, _idTexCol[attachment]);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	// Selects the color attachment written by the next draw calls (the FBO must be bound)
+	void DrawTo(int attachment)
+	{
+		glDrawBuffer(GL_COLOR_ATTACHMENT0 + attachment);
+	}
+
+	// Swaps the textures behind two color attachments, so that a pass can read from one attachment
+	// and write the other, then swap and read its own result as attachment a (ping-pong).
+	// Leaves the FBO bound for drawing.
+	void SwapColorAttachments(int a, int b)
+	{
+		std::swap(_idTexCol[a], _idTexCol[b]);
+		std::swap(_desc.Color[a], _desc.Color[b]);
+
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _id);
+		Attach(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + a, _idTexCol[a], _desc.Color[a]);
+		Attach(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + b, _idTexCol[b], _desc.Color[b]);
+	}
+
 	unsigned int Width()
 	{
 		return _width;
@@ -163,6 +428,29 @@ public:
 		return _height;
 	}
 
+	// Resolves a multisampled color attachment (and the depth if asked) into attachment targetAttachment of target,
+	// NULL is the default framebuffer. Depth can only be resolved into a target with the same depth format.
+	void ResolveTo(FrameBuffer* target, int attachment, int targetAttachment, bool depth)
+	{
+		unsigned int id = target != NULL ? target->_id : 0;
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, _id);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, id);
+
+		glReadBuffer(GL_COLOR_ATTACHMENT0 + attachment);
+		glDrawBuffer(id != 0 ? GL_COLOR_ATTACHMENT0 + targetAttachment : GL_BACK);
+
+		// multisample blits cannot scale, sizes must match
+		glBlitFramebuffer(0, 0, _width, _height, 0, 0, _width, _height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		if (depth && _desc.HasDepth)
+			glBlitFramebuffer(0, 0, _width, _height, 0, 0, _width, _height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		if (id != 0)
+			glDrawBuffer(GL_COLOR_ATTACHMENT0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
 	void CopyFromOtherFbo(FrameBuffer* other, bool color, int attachment, bool depth, glm::ivec2 rect0, glm::ivec2 rect1)
 	{
 
@@ -12,6 +12,11 @@
 #include <glm/gtc/type_ptr.hpp>
 #include "SceneUtils.h"
 #include <limits>
+#include <vector>
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_IX86_FP)
+#include <xmmintrin.h>
+#define WORKBENCH_SSE
+#endif
 
 namespace Utils
 {
@@ -27,40 +32,68 @@ namespace Utils
 	};
 
 
-	void GetMinMax(std::vector<glm::vec3> points, glm::vec3 &min, glm::vec3 &max)
+	// Bounds of count points moved by an affine transform, straight from the position stream: no transformed copy.
+	// SSE keeps one point per register (x, y, z, w lanes) and two min/max pairs to hide the compare latency.
+	void GetTransformedMinMax(const glm::vec3* points, int count, const glm::mat4& transform, glm::vec3& min, glm::vec3& max)
 	{
-		float
-			min_x, min_y, min_z,
-			max_x, max_y, max_z;
+#ifdef WORKBENCH_SSE
+		const __m128 c0 = _mm_loadu_ps(&transform[0][0]);
+		const __m128 c1 = _mm_loadu_ps(&transform[1][0]);
+		const __m128 c2 = _mm_loadu_ps(&transform[2][0]);
+		const __m128 c3 = _mm_loadu_ps(&transform[3][0]);
 
-		min_x = min_y = min_z = std::numeric_limits<float>::max();
-		max_x = max_y = max_z = std::numeric_limits<float>::min();
+		__m128 min0 = _mm_set1_ps(std::numeric_limits<float>::max()), min1 = min0;
+		__m128 max0 = _mm_set1_ps(std::numeric_limits<float>::lowest()), max1 = max0;
 
-		for (int i = 0; i < points.size(); i++)
+		int i = 0;
+		for (; i + 2 <= count; i += 2)
 		{
-			// Compute Minimum ======================================
-			if (points[i].x < min_x)
-				min_x = points[i].x;
-			if (points[i].y < min_y)
-				min_y = points[i].y;
-			if (points[i].z < min_z)
-				min_z = points[i].z;
-
-			// Compute Maximum ======================================
-			if (points[i].x > max_x)
-				max_x = points[i].x;
-			if (points[i].y > max_y)
-				max_y = points[i].y;
-			if (points[i].z > max_z)
-				max_z = points[i].z;
+			const float* a = &points[i].x;
+			const float* b = &points[i + 1].x;
+			__m128 pa = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(a[0])), _mm_mul_ps(c1, _mm_set1_ps(a[1]))), _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(a[2])), c3));
+			__m128 pb = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(b[0])), _mm_mul_ps(c1, _mm_set1_ps(b[1]))), _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(b[2])), c3));
+			min0 = _mm_min_ps(min0, pa);
+			max0 = _mm_max_ps(max0, pa);
+			min1 = _mm_min_ps(min1, pb);
+			max1 = _mm_max_ps(max1, pb);
 		}
+		if (i < count)
+		{
+			const float* a = &points[i].x;
+			__m128 pa = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(a[0])), _mm_mul_ps(c1, _mm_set1_ps(a[1]))), _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(a[2])), c3));
+			min0 = _mm_min_ps(min0, pa);
+			max0 = _mm_max_ps(max0, pa);
+		}
+
+		alignas(16) float lo[4], hi[4];
+		_mm_store_ps(lo, _mm_min_ps(min0, min1));
+		_mm_store_ps(hi, _mm_max_ps(max0, max1));
+		min = glm::vec3(lo[0], lo[1], lo[2]);
+		max = glm::vec3(hi[0], hi[1], hi[2]);
+#else
+		min = glm::vec3(1, 1, 1) * std::numeric_limits<float>::max();
+		max = glm::vec3(1, 1, 1) * std::numeric_limits<float>::lowest();
+		for (int i = 0; i < count; i++)
+		{
+			glm::vec3 point = glm::vec3(transform * glm::vec4(points[i], 1.0f));
+			min = glm::min(min, point);
+			max = glm::max(max, point);
+		}
+#endif
+	}
 
-		min = glm::vec3(min_x, min_y, min_z);
-		max = glm::vec3(max_x, max_y, max_z);
+	void GetMinMax(const glm::vec3* points, int count, glm::vec3& min, glm::vec3& max)
+	{
+		GetTransformedMinMax(points, count, glm::mat4(1.0f), min, max);
+	}
 
+	// No points: min is +max float and max is -max float, so merging with it changes nothing
+	void GetMinMax(const std::vector<glm::vec3>& points, glm::vec3 &min, glm::vec3 &max)
+	{
+		GetMinMax(points.data(), points.size(), min, max);
 	}
 
-	void GetShadowMatrices(glm::vec3 position, glm::vec3 direction, std::vector<glm::vec3> bboxPoints, glm::mat4 &view, glm::mat4 &proj)
+	void GetShadowMatrices(glm::vec3 position, glm::vec3 direction, const std::vector<glm::vec3>& bboxPoints, glm::mat4 &view, glm::mat4 &proj)
 	{
 		glm::vec3 center = (position + direction);
 		glm::vec3 worldZ = glm::vec3(0.0f, 0.0f, 1.0f);
@@ -71,19 +104,10 @@ namespace Utils
 		*/
 		view = glm::lookAt(position, center, worldZ);
 
-		// this containter stores the bbox points in camera space
-		std::vector<glm::vec3> projPoints = std::vector<glm::vec3>();
-
-		for (int i = 0; i < bboxPoints.size(); i++)
-		{
-			glm::vec3 projPoint =view * glm::vec4(bboxPoints[i], 1.0f);
-
-			projPoints.push_back(projPoint);
-		}
-
+		// bbox points in light space
 		glm::vec3 min, max;
 
-		GetMinMax(projPoints, min, max);
+		GetTransformedMinMax(bboxPoints.data(), bboxPoints.size(), view, min, max);
 
 		proj = glm::ortho(
 			min.x,
@@ -96,22 +120,13 @@ namespace Utils
 		);
 	}
 
-	void GetTightNearFar(std::vector<glm::vec3> bboxPoints, glm::mat4 view, float& near, float& far)
+	void GetTightNearFar(const std::vector<glm::vec3>& bboxPoints, glm::mat4 view, float& near, float& far)
 	{
 		
-		// this containter stores the bbox points in camera space
-		std::vector<glm::vec3> projPoints = std::vector<glm::vec3>();
-
-		for (int i = 0; i < bboxPoints.size(); i++)
-		{
-			glm::vec3 projPoint = view * glm::vec4(bboxPoints[i], 1.0f);
-
-			projPoints.push_back(projPoint);
-		}
-
+		// bbox points in camera space
 		glm::vec3 min, max;
 
-		GetMinMax(projPoints, min, max);
+		GetTransformedMinMax(bboxPoints.data(), bboxPoints.size(), view, min, max);
 
 		near = -0.9f * max.z;
 		far = -1.1f * min.z;
@@ -125,16 +140,16 @@ private:
 	float _size;
 
 public:
-	BoundingBox(std::vector<glm::vec3> points)
+	BoundingBox(const std::vector<glm::vec3>& points)
 	{
 
 		_min = glm::vec3(1, 1, 1) * std::numeric_limits<float>::max();
-		_max = glm::vec3(1, 1, 1) * std::numeric_limits<float>::min();
+		_max = glm::vec3(1, 1, 1) * std::numeric_limits<float>::lowest();
 
 		Update(points);
 	}
 
-	void Update(std::vector<glm::vec3> points)
+	void Update(const std::vector<glm::vec3>& points)
 	{
 
 		glm::vec3 nMin = glm::vec3();
@@ -142,6 +157,13 @@ public:
 
 		Utils::GetMinMax(points, nMin, nMax);
 
+		Update(nMin, nMax);
+	}
+
+	// Merges another box (e.g. from Utils::GetTransformedMinMax)
+	void Update(glm::vec3 nMin, glm::vec3 nMax)
+	{
+
 		_min = glm::vec3(
 			glm::min(nMin.x, _min.x),
 			glm::min(nMin.y, _min.y),
@@ -212,6 +234,8 @@ public:
 				_min + glm::vec3(0, 0, 1) * _diagonal.z,	
 		};
 	}
+	// Nothing added yet (e.g. a scene still loading)
+	bool Empty() { return _min.x > _max.x; };
 	glm::vec3 Center() { return _center; };
 	glm::vec3 Diagonal() { return _diagonal; };
 	float Size() { return _size; };
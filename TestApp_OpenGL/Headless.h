@@ -0,0 +1,245 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+#ifdef WORKBENCH_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <filesystem>
+
+#include "FrameBuffer.h"
+
+/*
+* Headless runs: no window and no ImGui, a fixed number of frames along a scripted orbit, each one resolved into an
+* offscreen FrameBuffer, read back and hashed (FNV-1a over the RGBA8 pixels), optionally written as a PPM image.
+*
+*   TestApp_OpenGL --headless [--frames N] [--size WxH] [--out dir] [--images]
+*
+* Built with WORKBENCH_EGL (link libEGL) the context is a surfaceless EGL one, which Mesa serves with llvmpipe on
+* machines without a GPU (LIBGL_ALWAYS_SOFTWARE=1 forces it). Otherwise an invisible GLFW window provides the
+* context; the default framebuffer is not used in either case.
+*/
+namespace Headless
+{
+    struct Options
+    {
+        bool Enabled = false;
+        int Frames = 60;
+        int Width = 1280;
+        int Height = 720;
+        std::string OutputDirectory = "./Headless/";
+        bool WriteImages = false;
+        bool Hashes = true;         // off for benchmark runs, the readback would be part of the frame time
+    };
+
+    Options Parse(int argc, char** argv)
+    {
+        Options options;
+        for (int i = 1; i < argc; i++)
+        {
+            bool hasValue = i + 1 < argc;
+            if (!strcmp(argv[i], "--headless"))
+                options.Enabled = true;
+            else if (!strcmp(argv[i], "--frames") && hasValue)
+                options.Frames = std::max(1, atoi(argv[++i]));
+            else if (!strcmp(argv[i], "--size") && hasValue)
+            {
+                std::string size = argv[++i];
+                size_t x = size.find('x');
+                int width = x == std::string::npos ? 0 : atoi(size.substr(0, x).c_str());
+                int height = x == std::string::npos ? 0 : atoi(size.substr(x + 1).c_str());
+                if (width > 0 && height > 0)
+                {
+                    options.Width = width;
+                    options.Height = height;
+                }
+                else
+                    std::cout << "ERROR::HEADLESS::BAD_SIZE " << size << ", expected WxH" << std::endl;
+            }
+            else if (!strcmp(argv[i], "--out") && hasValue)
+                options.OutputDirectory = std::string(argv[++i]) + "/";
+            else if (!strcmp(argv[i], "--images"))
+                options.WriteImages = true;
+        }
+        return options;
+    }
+
+#ifdef WORKBENCH_EGL
+    static EGLDisplay Display = EGL_NO_DISPLAY;
+    static EGLContext Context = EGL_NO_CONTEXT;
+
+    void* GetProcAddress(const char* name)
+    {
+        return (void*)eglGetProcAddress(name);
+    }
+
+    // Surfaceless display when the Mesa platform is there, the default one otherwise
+    bool CreateContext()
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            Display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (Display == EGL_NO_DISPLAY)
+            Display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint major, minor;
+        if (Display == EGL_NO_DISPLAY || !eglInitialize(Display, &major, &minor))
+        {
+            std::cout << "ERROR::HEADLESS::EGL_INITIALIZE_FAILED" << std::endl;
+            return false;
+        }
+
+        const EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(Display, configAttributes, &config, 1, &configCount) || configCount == 0)
+        {
+            std::cout << "ERROR::HEADLESS::EGL_NO_CONFIG" << std::endl;
+            return false;
+        }
+
+        // Same versions as the windowed path: 4.3 for compute shaders, 3.3 otherwise
+        const int contextVersions[][2] = { { 4, 3 }, { 3, 3 } };
+        for (int i = 0; i < 2 && Context == EGL_NO_CONTEXT; i++)
+        {
+            const EGLint contextAttributes[] = {
+                EGL_CONTEXT_MAJOR_VERSION, contextVersions[i][0],
+                EGL_CONTEXT_MINOR_VERSION, contextVersions[i][1],
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                EGL_NONE };
+            Context = eglCreateContext(Display, config, EGL_NO_CONTEXT, contextAttributes);
+        }
+
+        if (Context == EGL_NO_CONTEXT || !eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, Context))
+        {
+            std::cout << "ERROR::HEADLESS::EGL_CONTEXT_FAILED" << std::endl;
+            return false;
+        }
+
+        std::cout << "HEADLESS::EGL " << major << "." << minor << " " << eglQueryString(Display, EGL_VENDOR) << std::endl;
+        return true;
+    }
+
+    void DestroyContext()
+    {
+        if (Display == EGL_NO_DISPLAY)
+            return;
+
+        eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (Context != EGL_NO_CONTEXT)
+            eglDestroyContext(Display, Context);
+        eglTerminate(Display);
+        Display = EGL_NO_DISPLAY;
+        Context = EGL_NO_CONTEXT;
+    }
+#else
+    void* GetProcAddress(const char* name)
+    {
+        return nullptr;
+    }
+
+    bool CreateContext()
+    {
+        std::cout << "HEADLESS::NO_EGL built without WORKBENCH_EGL, using an invisible window" << std::endl;
+        return false;
+    }
+
+    void DestroyContext() {}
+#endif
+
+    // Camera rotation between two frames, one full turn over the run
+    float OrbitStep(const Options& options)
+    {
+        return 2.0f * 3.14159265f / options.Frames;
+    }
+
+    // RGBA8, bottom row first
+    std::vector<unsigned char> ReadPixels(FrameBuffer& target)
+    {
+        std::vector<unsigned char> pixels((size_t)target.Width() * target.Height() * 4);
+
+        target.Bind(true, false);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, target.Width(), target.Height(), GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        target.Unbind();
+
+        return pixels;
+    }
+
+    uint64_t Hash(const std::vector<unsigned char>& pixels)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char byte : pixels)
+        {
+            hash ^= byte;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    bool WritePPM(std::string path, const std::vector<unsigned char>& pixels, int width, int height)
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return false;
+
+        file << "P6\n" << width << " " << height << "\n255\n";
+        for (int y = height - 1; y >= 0; y--)
+        {
+            for (int x = 0; x < width; x++)
+                file.write((const char*)&pixels[((size_t)y * width + x) * 4], 3);
+        }
+        return true;
+    }
+
+    // One line per frame in <out>/hashes.txt, plus frame_NNNN.ppm with --images
+    class Recorder
+    {
+        Options _options;
+        std::ofstream _hashes;
+
+    public:
+        Recorder(const Options& options) : _options(options)
+        {
+            if (!_options.Enabled || !_options.Hashes)
+                return;
+
+            std::error_code error;
+            std::filesystem::create_directories(_options.OutputDirectory, error);
+            _hashes.open(_options.OutputDirectory + "hashes.txt");
+            if (!_hashes.is_open())
+                std::cout << "ERROR::HEADLESS::OUTPUT_NOT_WRITABLE " << _options.OutputDirectory << std::endl;
+        }
+
+        void Capture(FrameBuffer& target, int frame)
+        {
+            std::vector<unsigned char> pixels = ReadPixels(target);
+            uint64_t hash = Hash(pixels);
+
+            _hashes << frame << " " << std::hex << std::setw(16) << std::setfill('0') << hash << std::dec << std::setfill(' ') << std::endl;
+
+            if (_options.WriteImages)
+            {
+                std::stringstream path;
+                path << _options.OutputDirectory << "frame_" << std::setw(4) << std::setfill('0') << frame << ".ppm";
+                if (!WritePPM(path.str(), pixels, target.Width(), target.Height()))
+                    std::cout << "ERROR::HEADLESS::IMAGE_NOT_WRITTEN " << path.str() << std::endl;
+            }
+        }
+    };
+}
+
+#endif
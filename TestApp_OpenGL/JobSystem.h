@@ -0,0 +1,369 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+/*
+* Work-stealing job scheduler for the CPU side of the engine. Every worker owns a deque: it pushes and pops its own
+* jobs at the back (most recent first, still in cache) and, when it runs dry, steals from the front of the others.
+* Threads outside the pool (the render thread) share queue 0 and help run jobs whenever they wait.
+*
+*   JobSystem::Handle a = Jobs().Schedule([] { ... });
+*   JobSystem::Handle b = Jobs().Schedule([] { ... }, { a });          // runs after a
+*   JobSystem::Handle c = Jobs().ScheduleOnMainThread([] { ... }, { b }); // GL calls: only the main thread runs it
+*   Jobs().ParallelFor(count, 1024, [&](int begin, int end) { ... });
+*   Jobs().Wait(c);
+*
+* Main thread jobs run from RunMainThreadJobs() (once per frame) or while the main thread waits. The main thread is
+* the one that created the JobSystem; a worker waiting on a main thread job only spins until the frame picks it up.
+*/
+class JobSystem
+{
+public:
+    struct Job
+    {
+        std::function<void()> Work;
+        bool MainThread = false;
+        std::atomic<int> Pending{ 1 };  // dependencies left, plus one held while scheduling
+        std::atomic<bool> Finished{ false };
+        std::mutex Mutex;
+        std::vector<std::shared_ptr<Job>> Continuations;
+    };
+    typedef std::shared_ptr<Job> Handle;
+
+private:
+    struct Queue
+    {
+        std::mutex Mutex;
+        std::deque<Handle> Jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> _queues;    // 0: threads outside the pool, i: worker i
+    Queue _mainThreadJobs;
+    std::vector<std::thread> _workers;
+    std::thread::id _mainThread;
+
+    std::atomic<int> _queued{ 0 };
+    std::atomic<int> _sleeping{ 0 };
+    std::atomic<bool> _stopping{ false };
+    std::mutex _sleepMutex;
+    std::condition_variable _wakeUp;
+
+    std::atomic<long long> _executed{ 0 };
+    std::atomic<long long> _stolen{ 0 };
+
+    static JobSystem*& ThreadOwner() { static thread_local JobSystem* owner = nullptr; return owner; }
+    static int& ThreadIndex() { static thread_local int index = 0; return index; }
+
+    int Slot() { return ThreadOwner() == this ? ThreadIndex() : 0; }
+
+    void Enqueue(const Handle& job)
+    {
+        Queue& queue = job->MainThread ? _mainThreadJobs : *_queues[Slot()];
+        {
+            std::lock_guard<std::mutex> lock(queue.Mutex);
+            queue.Jobs.push_back(job);
+        }
+
+        if (job->MainThread)
+            return;
+
+        _queued++;
+        if (_sleeping > 0)
+        {
+            { std::lock_guard<std::mutex> lock(_sleepMutex); }
+            _wakeUp.notify_one();
+        }
+    }
+
+    void Release(const Handle& job)
+    {
+        if (--job->Pending == 0)
+            Enqueue(job);
+    }
+
+    Handle Take(int slot)
+    {
+        Handle job;
+        {
+            Queue& own = *_queues[slot];
+            std::lock_guard<std::mutex> lock(own.Mutex);
+            if (!own.Jobs.empty())
+            {
+                job = own.Jobs.back();
+                own.Jobs.pop_back();
+            }
+        }
+
+        for (int i = 1; !job && i < _queues.size(); i++)
+        {
+            Queue& victim = *_queues[(slot + i) % _queues.size()];
+            std::lock_guard<std::mutex> lock(victim.Mutex);
+            if (!victim.Jobs.empty())
+            {
+                job = victim.Jobs.front();
+                victim.Jobs.pop_front();
+                _stolen++;
+            }
+        }
+
+        if (job)
+            _queued--;
+        return job;
+    }
+
+    Handle TakeMainThreadJob()
+    {
+        std::lock_guard<std::mutex> lock(_mainThreadJobs.Mutex);
+        if (_mainThreadJobs.Jobs.empty())
+            return nullptr;
+
+        Handle job = _mainThreadJobs.Jobs.front();
+        _mainThreadJobs.Jobs.pop_front();
+        return job;
+    }
+
+    void Execute(const Handle& job)
+    {
+        job->Work();
+        job->Work = nullptr;    // captures go now, not when the last handle does
+
+        std::vector<Handle> continuations;
+        {
+            std::lock_guard<std::mutex> lock(job->Mutex);
+            job->Finished = true;
+            continuations.swap(job->Continuations);
+        }
+        for (int i = 0; i < continuations.size(); i++)
+            Release(continuations[i]);
+
+        _executed++;
+    }
+
+    // One job on behalf of the calling thread, false when there was nothing to run
+    bool RunOne()
+    {
+        Handle job;
+        if (std::this_thread::get_id() == _mainThread)
+            job = TakeMainThreadJob();
+        if (!job)
+            job = Take(Slot());
+        if (!job)
+            return false;
+
+        Execute(job);
+        return true;
+    }
+
+    void Work(int index)
+    {
+        ThreadOwner() = this;
+        ThreadIndex() = index;
+
+        while (!_stopping)
+        {
+            if (RunOne())
+                continue;
+
+            std::unique_lock<std::mutex> lock(_sleepMutex);
+            _sleeping++;
+            _wakeUp.wait(lock, [this] { return _stopping || _queued > 0; });
+            _sleeping--;
+        }
+    }
+
+    Handle Add(std::function<void()> work, const std::vector<Handle>& dependencies, bool mainThread)
+    {
+        Handle job = std::make_shared<Job>();
+        job->Work = std::move(work);
+        job->MainThread = mainThread;
+        job->Pending = 1 + dependencies.size();
+
+        for (int i = 0; i < dependencies.size(); i++)
+        {
+            bool finished;
+            {
+                std::lock_guard<std::mutex> lock(dependencies[i]->Mutex);
+                finished = dependencies[i]->Finished;
+                if (!finished)
+                    dependencies[i]->Continuations.push_back(job);
+            }
+            if (finished)
+                job->Pending--;
+        }
+
+        Release(job);
+        return job;
+    }
+
+public:
+    // One thread is left to the caller, which runs jobs too whenever it waits
+    JobSystem(int workers = std::max(1, (int)std::thread::hardware_concurrency() - 1)) : _mainThread(std::this_thread::get_id())
+    {
+        for (int i = 0; i <= workers; i++)
+            _queues.push_back(std::unique_ptr<Queue>(new Queue()));
+        for (int i = 1; i <= workers; i++)
+            _workers.push_back(std::thread(&JobSystem::Work, this, i));
+    }
+
+    // Jobs still queued are dropped
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_sleepMutex);
+            _stopping = true;
+        }
+        _wakeUp.notify_all();
+        for (int i = 0; i < _workers.size(); i++)
+            _workers[i].join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    Handle Schedule(std::function<void()> work, const std::vector<Handle>& dependencies = {})
+    {
+        return Add(std::move(work), dependencies, false);
+    }
+
+    Handle ScheduleOnMainThread(std::function<void()> work, const std::vector<Handle>& dependencies = {})
+    {
+        return Add(std::move(work), dependencies, true);
+    }
+
+    // Schedule() with a result
+    template <typename T>
+    std::future<T> Async(std::function<T()> work)
+    {
+        std::shared_ptr<std::packaged_task<T()>> task = std::make_shared<std::packaged_task<T()>>(std::move(work));
+        std::future<T> result = task->get_future();
+        Schedule([task] { (*task)(); });
+        return result;
+    }
+
+    // Runs other jobs until this one is done
+    void Wait(const Handle& job)
+    {
+        while (!job->Finished)
+        {
+            if (!RunOne())
+                std::this_thread::yield();
+        }
+    }
+
+    // body(begin, end) over [0, count) in chunks of grain items, returns when every chunk is done
+    void ParallelFor(int count, int grain, const std::function<void(int, int)>& body)
+    {
+        if (count <= 0)
+            return;
+
+        grain = std::max(1, grain);
+        std::atomic<int> remaining((count + grain - 1) / grain);
+        for (int begin = grain; begin < count; begin += grain)
+        {
+            Schedule([&body, &remaining, begin, grain, count]
+            {
+                body(begin, std::min(begin + grain, count));
+                remaining--;
+            });
+        }
+
+        body(0, std::min(grain, count));
+        remaining--;
+
+        while (remaining > 0)
+        {
+            if (!RunOne())
+                std::this_thread::yield();
+        }
+    }
+
+    // From the main thread, once per frame: the main thread jobs queued so far
+    void RunMainThreadJobs()
+    {
+        int count;
+        {
+            std::lock_guard<std::mutex> lock(_mainThreadJobs.Mutex);
+            count = _mainThreadJobs.Jobs.size();
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            Handle job = TakeMainThreadJob();
+            if (job)
+                Execute(job);
+        }
+    }
+
+    int Workers() { return _workers.size(); }
+    long long Executed() { return _executed; }
+    long long Stolen() { return _stolen; }
+
+    // ParallelFor throughput from 1 thread to every core: each item moves a point through a chain of 4x4 transforms,
+    // the kind of work bounds and matrix updates do
+    static void Scalability(std::ostream& out, int items = 1 << 21, int repeats = 5)
+    {
+        std::vector<float> points(items * 4, 1.0f), results(items * 4);
+        float matrix[16];
+        for (int i = 0; i < 16; i++)
+            matrix[i] = (i % 5 == 0 ? 0.9f : 0.01f * i);
+
+        auto body = [&](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                float p[4] = { points[i * 4], points[i * 4 + 1], points[i * 4 + 2], points[i * 4 + 3] };
+                for (int step = 0; step < 8; step++)
+                {
+                    float r[4];
+                    for (int row = 0; row < 4; row++)
+                        r[row] = matrix[row] * p[0] + matrix[4 + row] * p[1] + matrix[8 + row] * p[2] + matrix[12 + row] * p[3];
+                    std::copy(r, r + 4, p);
+                }
+                std::copy(p, p + 4, &results[i * 4]);
+            }
+        };
+
+        int cores = std::max(1, (int)std::thread::hardware_concurrency());
+        double single = 0.0;
+        out << "JOBS::SCALABILITY " << items << " items x " << repeats << " runs" << std::endl;
+        for (int threads = 1; threads <= cores; threads++)
+        {
+            JobSystem jobs(threads - 1);
+            jobs.ParallelFor(items, 4096, body); // warm up
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int r = 0; r < repeats; r++)
+                jobs.ParallelFor(items, 4096, body);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / repeats;
+
+            if (threads == 1)
+                single = ms;
+            out << std::fixed << std::setprecision(2)
+                << "  threads " << std::setw(2) << threads << "  " << std::setw(8) << ms << " ms  "
+                << std::setw(8) << items / ms / 1000.0 << " Mitems/s  x" << single / ms
+                << "  (" << jobs.Stolen() << " stolen)" << std::endl;
+        }
+    }
+};
+
+// The engine's pool, created on first use; call it first from the render thread, which becomes its main thread
+JobSystem& Jobs()
+{
+    static JobSystem jobs;
+    return jobs;
+}
+
+#endif
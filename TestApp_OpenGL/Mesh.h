@@ -8,10 +8,13 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "SceneUtils.h"
+#include "GeometryHelper.h"
 #include "Assimp/Importer.hpp"
 #include"Assimp/scene.h"
 #include "Assimp/postprocess.h"
@@ -65,6 +68,8 @@ public:
     }
 public:
     std::vector<glm::vec3> GetPositions() override { return std::vector<glm::vec3>(_vertices); };
+    const glm::vec3* PositionData() override { return _vertices.data(); };
+    int PositionCount() override { return _vertices.size(); };
     std::vector<glm::vec3> GetNormals() override { return std::vector<glm::vec3>(_normals); };
     std::vector<int> GetIndices() override { return std::vector<int>(_indices); };
     int NumVertices() { return _vertices_count; }
@@ -497,6 +502,88 @@ public:
 };
 
 
+// Draws issued by the renderers, reset by whoever reads them (benchmark report, once per frame)
+namespace DrawStats
+{
+    static int DrawCalls = 0;
+    static long long Triangles = 0;
+
+    void Reset()
+    {
+        DrawCalls = 0;
+        Triangles = 0;
+    }
+}
+
+// Normal matrices (inverse transpose of the model 3x3), for the shaders' mat4 normalMatrix
+namespace NormalMatrices
+{
+    // Rotation and uniform scale: the model matrix itself points normals the right way, the shaders normalize them
+    bool UniformScale(const glm::mat3& m)
+    {
+        float x = glm::dot(m[0], m[0]), y = glm::dot(m[1], m[1]), z = glm::dot(m[2], m[2]);
+        float epsilon = 1e-4f * std::max(x, std::max(y, z));
+        return std::abs(x - y) <= epsilon && std::abs(x - z) <= epsilon &&
+            std::abs(glm::dot(m[0], m[1])) <= epsilon && std::abs(glm::dot(m[0], m[2])) <= epsilon && std::abs(glm::dot(m[1], m[2])) <= epsilon;
+    }
+
+    glm::mat3 Compute(const glm::mat4& model)
+    {
+        glm::mat3 m = glm::mat3(model);
+        return UniformScale(m) ? m : glm::transpose(glm::inverse(m));
+    }
+
+    // count matrices at once, 4 per step in SoA registers: cofactors over the determinant
+    void ComputeBatch(const glm::mat4* const* models, glm::mat3* const* normals, int count)
+    {
+        int i = 0;
+#ifdef WORKBENCH_SSE
+        for (; i + 4 <= count; i += 4)
+        {
+            // m[row * 3 + col], one lane per matrix
+            alignas(16) float soa[9][4];
+            for (int lane = 0; lane < 4; lane++)
+            {
+                const glm::mat4& model = *models[i + lane];
+                for (int row = 0; row < 3; row++)
+                    for (int col = 0; col < 3; col++)
+                        soa[row * 3 + col][lane] = model[col][row];
+            }
+
+            __m128 m[9];
+            for (int e = 0; e < 9; e++)
+                m[e] = _mm_load_ps(soa[e]);
+
+            __m128 c[9];
+            c[0] = _mm_sub_ps(_mm_mul_ps(m[4], m[8]), _mm_mul_ps(m[5], m[7]));
+            c[1] = _mm_sub_ps(_mm_mul_ps(m[5], m[6]), _mm_mul_ps(m[3], m[8]));
+            c[2] = _mm_sub_ps(_mm_mul_ps(m[3], m[7]), _mm_mul_ps(m[4], m[6]));
+            c[3] = _mm_sub_ps(_mm_mul_ps(m[2], m[7]), _mm_mul_ps(m[1], m[8]));
+            c[4] = _mm_sub_ps(_mm_mul_ps(m[0], m[8]), _mm_mul_ps(m[2], m[6]));
+            c[5] = _mm_sub_ps(_mm_mul_ps(m[1], m[6]), _mm_mul_ps(m[0], m[7]));
+            c[6] = _mm_sub_ps(_mm_mul_ps(m[1], m[5]), _mm_mul_ps(m[2], m[4]));
+            c[7] = _mm_sub_ps(_mm_mul_ps(m[2], m[3]), _mm_mul_ps(m[0], m[5]));
+            c[8] = _mm_sub_ps(_mm_mul_ps(m[0], m[4]), _mm_mul_ps(m[1], m[3]));
+
+            __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], c[0]), _mm_mul_ps(m[1], c[1])), _mm_mul_ps(m[2], c[2]));
+            __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+            for (int e = 0; e < 9; e++)
+                _mm_store_ps(soa[e], _mm_mul_ps(c[e], invDet));
+
+            for (int lane = 0; lane < 4; lane++)
+            {
+                glm::mat3& normal = *normals[i + lane];
+                for (int row = 0; row < 3; row++)
+                    for (int col = 0; col < 3; col++)
+                        normal[col][row] = soa[row * 3 + col][lane];
+            }
+        }
+#endif
+        for (; i < count; i++)
+            *normals[i] = glm::transpose(glm::inverse(glm::mat3(*models[i])));
+    }
+}
+
 class MeshRenderer
 {
 
@@ -511,6 +598,8 @@ private:
     unsigned int _ebo;
 
     glm::mat4 _modelMatrix;
+    glm::mat3 _normalMatrix;
+    bool _normalDirty = true;   // set by Transform, the normal matrix follows on first use
 
 public:
     MeshRenderer(glm::vec3 position, float rotation, glm::vec3 rotationAxis, glm::vec3 scale, RenderableBasic* mesh, ShaderBase* shader, ShaderBase* shaderNoShadows, Material mat)
@@ -588,25 +677,34 @@ public:
 
 
 public:
-    void Draw(glm::mat4 view, glm::mat4 proj, glm::vec3 eye, SceneParams sceneParams)
+    // 1x1 black cube map, bound in place of a missing environment
+    static unsigned int FallbackCubeMap()
     {
+        static unsigned int cubeMap = 0;
+        if (cubeMap == 0)
+        {
+            const unsigned char black[3] = { 0, 0, 0 };
+            glGenTextures(1, &cubeMap);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            for (int face = 0; face < 6; face++)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB8, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, black);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 0);
+        }
+        return cubeMap;
+    }
 
-        ShaderBase* shader = sceneParams.drawParams.doShadows ? _shader : _shader_noShadows;
-
-        shader->SetCurrent();
-
-        // ModelViewProjection + NormalMatrix =========================================================================================================//
-        glUniformMatrix4fv(shader->UniformLocation(shader->UniformName_ModelMatrix()), 1, GL_FALSE, glm::value_ptr(_modelMatrix));
-        glUniformMatrix4fv(shader->UniformLocation(shader->UniformName_NormalMatrix()), 1, GL_FALSE, glm::value_ptr(glm::transpose(glm::inverse(_modelMatrix))));
+    // Everything but the object: camera, lights and the shadow / AO / environment maps. Also used by CommandBuffer,
+    // which sets it once per program instead of once per draw
+    static void SetFrameUniforms(ShaderBase* shader, glm::mat4 view, glm::mat4 proj, glm::vec3 eye, SceneParams& sceneParams)
+    {
         glUniformMatrix4fv(shader->UniformLocation(shader->UniformName_ViewMatrix()), 1, GL_FALSE, glm::value_ptr(view));
         glUniformMatrix4fv(shader->UniformLocation(shader->UniformName_ProjectionMatrix()), 1, GL_FALSE, glm::value_ptr(proj));
         glUniform3fv(shader->UniformLocation(shader->UniformName_CameraPosition()), 1, glm::value_ptr(eye));
 
-        // Material Properties =========================================================================================================//
-        glUniform4fv(shader->UniformLocation(shader->UniformName_MaterialDiffuse()), 1, glm::value_ptr(_material.Diffuse));
-        glUniform4fv(shader->UniformLocation(shader->UniformName_MaterialSpecular()), 1, glm::value_ptr(_material.Specular));
-        glUniform1f(shader->UniformLocation(shader->UniformName_MaterialShininess()), _material.Shininess);
-
         // Scene sceneParams.sceneLights =========================================================================================================//
         glUniform4fv(shader->UniformLocation(shader->UniformName_LightsAmbient()), 1, glm::value_ptr(sceneParams.sceneLights.Ambient.Ambient));
         glUniform3fv(shader->UniformLocation(shader->UniformName_LightsDirectionsDirection()), 1, glm::value_ptr(normalize(sceneParams.sceneLights.Directional.Direction)));
@@ -618,6 +716,8 @@ public:
         glUniform1f(shader->UniformLocation(shader->UniformName_Bias()), sceneParams.sceneLights.Directional.Bias);
         glUniform1f(shader->UniformLocation(shader->UniformName_SlopeBias()), sceneParams.sceneLights.Directional.SlopeBias);
         glUniform1f(shader->UniformLocation(shader->UniformName_Softness()), sceneParams.sceneLights.Directional.Softness);
+        glUniform1f(shader->UniformLocation(shader->UniformName_ShadowNear()), sceneParams.sceneLights.Directional.ShadowNear);
+        glUniform1i(shader->UniformLocation(shader->UniformName_DepthZeroToOne()), sceneParams.drawParams.depthZeroToOne);
         
         if (sceneParams.sceneLights.Directional.ShadowMapId > 0)
         {
@@ -629,13 +729,50 @@ public:
         {
             glActiveTexture(GL_TEXTURE1); //SSAO
             glBindTexture(GL_TEXTURE_2D, sceneParams.sceneLights.Ambient.AoMapId);
-            glUniform1f(shader->UniformLocation(shader->UniformName_AoStrength()), sceneParams.sceneLights.Ambient.aoStrength);
         }
+        // no map when the AO passes were culled
+        glUniform1f(shader->UniformLocation(shader->UniformName_AoStrength()), sceneParams.sceneLights.Ambient.AoMapId > 0 ? sceneParams.sceneLights.Ambient.aoStrength : 0.0f);
+
+        // Environment =========================================================================================================//
+        EnvironmentLight& environment = sceneParams.sceneLights.Environment;
+        glUniform1i(shader->UniformLocation(shader->UniformName_EnvEnabled()), environment.Enabled && environment.PrefilteredMapId > 0);
+        // the samplerCube keeps unit 2 even without an environment: left on its default unit 0 it would share it with
+        // the shadow map sampler2D, and every draw would fail with GL_INVALID_OPERATION
+        glActiveTexture(GL_TEXTURE2); //Prefiltered environment
+        glBindTexture(GL_TEXTURE_CUBE_MAP, environment.PrefilteredMapId > 0 ? environment.PrefilteredMapId : FallbackCubeMap());
+        glUniform1i(shader->UniformLocation(shader->UniformName_EnvPrefilteredSamplerCube()), 2);
+        if (environment.PrefilteredMapId > 0)
+        {
+            glUniform3fv(shader->UniformLocation(shader->UniformName_EnvIrradianceSH()), 9, glm::value_ptr(environment.IrradianceSH[0]));
+            glUniform1f(shader->UniformLocation(shader->UniformName_EnvMaxLod()), environment.MaxLod);
+            glUniform1f(shader->UniformLocation(shader->UniformName_EnvIntensity()), environment.Intensity);
+        }
+    }
+
+    void Draw(glm::mat4 view, glm::mat4 proj, glm::vec3 eye, SceneParams sceneParams)
+    {
+
+        ShaderBase* shader = sceneParams.drawParams.doShadows ? _shader : _shader_noShadows;
+
+        shader->SetCurrent();
+
+        // ModelViewProjection + NormalMatrix =========================================================================================================//
+        glUniformMatrix4fv(shader->UniformLocation(shader->UniformName_ModelMatrix()), 1, GL_FALSE, glm::value_ptr(_modelMatrix));
+        glUniformMatrix4fv(shader->UniformLocation(shader->UniformName_NormalMatrix()), 1, GL_FALSE, glm::value_ptr(glm::mat4(NormalMatrix())));
+
+        // Material Properties =========================================================================================================//
+        glUniform4fv(shader->UniformLocation(shader->UniformName_MaterialDiffuse()), 1, glm::value_ptr(_material.Diffuse));
+        glUniform4fv(shader->UniformLocation(shader->UniformName_MaterialSpecular()), 1, glm::value_ptr(_material.Specular));
+        glUniform1f(shader->UniformLocation(shader->UniformName_MaterialShininess()), _material.Shininess);
+
+        SetFrameUniforms(shader, view, proj, eye, sceneParams);
 
         // Draw Call =========================================================================================================//
         glBindVertexArray(_vao);
         glDrawElements(GL_TRIANGLES, _numIndices, GL_UNSIGNED_INT, nullptr); 
         glBindVertexArray(0);
+        DrawStats::DrawCalls++;
+        DrawStats::Triangles += _numIndices / 3;
 
         CheckOGLErrors();
 
@@ -650,7 +787,7 @@ public:
 
         // ModelViewProjection + NormalMatrix =========================================================================================================//
         glUniformMatrix4fv(shader->UniformLocation(shader->UniformName_ModelMatrix()), 1, GL_FALSE, glm::value_ptr(_modelMatrix));
-        glUniformMatrix4fv(shader->UniformLocation(shader->UniformName_NormalMatrix()), 1, GL_FALSE, glm::value_ptr(glm::transpose(glm::inverse(_modelMatrix))));
+        glUniformMatrix4fv(shader->UniformLocation(shader->UniformName_NormalMatrix()), 1, GL_FALSE, glm::value_ptr(glm::mat4(NormalMatrix())));
         glUniformMatrix4fv(shader->UniformLocation(shader->UniformName_ViewMatrix()), 1, GL_FALSE, glm::value_ptr(view));
         glUniformMatrix4fv(shader->UniformLocation(shader->UniformName_ProjectionMatrix()), 1, GL_FALSE, glm::value_ptr(proj));
 
@@ -660,6 +797,8 @@ public:
         glBindVertexArray(_vao);
         glDrawElements(GL_TRIANGLES, _numIndices, GL_UNSIGNED_INT, nullptr);
         glBindVertexArray(0);
+        DrawStats::DrawCalls++;
+        DrawStats::Triangles += _numIndices / 3;
 
         CheckOGLErrors();
 
@@ -679,6 +818,55 @@ public:
         else
             _modelMatrix = model* _modelMatrix;
 
+        _normalDirty = true;
+    }
+
+    // World matrix computed elsewhere (TransformHierarchy)
+    void SetModelMatrix(const glm::mat4& model)
+    {
+        _modelMatrix = model;
+        _normalDirty = true;
+    }
+
+    const glm::mat3& NormalMatrix()
+    {
+        if (_normalDirty)
+        {
+            _normalMatrix = NormalMatrices::Compute(_modelMatrix);
+            _normalDirty = false;
+        }
+        return _normalMatrix;
+    }
+
+    // Refreshes the stale normal matrices among count renderers in one batch, the ones up to date are skipped
+    static void UpdateNormalMatrices(MeshRenderer* renderers, int count)
+    {
+        std::vector<const glm::mat4*> models;
+        std::vector<glm::mat3*> normals;
+        for (int i = 0; i < count; i++)
+        {
+            if (!renderers[i]._normalDirty)
+                continue;
+
+            models.push_back(&renderers[i]._modelMatrix);
+            normals.push_back(&renderers[i]._normalMatrix);
+            renderers[i]._normalDirty = false;
+        }
+
+        NormalMatrices::ComputeBatch(models.data(), normals.data(), models.size());
+    }
+
+    // CPU state only, safe to read from any thread (CommandBuffer records from these)
+    ShaderBase* GetShader(bool shadows) { return shadows ? _shader : _shader_noShadows; }
+    const Material& GetMaterial() { return _material; }
+    const glm::mat4& ModelMatrix() { return _modelMatrix; }
+    unsigned int Vao() { return _vao; }
+    int NumIndices() { return _numIndices; }
+
+    // World space bounds from the mesh vertices, no transformed copy
+    void GetBounds(glm::vec3& min, glm::vec3& max)
+    {
+        Utils::GetTransformedMinMax(_mesh->PositionData(), _mesh->PositionCount(), _modelMatrix, min, max);
     }
 
     std::vector<glm::vec3> GetTransformedPoints()
@@ -720,6 +908,7 @@ private:
     unsigned int _numPoints;
 
     glm::mat4 _modelMatrix;
+    glm::mat4 _normalMatrix;
 
 public:
     LinesRenderer(glm::vec3 position, float rotation, glm::vec3 rotationAxis, glm::vec3 scale, Wire wire, ShaderBase* shader, glm::vec4 color)
@@ -737,6 +926,7 @@ public:
         model = glm::scale(model, scale);
 
         _modelMatrix = model;
+        _normalMatrix = glm::mat4(NormalMatrices::Compute(model));
 
         // Generate Graphics Data ============================================================================================================= //
         glGenVertexArrays(1, &_vao);
@@ -785,7 +975,7 @@ public:
 
         // ModelViewProjection + NormalMatrix =========================================================================================================//
         glUniformMatrix4fv(_shader->UniformLocation(_shader->UniformName_ModelMatrix()), 1, GL_FALSE, glm::value_ptr(_modelMatrix));
-        glUniformMatrix4fv(_shader->UniformLocation(_shader->UniformName_NormalMatrix()), 1, GL_FALSE, glm::value_ptr(glm::transpose(glm::inverse(_modelMatrix))));
+        glUniformMatrix4fv(_shader->UniformLocation(_shader->UniformName_NormalMatrix()), 1, GL_FALSE, glm::value_ptr(_normalMatrix));
         glUniformMatrix4fv(_shader->UniformLocation(_shader->UniformName_ViewMatrix()), 1, GL_FALSE, glm::value_ptr(view));
         glUniformMatrix4fv(_shader->UniformLocation(_shader->UniformName_ProjectionMatrix()), 1, GL_FALSE, glm::value_ptr(proj));
         glUniform3fv(_shader->UniformLocation(_shader->UniformName_CameraPosition()), 1, glm::value_ptr(eye));
@@ -796,6 +986,7 @@ public:
         // Draw Call =========================================================================================================//
         glBindVertexArray(_vao);
         glDrawArrays(GL_LINES, 0, _numPoints);
+        DrawStats::DrawCalls++;
         glBindVertexArray(0);
 
         CheckOGLErrors();
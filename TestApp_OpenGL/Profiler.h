@@ -0,0 +1,347 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <map>
+#include <string>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+/*
+* CPU + GPU scope timings. Every scope takes a steady_clock time and a GL_TIMESTAMP query (glQueryCounter) at both
+* ends, timestamps nest freely unlike GL_TIME_ELAPSED. Queries of a frame are read back Latency frames later, when
+* its slot comes round again; a frame whose last query is still not available is dropped instead of waiting.
+*
+*   profiler.BeginFrame();
+*   { Profiler::Scope scope(profiler, "Shadow"); ... }
+*   profiler.EndFrame();
+*
+* The last HistorySize samples of every scope give avg/p95/max, CaptureTrace() writes the next frames as a
+* Chrome trace (chrome://tracing, Perfetto) with a CPU and a GPU track.
+*/
+class Profiler
+{
+public:
+    static const int Latency = 4;
+    static const int HistorySize = 256;
+
+    struct Stats
+    {
+        float Average = 0.0f;
+        float P95 = 0.0f;
+        float Max = 0.0f;
+    };
+
+    // Samples in ring order, Offset is the oldest (ImGui::PlotLines values_offset)
+    struct History
+    {
+        std::vector<float> Cpu = std::vector<float>(HistorySize, 0.0f);
+        std::vector<float> Gpu = std::vector<float>(HistorySize, 0.0f);
+        int Offset = 0;
+        int Count = 0;
+    };
+
+    class Scope
+    {
+        Profiler& _profiler;
+
+    public:
+        Scope(Profiler& profiler, const std::string& name) : _profiler(profiler) { _profiler.BeginScope(name); }
+        ~Scope() { _profiler.EndScope(); }
+    };
+
+private:
+    struct ScopeRecord
+    {
+        std::string Name;
+        int Depth;
+        double CpuBegin, CpuEnd;
+        int QueryBegin, QueryEnd;
+    };
+
+    struct FrameRecord
+    {
+        bool Pending = false;
+        std::vector<ScopeRecord> Scopes;
+        std::vector<unsigned int> Queries;  // grows to the most scopes seen, reused every Latency frames
+        int UsedQueries = 0;
+    };
+
+    struct TraceEvent
+    {
+        std::string Name;
+        bool Gpu;
+        double Begin, Duration;     // ms on the CPU clock
+    };
+
+    FrameRecord _frames[Latency];
+    unsigned int _frame = 0;
+    std::vector<int> _open;
+    bool _inFrame = false;
+
+    std::map<std::string, History> _history;
+    History _frameHistory;
+    int _droppedFrames = 0;
+
+    std::chrono::steady_clock::time_point _epoch = std::chrono::steady_clock::now();
+    bool _calibrated = false;
+    double _gpuToCpu = 0.0;         // ms to add to a GPU timestamp (ms) to land on the CPU clock
+
+    std::vector<TraceEvent> _trace;
+    std::string _tracePath;
+    int _traceFrames = 0;
+
+    double Now()
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _epoch).count();
+    }
+
+    int Timestamp()
+    {
+        FrameRecord& record = _frames[_frame % Latency];
+        if (record.UsedQueries == record.Queries.size())
+        {
+            unsigned int query;
+            glGenQueries(1, &query);
+            record.Queries.push_back(query);
+        }
+
+        glQueryCounter(record.Queries[record.UsedQueries], GL_TIMESTAMP);
+        return record.UsedQueries++;
+    }
+
+    static void Push(History& history, float cpu, float gpu)
+    {
+        int index = (history.Offset + history.Count) % HistorySize;
+        if (history.Count == HistorySize)
+            history.Offset = (history.Offset + 1) % HistorySize;
+        else
+            history.Count++;
+
+        history.Cpu[index] = cpu;
+        history.Gpu[index] = gpu;
+    }
+
+    // Results of the frame that used this slot Latency frames ago
+    void Collect(FrameRecord& record)
+    {
+        if (!record.Pending)
+            return;
+        record.Pending = false;
+
+        GLint available = 0;
+        if (record.UsedQueries > 0)
+            glGetQueryObjectiv(record.Queries[record.UsedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (!available)
+        {
+            _droppedFrames++;
+            return;
+        }
+
+        std::vector<double> gpu(record.UsedQueries);
+        for (int i = 0; i < record.UsedQueries; i++)
+        {
+            GLuint64 timestamp = 0;
+            glGetQueryObjectui64v(record.Queries[i], GL_QUERY_RESULT, &timestamp);
+            gpu[i] = timestamp / 1000000.0;
+        }
+
+        // scope 0 is the whole frame
+        std::map<std::string, std::pair<double, double>> totals;
+        for (const ScopeRecord& scope : record.Scopes)
+        {
+            double cpu = scope.CpuEnd - scope.CpuBegin;
+            double gpuTime = gpu[scope.QueryEnd] - gpu[scope.QueryBegin];
+
+            if (scope.Depth < 0)
+                Push(_frameHistory, cpu, gpuTime);
+            else
+            {
+                totals[scope.Name].first += cpu;
+                totals[scope.Name].second += gpuTime;
+            }
+
+            if (_traceFrames > 0)
+            {
+                _trace.push_back({ scope.Name, false, scope.CpuBegin, cpu });
+                _trace.push_back({ scope.Name, true, gpu[scope.QueryBegin] + _gpuToCpu, gpuTime });
+            }
+        }
+
+        for (auto& total : totals)
+            Push(_history[total.first], total.second.first, total.second.second);
+
+        if (_traceFrames > 0 && --_traceFrames == 0)
+            WriteTrace();
+    }
+
+    void WriteTrace()
+    {
+        std::ofstream file(_tracePath);
+        if (!file.is_open())
+        {
+            std::cout << "ERROR::PROFILER::TRACE_NOT_WRITTEN " << _tracePath << std::endl;
+            return;
+        }
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+        for (const TraceEvent& event : _trace)
+        {
+            // chrome trace times are microseconds
+            file << ",\n{\"name\":\"" << event.Name << "\",\"cat\":\"" << (event.Gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << (event.Gpu ? 1 : 0)
+                << ",\"ts\":" << (long long)(event.Begin * 1000.0) << ",\"dur\":" << (long long)(event.Duration * 1000.0) << "}";
+        }
+        file << "\n]}\n";
+
+        std::cout << "PROFILER::TRACE_WRITTEN " << _tracePath << " (" << _trace.size() << " events)" << std::endl;
+        _trace.clear();
+    }
+
+public:
+    Profiler() {}
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    void BeginFrame()
+    {
+        if (!_calibrated)
+        {
+            GLint64 gpuNow = 0;
+            glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+            _gpuToCpu = Now() - gpuNow / 1000000.0;
+            _calibrated = true;
+        }
+
+        FrameRecord& record = _frames[_frame % Latency];
+        Collect(record);
+
+        record.Scopes.clear();
+        record.UsedQueries = 0;
+        _open.clear();
+        _inFrame = true;
+
+        BeginScope("Frame"); // depth -1, the frame totals
+    }
+
+    void EndFrame()
+    {
+        if (!_inFrame)
+            return;
+
+        if (_open.size() != 1)
+            std::cout << "ERROR::PROFILER::UNBALANCED_SCOPES " << _open.size() - 1 << " still open at the end of the frame" << std::endl;
+
+        while (!_open.empty())
+            EndScope();
+
+        _frames[_frame % Latency].Pending = true;
+        _inFrame = false;
+        _frame++;
+    }
+
+    void BeginScope(const std::string& name)
+    {
+        if (!_inFrame)
+            return;
+
+        FrameRecord& record = _frames[_frame % Latency];
+        record.Scopes.push_back({ name, (int)_open.size() - 1, Now(), 0.0, Timestamp(), 0 });
+        _open.push_back(record.Scopes.size() - 1);
+    }
+
+    void EndScope()
+    {
+        if (!_inFrame || _open.empty())
+            return;
+
+        ScopeRecord& scope = _frames[_frame % Latency].Scopes[_open.back()];
+        scope.QueryEnd = Timestamp();
+        scope.CpuEnd = Now();
+        _open.pop_back();
+    }
+
+    // Records the next frames (as soon as their queries come back) and writes them to path
+    void CaptureTrace(const std::string& path, int frames)
+    {
+        _tracePath = path;
+        _traceFrames = frames;
+        _trace.clear();
+    }
+
+    bool Capturing() { return _traceFrames > 0; }
+
+    // Forgets every sample so far, frames still waiting for their queries included (e.g. at the end of a warmup)
+    void ClearHistory()
+    {
+        _history.clear();
+        _frameHistory = History();
+        _droppedFrames = 0;
+        for (FrameRecord& record : _frames)
+            record.Pending = false;
+    }
+
+    // Waits for the GPU and reads back the frames still in flight, oldest first
+    void Flush()
+    {
+        glFinish();
+        for (int i = 0; i < Latency; i++)
+            Collect(_frames[(_frame + i) % Latency]);
+    }
+
+    static Stats Compute(const std::vector<float>& values, int count)
+    {
+        Stats stats;
+        if (count == 0)
+            return stats;
+
+        std::vector<float> sorted(values.begin(), values.begin() + count);
+        std::sort(sorted.begin(), sorted.end());
+
+        double sum = 0.0;
+        for (float value : sorted)
+            sum += value;
+
+        stats.Average = sum / count;
+        stats.P95 = sorted[(int)(0.95f * (count - 1))];
+        stats.Max = sorted.back();
+        return stats;
+    }
+
+    Stats CpuStats(const std::string& name)
+    {
+        auto history = _history.find(name);
+        return history == _history.end() ? Stats() : Compute(history->second.Cpu, history->second.Count);
+    }
+
+    Stats GpuStats(const std::string& name)
+    {
+        auto history = _history.find(name);
+        return history == _history.end() ? Stats() : Compute(history->second.Gpu, history->second.Count);
+    }
+
+    const History& FrameHistory() { return _frameHistory; }
+    const std::map<std::string, History>& Scopes() { return _history; }
+    int DroppedFrames() { return _droppedFrames; }
+
+    void FreeUnmanagedResources()
+    {
+        for (FrameRecord& record : _frames)
+        {
+            if (!record.Queries.empty())
+                glDeleteQueries(record.Queries.size(), record.Queries.data());
+            record.Queries.clear();
+            record.UsedQueries = 0;
+            record.Pending = false;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef PROGRAMBINARYCACHE_H
+#define PROGRAMBINARYCACHE_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <filesystem>
+
+/*
+* Linked program binaries are stored in Directory, one file per program, named after a hash of
+* the program sources and of the driver strings (vendor, renderer, version): a driver update changes
+* the hash, so stale binaries are never handed to a different driver.
+* The driver is still free to reject a binary (glProgramBinary fails to link): callers then compile
+* from source as usual and Store() overwrites the rejected entry.
+*/
+namespace ProgramBinaryCache
+{
+    static std::string Directory = "./ShaderCache/";
+    static bool Enabled = true;
+
+    bool Supported()
+    {
+        if (!Enabled || !GLAD_GL_VERSION_4_1)
+            return false;
+
+        int formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    // FNV-1a, good enough to tell sources apart, the files are not trusted beyond that
+    unsigned long long Hash(const std::string& data, unsigned long long hash = 14695981039346656037ULL)
+    {
+        for (int i = 0; i < data.size(); i++)
+        {
+            hash ^= (unsigned char)data[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    std::string DriverString()
+    {
+        static std::string driver;
+        if (driver.empty())
+        {
+            const char* vendor = (const char*)glGetString(GL_VENDOR);
+            const char* renderer = (const char*)glGetString(GL_RENDERER);
+            const char* version = (const char*)glGetString(GL_VERSION);
+            driver = std::string(vendor ? vendor : "") + "|" + (renderer ? renderer : "") + "|" + (version ? version : "");
+        }
+        return driver;
+    }
+
+    std::string Key(std::vector<std::string> sources)
+    {
+        unsigned long long hash = Hash(DriverString());
+        for (int i = 0; i < sources.size(); i++)
+        {
+            hash = Hash(sources[i], hash);
+            hash = Hash(std::string(1, '\0'), hash); // keeps ("ab", "c") and ("a", "bc") apart
+        }
+
+        std::stringstream key;
+        key << std::hex << std::setw(16) << std::setfill('0') << hash;
+        return key.str();
+    }
+
+    std::string PathFromKey(std::string key) { return Directory + key + ".bin"; }
+
+    // Call before glLinkProgram on programs that will be stored
+    void PrepareProgram(unsigned int program)
+    {
+        if (Supported())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // Loads the binary into an existing program object, false on a miss or if the driver rejects it
+    bool Load(unsigned int program, std::string key)
+    {
+        if (!Supported())
+            return false;
+
+        std::ifstream file(PathFromKey(key), std::ios::binary);
+        if (!file)
+            return false;
+
+        unsigned int format = 0;
+        file.read((char*)&format, sizeof(format));
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (binary.empty())
+            return false;
+
+        glProgramBinary(program, format, binary.data(), binary.size());
+
+        int success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+            std::cout << "SHADER::BINARY_CACHE::REJECTED " << key << std::endl;
+
+        return success;
+    }
+
+    void Store(unsigned int program, std::string key)
+    {
+        if (!Supported())
+            return;
+
+        int success = 0, length = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (!success || length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        unsigned int format = 0;
+        glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+        std::error_code error;
+        std::filesystem::create_directories(Directory, error);
+
+        std::ofstream file(PathFromKey(key), std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            std::cout << "SHADER::BINARY_CACHE::WRITE_FAILED " << PathFromKey(key) << std::endl;
+            return;
+        }
+        file.write((char*)&format, sizeof(format));
+        file.write(binary.data(), binary.size());
+    }
+}
+
+#endif
@@ -0,0 +1,498 @@
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#include "FrameBuffer.h"
+#include "RenderTargetPool.h"
+#include "Profiler.h"
+
+/*
+* Frame passes declared with the resources they read and write, rebuilt every frame:
+*
+*   RenderGraph::Resource ao = graph.Create("AO", width, height, GL_R16F);
+*   graph.AddPass("SSAO").Sample(viewPositions).Sample(viewNormals).Write(ao).Execute([&](RenderGraph::Context& ctx) { ... });
+*   graph.Output(scene);
+*   graph.Execute();
+*
+* Execute() orders the passes (a reader runs after every writer of what it reads, writers of the same resource keep
+* their declaration order), culls the passes that do not contribute to an Output() or SideEffect() pass, takes the
+* transient textures from the RenderTargetPool for the span between their first and last live use, binds the pass
+* target only when it changes, binds sampled textures and images to units in declaration order and puts a
+* glMemoryBarrier only in front of the first pass touching an image write.
+*
+* Each pass runs in a Profiler scope of the same name.
+*/
+class RenderGraph
+{
+public:
+    typedef int Resource;
+
+    static const int DepthAttachment = -1;
+
+    // What a pass body can ask while it runs
+    class Context
+    {
+        friend class RenderGraph;
+        RenderGraph& _graph;
+        int _pass;
+
+        Context(RenderGraph& graph, int pass) : _graph(graph), _pass(pass) {}
+
+    public:
+        unsigned int Texture(Resource resource) { return _graph.TextureOf(resource); }
+        int Unit(Resource resource) { return _graph._passes[_pass].UnitOf(resource, false); }
+        int ImageUnit(Resource resource) { return _graph._passes[_pass].UnitOf(resource, true); }
+    };
+
+    class Pass
+    {
+        friend class RenderGraph;
+
+        std::string _name;
+        std::vector<Resource> _samples;     // bound to texture units 0, 1, ...
+        std::vector<Resource> _reads;       // dependency only, the pass binds them itself
+        std::vector<Resource> _writes;      // attachments of the pass target
+        std::vector<Resource> _images;      // bound to image units 0, 1, ...
+        bool _sideEffect = false;
+        std::function<void(Context&)> _execute;
+
+        bool _live = false;
+
+        int UnitOf(Resource resource, bool image)
+        {
+            const std::vector<Resource>& list = image ? _images : _samples;
+            for (int i = 0; i < list.size(); i++)
+                if (list[i] == resource)
+                    return i;
+
+            std::cout << "ERROR::RENDER_GRAPH::" << _name << " resource " << resource << " is not bound by this pass" << std::endl;
+            return -1;
+        }
+
+    public:
+        Pass(std::string name) : _name(name) {}
+
+        const std::string& Name() { return _name; }
+
+        // Read through a texture unit, the unit index is the declaration order (Context::Unit)
+        Pass& Sample(Resource resource) { _samples.push_back(resource); return *this; }
+
+        // Read without binding, for textures the pass hands out itself (e.g. through SceneParams)
+        Pass& Read(Resource resource) { _reads.push_back(resource); return *this; }
+
+        // Render to: transient resources make up a pooled framebuffer (depth formats on the depth attachment),
+        // an imported FrameBuffer is bound as a whole
+        Pass& Write(Resource resource) { _writes.push_back(resource); return *this; }
+
+        // Written with image stores (compute), the image unit is the declaration order (Context::ImageUnit)
+        Pass& WriteImage(Resource resource) { _images.push_back(resource); return *this; }
+
+        // Kept even when nothing reads its outputs (present, readbacks)
+        Pass& SideEffect() { _sideEffect = true; return *this; }
+
+        Pass& Execute(std::function<void(Context&)> execute) { _execute = execute; return *this; }
+    };
+
+private:
+    struct ResourceInfo
+    {
+        std::string Name;
+        unsigned int Width = 0, Height = 0;
+        GLenum Format = GL_NONE;
+        bool Transient = false;
+        bool Output = false;
+
+        unsigned int Texture = 0;       // acquired (transient) or imported
+        FrameBuffer* Target = nullptr;  // imported framebuffer attachment
+        int Attachment = 0;
+
+        bool PendingImageWrite = false;
+    };
+
+    RenderTargetPool& _pool;
+    Profiler& _profiler;
+    std::vector<ResourceInfo> _resources;
+    std::deque<Pass> _passes;       // deque: the Pass& handed out by AddPass stays valid
+    std::vector<int> _order;
+
+    std::vector<std::pair<std::string, bool>> _lastPasses;     // execution order of the last frame, live or culled
+    int _binds = 0, _barriers = 0;
+    int _lastBinds = 0, _lastBarriers = 0;
+
+    std::vector<unsigned int> _boundTarget;
+
+    unsigned int TextureOf(Resource resource)
+    {
+        ResourceInfo& info = _resources[resource];
+        if (info.Target)
+            return info.Attachment == DepthAttachment ? info.Target->DepthTextureId() : info.Target->ColorTextureId(info.Attachment);
+
+        return info.Texture;
+    }
+
+    static bool Contains(const std::vector<Resource>& list, Resource resource)
+    {
+        return std::find(list.begin(), list.end(), resource) != list.end();
+    }
+
+    static bool Writes(Pass& pass, Resource resource)
+    {
+        return Contains(pass._writes, resource) || Contains(pass._images, resource);
+    }
+
+    static std::vector<Resource> Inputs(Pass& pass)
+    {
+        std::vector<Resource> inputs = pass._samples;
+        inputs.insert(inputs.end(), pass._reads.begin(), pass._reads.end());
+        return inputs;
+    }
+
+    static std::vector<Resource> Outputs(Pass& pass)
+    {
+        std::vector<Resource> outputs = pass._writes;
+        outputs.insert(outputs.end(), pass._images.begin(), pass._images.end());
+        return outputs;
+    }
+
+    // Kahn over the read-after-write and write-after-write edges, lowest declaration index first
+    void Sort()
+    {
+        int count = _passes.size();
+        std::vector<std::vector<int>> next(count);
+        std::vector<int> incoming(count, 0);
+
+        auto edge = [&](int from, int to) { next[from].push_back(to); incoming[to]++; };
+
+        for (int b = 0; b < count; b++)
+        {
+            for (int a = 0; a < count; a++)
+            {
+                if (a == b)
+                    continue;
+
+                bool depends = false;
+                for (Resource resource : Inputs(_passes[b]))
+                    depends |= Writes(_passes[a], resource) && !Writes(_passes[b], resource);
+                for (Resource resource : Outputs(_passes[b]))
+                    depends |= a < b && Writes(_passes[a], resource);
+
+                if (depends)
+                    edge(a, b);
+            }
+        }
+
+        _order.clear();
+        std::vector<bool> done(count, false);
+        while (_order.size() < count)
+        {
+            int pick = -1;
+            for (int i = 0; i < count && pick < 0; i++)
+                if (!done[i] && incoming[i] == 0)
+                    pick = i;
+
+            if (pick < 0)
+            {
+                std::cout << "ERROR::RENDER_GRAPH:: dependency cycle, running the remaining passes in declaration order" << std::endl;
+                for (int i = 0; i < count; i++)
+                    if (!done[i])
+                        _order.push_back(i);
+                break;
+            }
+
+            done[pick] = true;
+            _order.push_back(pick);
+            for (int to : next[pick])
+                incoming[to]--;
+        }
+    }
+
+    // Backwards from the outputs: a pass lives when it has side effects or writes something a live pass needs
+    void Cull()
+    {
+        std::vector<bool> needed(_resources.size(), false);
+        for (int i = 0; i < _resources.size(); i++)
+            needed[i] = _resources[i].Output;
+
+        for (int i = (int)_order.size() - 1; i >= 0; i--)
+        {
+            Pass& pass = _passes[_order[i]];
+            pass._live = pass._sideEffect;
+            for (Resource resource : Outputs(pass))
+                pass._live |= needed[resource];
+
+            if (!pass._live)
+                continue;
+
+            for (Resource resource : Inputs(pass))
+                needed[resource] = true;
+
+            // drawing on top of an imported target keeps whoever drew it before
+            for (Resource resource : pass._writes)
+                needed[resource] = needed[resource] || !_resources[resource].Transient;
+        }
+    }
+
+    void BindTarget(Pass& pass)
+    {
+        if (pass._writes.empty())
+            return;
+
+        FrameBuffer* target = _resources[pass._writes[0]].Target;
+        std::vector<unsigned int> key;
+        std::vector<unsigned int> colors;
+        unsigned int depth = 0;
+        unsigned int width = 0, height = 0;
+
+        if (target)
+        {
+            key = { 1u, target->Id() };
+            width = target->Width();
+            height = target->Height();
+        }
+        else
+        {
+            for (Resource resource : pass._writes)
+            {
+                ResourceInfo& info = _resources[resource];
+                if (FrameBuffer::IsDepthFormat(info.Format))
+                    depth = info.Texture;
+                else
+                    colors.push_back(info.Texture);
+
+                width = info.Width;
+                height = info.Height;
+            }
+
+            key = colors;
+            key.insert(key.begin(), 0u);
+            key.push_back(depth);
+        }
+
+        if (key == _boundTarget)
+            return;
+
+        if (target)
+            target->Bind(true, true);
+        else
+            _pool.Bind(colors, depth);
+
+        glViewport(0, 0, width, height);
+        _boundTarget = key;
+        _binds++;
+    }
+
+    void Barrier(Pass& pass)
+    {
+        bool pending = false;
+        for (Resource resource : Inputs(pass))
+            pending |= _resources[resource].PendingImageWrite;
+        for (Resource resource : Outputs(pass))
+            pending |= _resources[resource].PendingImageWrite;
+
+        if (!pending)
+            return;
+
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+        for (ResourceInfo& info : _resources)
+            info.PendingImageWrite = false;
+        _barriers++;
+    }
+
+    void Run(int index)
+    {
+        Pass& pass = _passes[index];
+        Profiler::Scope scope(_profiler, pass._name);
+
+        BindTarget(pass);
+        Barrier(pass);
+
+        for (int i = 0; i < pass._samples.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, TextureOf(pass._samples[i]));
+        }
+        glActiveTexture(GL_TEXTURE0);
+
+        for (int i = 0; i < pass._images.size(); i++)
+        {
+            ResourceInfo& info = _resources[pass._images[i]];
+            glBindImageTexture(i, TextureOf(pass._images[i]), 0, GL_FALSE, 0, GL_WRITE_ONLY, info.Format);
+        }
+
+        if (pass._execute)
+        {
+            Context context(*this, index);
+            pass._execute(context);
+        }
+
+        for (int i = 0; i < pass._images.size(); i++)
+        {
+            glBindImageTexture(i, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, _resources[pass._images[i]].Format);
+            _resources[pass._images[i]].PendingImageWrite = true;
+        }
+
+        for (int i = (int)pass._samples.size() - 1; i >= 0; i--)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+    }
+
+public:
+    RenderGraph(RenderTargetPool& pool, Profiler& profiler) : _pool(pool), _profiler(profiler) {}
+
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+
+    // Transient texture, allocated from the pool only for the passes that use it
+    Resource Create(std::string name, unsigned int width, unsigned int height, GLenum format)
+    {
+        ResourceInfo info;
+        info.Name = name;
+        info.Width = width;
+        info.Height = height;
+        info.Format = format;
+        info.Transient = true;
+        _resources.push_back(info);
+        return _resources.size() - 1;
+    }
+
+    // Texture owned outside of the graph
+    Resource Import(std::string name, unsigned int texture)
+    {
+        ResourceInfo info;
+        info.Name = name;
+        info.Texture = texture;
+        _resources.push_back(info);
+        return _resources.size() - 1;
+    }
+
+    // Attachment of a FrameBuffer owned outside of the graph (DepthAttachment for depth), resolved when a pass runs
+    Resource Import(std::string name, FrameBuffer& target, int attachment = 0)
+    {
+        ResourceInfo info;
+        info.Name = name;
+        info.Target = &target;
+        info.Attachment = attachment;
+        info.Width = target.Width();
+        info.Height = target.Height();
+        _resources.push_back(info);
+        return _resources.size() - 1;
+    }
+
+    Pass& AddPass(std::string name)
+    {
+        _passes.push_back(Pass(name));
+        return _passes.back();
+    }
+
+    // The frame result, passes that do not lead to an output are culled
+    void Output(Resource resource)
+    {
+        _resources[resource].Output = true;
+    }
+
+    void Execute()
+    {
+        Sort();
+        Cull();
+
+        // lifetimes over the live passes
+        std::vector<int> first(_resources.size(), -1), last(_resources.size(), -1);
+        for (int i = 0; i < _order.size(); i++)
+        {
+            Pass& pass = _passes[_order[i]];
+            if (!pass._live)
+                continue;
+
+            std::vector<Resource> used = Inputs(pass);
+            std::vector<Resource> outputs = Outputs(pass);
+            used.insert(used.end(), outputs.begin(), outputs.end());
+            for (Resource resource : used)
+            {
+                if (first[resource] < 0)
+                    first[resource] = i;
+                last[resource] = i;
+            }
+        }
+
+        _lastPasses.clear();
+        _pool.BeginFrame();
+        _binds = 0;
+        _barriers = 0;
+        _boundTarget.clear();
+
+        for (int i = 0; i < _order.size(); i++)
+        {
+            Pass& pass = _passes[_order[i]];
+            _lastPasses.push_back({ pass._name, pass._live });
+            if (!pass._live)
+                continue;
+
+            for (int r = 0; r < _resources.size(); r++)
+            {
+                if (_resources[r].Transient && first[r] == i)
+                    _resources[r].Texture = _pool.Acquire(_resources[r].Width, _resources[r].Height, _resources[r].Format);
+            }
+
+            Run(_order[i]);
+
+            for (int r = 0; r < _resources.size(); r++)
+            {
+                if (_resources[r].Transient && last[r] == i)
+                    _pool.Release(_resources[r].Texture);
+            }
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        _pool.EndFrame();
+
+        _lastBinds = _binds;
+        _lastBarriers = _barriers;
+    }
+
+    // Forgets the declared passes and resources
+    void Reset()
+    {
+        _passes.clear();
+        _resources.clear();
+        _order.clear();
+    }
+
+    void Report(std::ostream& out)
+    {
+        double cpuTotal = 0.0, gpuTotal = 0.0;
+        out << std::fixed << std::setprecision(3);
+        for (auto& entry : _lastPasses)
+        {
+            out << std::left << std::setw(16) << entry.first << std::right;
+            if (!entry.second)
+            {
+                out << "  culled\n";
+                continue;
+            }
+
+            float cpu = _profiler.CpuStats(entry.first).Average;
+            float gpu = _profiler.GpuStats(entry.first).Average;
+            out << "  cpu " << std::setw(7) << cpu << " ms  gpu " << std::setw(7) << gpu << " ms\n";
+            cpuTotal += cpu;
+            gpuTotal += gpu;
+        }
+
+        out << std::left << std::setw(16) << "Total" << std::right
+            << "  cpu " << std::setw(7) << cpuTotal << " ms  gpu " << std::setw(7) << gpuTotal << " ms\n"
+            << "Target binds " << _lastBinds << ", barriers " << _lastBarriers << "\n";
+    }
+};
+
+#endif
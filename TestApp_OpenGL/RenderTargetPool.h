@@ -0,0 +1,263 @@
+#ifndef RENDERTARGETPOOL_H
+#define RENDERTARGETPOOL_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <map>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#include "FrameBuffer.h"
+
+/*
+* Transient render targets: passes Acquire() a texture by (size, format) when they start writing it and Release() it
+* after its last reader, so a later pass of the same frame gets the same texture back. Two targets whose lifetimes do
+* not overlap share one allocation; GL has no memory aliasing between different formats, so sharing is per key.
+* Textures that are not acquired for EvictAfterFrames frames (e.g. the old size after a resize) are deleted.
+*
+* Persistent targets (history, shadow map) stay FrameBuffers, the pool only holds what lives within one frame.
+*/
+class RenderTargetPool
+{
+public:
+    struct Key
+    {
+        unsigned int Width, Height;
+        GLenum Format;
+
+        bool operator<(const Key& other) const
+        {
+            if (Width != other.Width) return Width < other.Width;
+            if (Height != other.Height) return Height < other.Height;
+            return Format < other.Format;
+        }
+    };
+
+    static const unsigned int EvictAfterFrames = 3;
+
+private:
+    struct Entry
+    {
+        Key TargetKey;
+        unsigned int Texture;
+        bool InUse;
+        unsigned int LastUsedFrame;
+    };
+
+    std::vector<Entry> _entries;
+
+    // FBOs are cached by attachment set, a pass that binds the same textures again does not rebuild one
+    std::map<std::vector<unsigned int>, unsigned int> _framebuffers;
+
+    unsigned int _frame = 0;
+    size_t _inUseBytes = 0;
+    size_t _framePeakBytes = 0;
+    size_t _lastFramePeakBytes = 0;
+    int _frameAcquires = 0;
+    int _frameReuses = 0;
+    int _lastFrameAcquires = 0;
+    int _lastFrameReuses = 0;
+
+    static size_t Bytes(const Key& key)
+    {
+        return (size_t)key.Width * key.Height * FrameBuffer::BytesPerPixel(key.Format);
+    }
+
+    unsigned int CreateTexture(const Key& key)
+    {
+        unsigned int id;
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexImage2D(GL_TEXTURE_2D, 0, key.Format, key.Width, key.Height, 0, FrameBuffer::PixelFormat(key.Format), FrameBuffer::PixelType(key.Format), NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return id;
+    }
+
+    void DeleteFramebuffersUsing(unsigned int texture)
+    {
+        for (auto it = _framebuffers.begin(); it != _framebuffers.end(); )
+        {
+            if (std::find(it->first.begin(), it->first.end(), texture) != it->first.end())
+            {
+                glDeleteFramebuffers(1, &it->second);
+                it = _framebuffers.erase(it);
+            }
+            else
+                it++;
+        }
+    }
+
+    Entry* Find(unsigned int texture)
+    {
+        for (int i = 0; i < _entries.size(); i++)
+            if (_entries[i].Texture == texture)
+                return &_entries[i];
+
+        return nullptr;
+    }
+
+public:
+    RenderTargetPool() {}
+
+    RenderTargetPool(const RenderTargetPool&) = delete;
+    RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+    void BeginFrame()
+    {
+        _frame++;
+        _framePeakBytes = _inUseBytes;
+        _frameAcquires = 0;
+        _frameReuses = 0;
+    }
+
+    // Releases what is still held and evicts the textures nobody asked for lately
+    void EndFrame()
+    {
+        for (int i = 0; i < _entries.size(); i++)
+        {
+            if (_entries[i].InUse)
+                Release(_entries[i].Texture);
+        }
+
+        for (int i = (int)_entries.size() - 1; i >= 0; i--)
+        {
+            if (_frame - _entries[i].LastUsedFrame < EvictAfterFrames)
+                continue;
+
+            DeleteFramebuffersUsing(_entries[i].Texture);
+            glDeleteTextures(1, &_entries[i].Texture);
+            _entries.erase(_entries.begin() + i);
+        }
+
+        _lastFramePeakBytes = _framePeakBytes;
+        _lastFrameAcquires = _frameAcquires;
+        _lastFrameReuses = _frameReuses;
+    }
+
+    // A texture of this size and format for the current frame, contents undefined
+    unsigned int Acquire(unsigned int width, unsigned int height, GLenum format)
+    {
+        Key key = { width, height, format };
+        _frameAcquires++;
+
+        Entry* entry = nullptr;
+        for (int i = 0; i < _entries.size() && !entry; i++)
+        {
+            const Key& other = _entries[i].TargetKey;
+            if (!_entries[i].InUse && other.Width == width && other.Height == height && other.Format == format)
+                entry = &_entries[i];
+        }
+
+        if (entry)
+            _frameReuses++;
+        else
+        {
+            _entries.push_back({ key, CreateTexture(key), false, _frame });
+            entry = &_entries.back();
+        }
+
+        entry->InUse = true;
+        entry->LastUsedFrame = _frame;
+
+        _inUseBytes += Bytes(key);
+        _framePeakBytes = std::max(_framePeakBytes, _inUseBytes);
+        return entry->Texture;
+    }
+
+    // The texture may be handed to the next Acquire() with the same key, call it after the last pass reading it
+    void Release(unsigned int texture)
+    {
+        Entry* entry = Find(texture);
+        if (!entry || !entry->InUse)
+            return;
+
+        entry->InUse = false;
+        _inUseBytes -= Bytes(entry->TargetKey);
+    }
+
+    // Binds (and caches) a framebuffer with these color attachments and optional depth for drawing,
+    // draw buffers are set to every color attachment
+    void Bind(std::vector<unsigned int> colors, unsigned int depth = 0)
+    {
+        std::vector<unsigned int> attachments = colors;
+        attachments.push_back(depth);
+
+        unsigned int& fbo = _framebuffers[attachments];
+        if (fbo == 0)
+        {
+            glGenFramebuffers(1, &fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+            std::vector<GLenum> drawBuffers;
+            for (int i = 0; i < colors.size(); i++)
+            {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colors[i], 0);
+                drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + i);
+            }
+
+            if (depth != 0)
+            {
+                Entry* entry = Find(depth);
+                bool stencil = entry && FrameBuffer::HasStencil(entry->TargetKey.Format);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+            }
+
+            if (drawBuffers.empty())
+                glDrawBuffer(GL_NONE);
+            else
+                glDrawBuffers(drawBuffers.size(), drawBuffers.data());
+
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "ERROR::RENDER_TARGET_POOL:: Framebuffer is not complete!" << std::endl;
+        }
+        else
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    }
+
+    void FreeUnmanagedResources()
+    {
+        for (auto& framebuffer : _framebuffers)
+            glDeleteFramebuffers(1, &framebuffer.second);
+        _framebuffers.clear();
+
+        for (int i = 0; i < _entries.size(); i++)
+            glDeleteTextures(1, &_entries[i].Texture);
+        _entries.clear();
+        _inUseBytes = 0;
+    }
+
+    size_t AllocatedBytes()
+    {
+        size_t bytes = 0;
+        for (int i = 0; i < _entries.size(); i++)
+            bytes += Bytes(_entries[i].TargetKey);
+        return bytes;
+    }
+
+    // Highest amount held at once during the last completed frame
+    size_t PeakBytes() { return _lastFramePeakBytes; }
+
+    void Report(std::ostream& out)
+    {
+        const double MB = 1024.0 * 1024.0;
+        out << std::fixed << std::setprecision(2)
+            << "Peak in use  " << _lastFramePeakBytes / MB << " MB\n"
+            << "Allocated    " << AllocatedBytes() / MB << " MB in " << _entries.size() << " textures\n"
+            << "Acquires     " << _lastFrameAcquires << " (" << _lastFrameReuses << " reused)\n";
+
+        std::map<Key, int> counts;
+        for (int i = 0; i < _entries.size(); i++)
+            counts[_entries[i].TargetKey]++;
+        for (auto& count : counts)
+            out << "  " << count.first.Width << "x" << count.first.Height << " 0x" << std::hex << count.first.Format << std::dec << " x" << count.second << "\n";
+    }
+};
+
+#endif
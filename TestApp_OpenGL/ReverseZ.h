@@ -0,0 +1,119 @@
+#ifndef REVERSEZ_H
+#define REVERSEZ_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <string>
+#include <iostream>
+
+#include "Shader.h"
+
+/*
+* Reverse-Z: the perspective projection maps the near plane to depth 1 and the far plane to depth 0, and
+* glClipControl(GL_ZERO_TO_ONE) keeps that range as it is instead of going through [-1, 1]. The float
+* exponent then spreads the precision evenly over the eye depth (with GL_DEPTH_COMPONENT32F targets),
+* and the far plane can be pushed to infinity.
+*
+* Scene passes test with GL_GREATER and clear to 0. Orthographic projections (shadow maps) are linear in
+* depth anyway, they keep the usual direction and only follow the [0, 1] clip range (ZeroToOne()).
+* Without glClipControl (GL < 4.5 and no GL_ARB_clip_control) everything stays in the standard mode.
+*/
+namespace ReverseZ
+{
+    static bool Supported = false;
+    static bool Enabled = false;
+    static bool InfiniteFar = false;
+
+    // getProcAddress is the same loader handed to glad (glfwGetProcAddress)
+    void Initialize(GLADloadproc getProcAddress)
+    {
+        if (!GLAD_GL_VERSION_4_5 && ParallelShaderCompile::HasExtension("GL_ARB_clip_control"))
+            glad_glClipControl = (PFNGLCLIPCONTROLPROC)getProcAddress("glClipControl");
+
+        Supported = glad_glClipControl != nullptr;
+        Enabled = Supported;
+
+        std::cout << "DEPTH::REVERSE_Z " << (Supported ? "enabled" : "not available") << std::endl;
+    }
+
+    // Clip range in use: [0, 1] when reverse-Z is on
+    bool ZeroToOne()
+    {
+        return Supported && Enabled;
+    }
+
+    // Call once per frame, before the first pass, so that toggling Enabled takes effect
+    void Apply()
+    {
+        if (Supported)
+            glClipControl(GL_LOWER_LEFT, ZeroToOne() ? GL_ZERO_TO_ONE : GL_NEGATIVE_ONE_TO_ONE);
+    }
+
+    // Perspective in the current mode, far is ignored when InfiniteFar
+    glm::mat4 Perspective(float fovy, float aspect, float near, float far)
+    {
+        if (!ZeroToOne())
+            return InfiniteFar ? glm::infinitePerspective(fovy, aspect, near) : glm::perspective(fovy, aspect, near, far);
+
+        float f = 1.0f / std::tan(fovy * 0.5f);
+        glm::mat4 proj(0.0f);
+        proj[0][0] = f / aspect;
+        proj[1][1] = f;
+        proj[2][3] = -1.0f;
+
+        // depth = near / zEye for an infinite far plane, near (far - zEye) / (zEye (far - near)) otherwise
+        proj[2][2] = InfiniteFar ? 0.0f : near / (far - near);
+        proj[3][2] = InfiniteFar ? near : near * far / (far - near);
+        return proj;
+    }
+
+    // Remaps a standard GL projection ([-1, 1] depth) to the current clip range, depth direction unchanged
+    glm::mat4 ToClipRange(glm::mat4 proj)
+    {
+        if (!ZeroToOne())
+            return proj;
+
+        glm::mat4 remap(1.0f);
+        remap[2][2] = 0.5f;
+        remap[3][2] = 0.5f;
+        return remap * proj;
+    }
+
+    // (x, y) such that 1 / zEye = depth * x + y, for a depth read from a target written with Perspective()
+    glm::vec2 LinearizeParams(float near, float far)
+    {
+        if (ZeroToOne())
+            return InfiniteFar ? glm::vec2(1.0f / near, 0.0f) : glm::vec2(1.0f / near - 1.0f / far, 1.0f / far);
+
+        // standard GL, depth = 0.5 * ndc + 0.5
+        return InfiniteFar ? glm::vec2(-1.0f / near, 1.0f / near) : glm::vec2(1.0f / far - 1.0f / near, 1.0f / near);
+    }
+
+    // The depth test equivalent to func in the current mode (GL_LESS => GL_GREATER, ...)
+    GLenum DepthFunc(GLenum func)
+    {
+        if (!ZeroToOne())
+            return func;
+
+        switch (func)
+        {
+        case GL_LESS:    return GL_GREATER;
+        case GL_LEQUAL:  return GL_GEQUAL;
+        case GL_GREATER: return GL_LESS;
+        case GL_GEQUAL:  return GL_LEQUAL;
+        default:         return func;
+        }
+    }
+
+    // Depth state of a pass drawn with Perspective() (reversed) or with a standard projection
+    void BeginPass(bool reversed)
+    {
+        bool flip = reversed && ZeroToOne();
+        glClearDepth(flip ? 0.0 : 1.0);
+        glDepthFunc(flip ? GL_GREATER : GL_LESS);
+    }
+}
+
+#endif
@@ -0,0 +1,897 @@
+#ifndef SCENELOADER_H
+#define SCENELOADER_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <future>
+#include <chrono>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <filesystem>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+#include "Mesh.h"
+#include "GeometryHelper.h"
+#include "JobSystem.h"
+#include "TransformHierarchy.h"
+
+/*
+* Scenes are JSON files (Assets/Scenes) instead of code:
+*
+*   {
+*     "lights":    { "ambient": [1, 1, 1, 0.6], "direction": [1, 1, -1], "diffuse": [...], "specular": [...] },
+*     "materials": { "Floor": { "diffuse": [...], "specular": [...], "shininess": 64 } },
+*     "meshes":    { "plane": { "box": [1, 1, 1] }, "monkey": { "file": "./Assets/Models/suzanne.obj" } },
+*     "instances": [
+*       { "mesh": "plane", "position": [-4, -4, -0.25], "scale": [8, 8, 0.25], "material": "MatteGray" },
+*       { "mesh": "monkey", "submesh": 0, "rotation": 1.3, "axis": [1, 0, 0], "then": { "position": [0, 0, 1] } },
+*       { "name": "rig", "position": [2, 0, 0] },
+*       { "mesh": "monkey", "parent": "rig", "position": [0, 0, 1] }
+*     ]
+*   }
+*
+* Primitives are "box": [w, h, d], "cone" / "cylinder": [radius, height, subdivisions]. Instances take every submesh of
+* the file unless "submesh" picks one; "then" is a second transform applied on top (MeshRenderer::Transform cumulative).
+* Every instance is a node of the scene's TransformHierarchy, under the earlier instance named by "parent"; instances
+* without "mesh" only group others. All the submeshes of an instance share its node and move with it.
+* Materials default to MaterialsCollection, shaders to LIT_WITH_SHADOWS_SSAO / LIT_WITH_SSAO ("shader", "shaderNoShadows").
+*
+* Model files are read once per program: the meshes stay in Cache (renderers point into it) and a binary copy is kept in
+* CacheDirectory, keyed like the texture cache by path, size and write time. Files missing from both are imported and
+* bounded on the job system while frames keep running; SceneStream uploads what is ready within a per-frame budget.
+*/
+namespace SceneLoader
+{
+    static std::string CacheDirectory = "./MeshCache/";
+
+    // JSON ================================================================================================================= //
+    struct Json
+    {
+        enum Type { Null, Boolean, Number, String, Array, Object };
+
+        Type Kind = Null;
+        double Scalar = 0.0;        // numbers, booleans as 0/1
+        std::string Text;
+        std::vector<Json> Items;
+        std::vector<std::pair<std::string, Json>> Members;  // file order
+
+        const Json* Find(const std::string& key) const
+        {
+            for (int i = 0; i < Members.size(); i++)
+                if (Members[i].first == key)
+                    return &Members[i].second;
+            return nullptr;
+        }
+
+        float Float(const std::string& key, float fallback) const
+        {
+            const Json* value = Find(key);
+            return value && value->Kind == Number ? (float)value->Scalar : fallback;
+        }
+
+        std::string Str(const std::string& key, const std::string& fallback) const
+        {
+            const Json* value = Find(key);
+            return value && value->Kind == String ? value->Text : fallback;
+        }
+
+        // Array of numbers into a vecN, missing components keep the fallback
+        template <typename T>
+        T Vec(const std::string& key, T fallback) const
+        {
+            const Json* value = Find(key);
+            if (!value || value->Kind != Array)
+                return fallback;
+
+            int components = sizeof(T) / sizeof(float);
+            for (int i = 0; i < value->Items.size() && i < components; i++)
+                fallback[i] = (float)value->Items[i].Scalar;
+            return fallback;
+        }
+    };
+
+    class JsonParser
+    {
+    private:
+        const std::string& _text;
+        size_t _pos = 0;
+        std::string _error;
+
+        bool Fail(const std::string& message)
+        {
+            if (_error.empty())
+                _error = message + " at line " + std::to_string(1 + std::count(_text.begin(), _text.begin() + std::min(_pos, _text.size()), '\n'));
+            return false;
+        }
+
+        void SkipSpace()
+        {
+            while (_pos < _text.size() && isspace((unsigned char)_text[_pos]))
+                _pos++;
+        }
+
+        bool Accept(char c)
+        {
+            SkipSpace();
+            if (_pos < _text.size() && _text[_pos] == c)
+            {
+                _pos++;
+                return true;
+            }
+            return false;
+        }
+
+        bool Expect(char c)
+        {
+            return Accept(c) || Fail(std::string("expected '") + c + "'");
+        }
+
+        bool ParseString(std::string& out)
+        {
+            if (!Expect('"'))
+                return false;
+
+            while (_pos < _text.size() && _text[_pos] != '"')
+            {
+                char c = _text[_pos++];
+                if (c == '\\' && _pos < _text.size())
+                {
+                    c = _text[_pos++];
+                    if (c == 'n') c = '\n';
+                    else if (c == 't') c = '\t';
+                }
+                out += c;
+            }
+
+            if (_pos >= _text.size())
+                return Fail("unterminated string");
+            _pos++;
+            return true;
+        }
+
+        bool ParseValue(Json& value)
+        {
+            SkipSpace();
+            if (_pos >= _text.size())
+                return Fail("unexpected end of file");
+
+            char c = _text[_pos];
+            if (c == '{')
+            {
+                _pos++;
+                value.Kind = Json::Object;
+                if (Accept('}'))
+                    return true;
+                do
+                {
+                    value.Members.push_back({ "", Json() });
+                    SkipSpace();
+                    if (!ParseString(value.Members.back().first) || !Expect(':') || !ParseValue(value.Members.back().second))
+                        return false;
+                } while (Accept(','));
+                return Expect('}');
+            }
+
+            if (c == '[')
+            {
+                _pos++;
+                value.Kind = Json::Array;
+                if (Accept(']'))
+                    return true;
+                do
+                {
+                    value.Items.push_back(Json());
+                    if (!ParseValue(value.Items.back()))
+                        return false;
+                } while (Accept(','));
+                return Expect(']');
+            }
+
+            if (c == '"')
+            {
+                value.Kind = Json::String;
+                return ParseString(value.Text);
+            }
+
+            const char* keywords[] = { "true", "false", "null" };
+            for (int i = 0; i < 3; i++)
+            {
+                if (_text.compare(_pos, strlen(keywords[i]), keywords[i]) == 0)
+                {
+                    _pos += strlen(keywords[i]);
+                    value.Kind = i < 2 ? Json::Boolean : Json::Null;
+                    value.Scalar = i == 0 ? 1.0 : 0.0;
+                    return true;
+                }
+            }
+
+            char* end = nullptr;
+            value.Scalar = strtod(_text.c_str() + _pos, &end);
+            if (end == _text.c_str() + _pos)
+                return Fail("unexpected character");
+
+            value.Kind = Json::Number;
+            _pos = end - _text.c_str();
+            return true;
+        }
+
+    public:
+        JsonParser(const std::string& text) : _text(text) {}
+
+        bool Parse(Json& root)
+        {
+            if (!ParseValue(root))
+                return false;
+
+            SkipSpace();
+            return _pos == _text.size() || Fail("trailing characters");
+        }
+
+        const std::string& Error() { return _error; }
+    };
+
+    // Mesh cache =========================================================================================================== //
+    struct CachedMesh
+    {
+        std::vector<Mesh> Meshes;
+        std::vector<glm::vec3> Min, Max;    // object space bounds, one per submesh
+        bool FromDisk = false;
+        double LoadMs = 0.0;
+    };
+
+    // Lives as long as the program, renderers keep pointers to the meshes
+    static std::map<std::string, CachedMesh> Cache;
+
+    std::string CachePath(std::string path)
+    {
+        std::error_code error;
+        auto size = std::filesystem::file_size(path, error);
+        auto time = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+
+        size_t hash = std::hash<std::string>()(path + "|" + std::to_string(size) + "|" + std::to_string(time));
+        return CacheDirectory + std::to_string(hash) + ".mesh";
+    }
+
+    // Written first in every .mesh file, a layout change bumps the version so old entries are rebuilt
+    static const unsigned int CacheMagic = 0x4853454D;  // "MESH"
+    static const unsigned int CacheVersion = 1;
+
+    // Header of this version, then every mesh sized to fit in the file with indices inside its vertices; anything
+    // else (truncated, older or foreign file) is treated as a miss and the cache entry gets rebuilt
+    bool ReadCache(std::string cachePath, std::vector<Mesh>* meshes)
+    {
+        std::ifstream file(cachePath, std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+        long long remaining = (long long)file.tellg();
+        file.seekg(0);
+
+        unsigned int magic = 0, version = 0;
+        int count = 0;
+        file.read((char*)&magic, sizeof(magic));
+        file.read((char*)&version, sizeof(version));
+        file.read((char*)&count, sizeof(count));
+        remaining -= sizeof(magic) + sizeof(version) + sizeof(count);
+        bool valid = file && magic == CacheMagic && version == CacheVersion && count > 0;
+        for (int i = 0; i < count && valid; i++)
+        {
+            int vertices = 0, indices = 0;
+            file.read((char*)&vertices, sizeof(vertices));
+            file.read((char*)&indices, sizeof(indices));
+            remaining -= 2 * sizeof(int);
+
+            long long size = (long long)vertices * 2 * sizeof(glm::vec3) + (long long)indices * sizeof(int);
+            valid = file && vertices > 0 && indices >= 3 && indices % 3 == 0 && size <= remaining;
+            if (!valid)
+                break;
+
+            std::vector<glm::vec3> positions(vertices), normals(vertices);
+            std::vector<int> triangles(indices);
+            file.read((char*)positions.data(), vertices * sizeof(glm::vec3));
+            file.read((char*)normals.data(), vertices * sizeof(glm::vec3));
+            file.read((char*)triangles.data(), indices * sizeof(int));
+            remaining -= size;
+            valid = (bool)file;
+
+            for (int t = 0; t < indices && valid; t++)
+                valid = triangles[t] >= 0 && triangles[t] < vertices;
+
+            if (valid)
+                meshes->push_back(Mesh(positions, normals, triangles));
+        }
+
+        if (!valid)
+        {
+            std::cout << "SCENE::CACHE_INVALID " << cachePath << ", rebuilding" << std::endl;
+            meshes->clear();
+            return false;
+        }
+        return true;
+    }
+
+    void WriteCache(std::string cachePath, std::vector<Mesh>& meshes)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(CacheDirectory, error);
+
+        std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return;
+
+        int count = meshes.size();
+        file.write((char*)&CacheMagic, sizeof(CacheMagic));
+        file.write((char*)&CacheVersion, sizeof(CacheVersion));
+        file.write((char*)&count, sizeof(count));
+        for (int i = 0; i < count; i++)
+        {
+            std::vector<glm::vec3> positions = meshes[i].GetPositions();
+            std::vector<glm::vec3> normals = meshes[i].GetNormals();
+            std::vector<int> indices = meshes[i].GetIndices();
+            int vertices = positions.size(), numIndices = indices.size();
+
+            file.write((char*)&vertices, sizeof(vertices));
+            file.write((char*)&numIndices, sizeof(numIndices));
+            file.write((char*)positions.data(), vertices * sizeof(glm::vec3));
+            file.write((char*)normals.data(), vertices * sizeof(glm::vec3));
+            file.write((char*)indices.data(), numIndices * sizeof(int));
+        }
+    }
+
+    void ComputeBounds(CachedMesh& entry)
+    {
+        for (int i = 0; i < entry.Meshes.size(); i++)
+        {
+            glm::vec3 min, max;
+            Utils::GetMinMax(entry.Meshes[i].PositionData(), entry.Meshes[i].PositionCount(), min, max);
+
+            entry.Min.push_back(min);
+            entry.Max.push_back(max);
+        }
+    }
+
+    // CPU only, safe to run on any thread (one Assimp importer per call)
+    CachedMesh LoadFile(std::string path)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        CachedMesh entry;
+        std::string cachePath = CachePath(path);
+        entry.FromDisk = ReadCache(cachePath, &entry.Meshes);
+        if (!entry.FromDisk)
+        {
+            FileReader reader = FileReader(path.c_str());
+            reader.Load();
+            entry.Meshes = reader.Meshes();
+            if (!entry.Meshes.empty())
+                WriteCache(cachePath, entry.Meshes);
+        }
+
+        ComputeBounds(entry);
+        entry.LoadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        return entry;
+    }
+
+    // The primitive a mesh declares and its 3 numeric arguments, nullptr when it declares none that is usable.
+    // MeshKey and BuildPrimitive both go through here, so a cached entry is always the primitive that was built.
+    const char* PrimitiveOf(const Json& mesh, const Json** args)
+    {
+        const char* primitives[] = { "box", "cone", "cylinder" };
+        for (int i = 0; i < 3; i++)
+        {
+            const Json* found = mesh.Find(primitives[i]);
+            if (!found)
+                continue;
+
+            if (found->Kind != Json::Array || found->Items.size() < 3)
+                return nullptr;
+            for (int a = 0; a < 3; a++)
+                if (found->Items[a].Kind != Json::Number)
+                    return nullptr;
+
+            *args = found;
+            return primitives[i];
+        }
+        return nullptr;
+    }
+
+    // Cache key of a mesh declaration, empty when the declaration is not understood
+    std::string MeshKey(const Json& mesh)
+    {
+        if (mesh.Find("file"))
+        {
+            std::string file = mesh.Str("file", "");
+            return file.empty() ? "" : "file:" + file;
+        }
+
+        const Json* args = nullptr;
+        const char* primitive = PrimitiveOf(mesh, &args);
+        if (!primitive)
+            return "";
+
+        std::stringstream key;
+        key << primitive;
+        for (int a = 0; a < 3; a++)
+            key << (a == 0 ? ":" : ",") << args->Items[a].Scalar;
+        return key.str();
+    }
+
+    // Only for declarations MeshKey accepted
+    CachedMesh BuildPrimitive(const Json& mesh)
+    {
+        CachedMesh entry;
+        const Json* args = nullptr;
+        const char* primitive = PrimitiveOf(mesh, &args);
+        if (primitive && !strcmp(primitive, "box"))
+            entry.Meshes.push_back(Mesh::Box(args->Items[0].Scalar, args->Items[1].Scalar, args->Items[2].Scalar));
+        else if (primitive && !strcmp(primitive, "cone"))
+            entry.Meshes.push_back(Mesh::Cone(args->Items[0].Scalar, args->Items[1].Scalar, (int)args->Items[2].Scalar));
+        else if (primitive && !strcmp(primitive, "cylinder"))
+            entry.Meshes.push_back(Mesh::Cylinder(args->Items[0].Scalar, args->Items[1].Scalar, (int)args->Items[2].Scalar));
+
+        ComputeBounds(entry);
+        return entry;
+    }
+
+    // Scene ================================================================================================================ //
+    glm::mat4 TransformOf(const Json& transform)
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, transform.Vec("position", glm::vec3(0, 0, 0)));
+        model = glm::rotate(model, transform.Float("rotation", 0.0f), transform.Vec("axis", glm::vec3(0, 0, 1)));
+        model = glm::scale(model, transform.Vec("scale", glm::vec3(1, 1, 1)));
+        return model;
+    }
+
+    Material MaterialOf(const Json& material)
+    {
+        return Material{
+            material.Vec("diffuse", glm::vec4(0.5, 0.5, 0.5, 1)),
+            material.Vec("specular", glm::vec4(0.5, 0.5, 0.5, 1)),
+            material.Float("shininess", 64) };
+    }
+
+    void ApplyLights(const Json& lights, SceneLights* sceneLights)
+    {
+        sceneLights->Ambient.Ambient = lights.Vec("ambient", sceneLights->Ambient.Ambient);
+        sceneLights->Directional.Direction = lights.Vec("direction", sceneLights->Directional.Direction);
+        sceneLights->Directional.Diffuse = lights.Vec("diffuse", sceneLights->Directional.Diffuse);
+        sceneLights->Directional.Specular = lights.Vec("specular", sceneLights->Directional.Specular);
+    }
+
+    // World bounds of the renderers from their vertices, renderers split over the job system
+    BoundingBox SceneBounds(std::vector<MeshRenderer>& renderers)
+    {
+        std::vector<glm::vec3> min(renderers.size()), max(renderers.size());
+        Jobs().ParallelFor(renderers.size(), 4, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+                renderers[i].GetBounds(min[i], max[i]);
+        });
+
+        BoundingBox bounds = BoundingBox(std::vector<glm::vec3>{});
+        for (int i = 0; i < renderers.size(); i++)
+            bounds.Update(min[i], max[i]);
+        return bounds;
+    }
+
+    // Bounds of the meshes in files, three ways: the old path (transformed copy of the positions, then a scalar
+    // reduction), the SSE kernel on one thread, and the kernel over many instances on the job system
+    //
+    //   TestApp_OpenGL --bounds-benchmark
+    void BoundsBenchmark(std::ostream& out, const std::vector<std::string>& files, int repeats = 10)
+    {
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(1, -2, 0.5f));
+        transform = glm::rotate(transform, 0.7f, glm::normalize(glm::vec3(1, 1, 0)));
+        transform = glm::scale(transform, glm::vec3(1.5f, 0.5f, 2.0f));
+
+        auto elapsed = [](std::chrono::high_resolution_clock::time_point start)
+        {
+            return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        };
+
+        for (const std::string& file : files)
+        {
+            CachedMesh entry = LoadFile(file);
+            long long vertices = 0;
+            for (int m = 0; m < entry.Meshes.size(); m++)
+                vertices += entry.Meshes[m].PositionCount();
+            if (vertices == 0)
+            {
+                out << "BOUNDS::SKIPPED " << file << " (no vertices)" << std::endl;
+                continue;
+            }
+
+            glm::vec3 referenceMin, referenceMax, kernelMin, kernelMax;
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int r = 0; r < repeats; r++)
+            {
+                referenceMin = glm::vec3(1, 1, 1) * std::numeric_limits<float>::max();
+                referenceMax = glm::vec3(1, 1, 1) * std::numeric_limits<float>::lowest();
+                for (int m = 0; m < entry.Meshes.size(); m++)
+                {
+                    std::vector<glm::vec3> transformed = entry.Meshes[m].GetPositions();
+                    for (int v = 0; v < transformed.size(); v++)
+                        transformed[v] = glm::vec3(transform * glm::vec4(transformed[v], 1.0f));
+
+                    glm::vec3 min, max;
+                    Utils::GetMinMax(transformed, min, max);
+                    referenceMin = glm::min(referenceMin, min);
+                    referenceMax = glm::max(referenceMax, max);
+                }
+            }
+            double referenceMs = elapsed(start) / repeats;
+
+            start = std::chrono::high_resolution_clock::now();
+            for (int r = 0; r < repeats; r++)
+            {
+                kernelMin = glm::vec3(1, 1, 1) * std::numeric_limits<float>::max();
+                kernelMax = glm::vec3(1, 1, 1) * std::numeric_limits<float>::lowest();
+                for (int m = 0; m < entry.Meshes.size(); m++)
+                {
+                    glm::vec3 min, max;
+                    Utils::GetTransformedMinMax(entry.Meshes[m].PositionData(), entry.Meshes[m].PositionCount(), transform, min, max);
+                    kernelMin = glm::min(kernelMin, min);
+                    kernelMax = glm::max(kernelMax, max);
+                }
+            }
+            double kernelMs = elapsed(start) / repeats;
+
+            // one instance per mesh and core, 4 times over, like a scene full of copies
+            int instances = 4 * (Jobs().Workers() + 1) * entry.Meshes.size();
+            std::vector<glm::vec3> min(instances), max(instances);
+            start = std::chrono::high_resolution_clock::now();
+            for (int r = 0; r < repeats; r++)
+            {
+                Jobs().ParallelFor(instances, 1, [&](int begin, int end)
+                {
+                    for (int i = begin; i < end; i++)
+                    {
+                        Mesh& mesh = entry.Meshes[i % entry.Meshes.size()];
+                        Utils::GetTransformedMinMax(mesh.PositionData(), mesh.PositionCount(), transform, min[i], max[i]);
+                    }
+                });
+            }
+            double parallelMs = elapsed(start) / repeats;
+            double serialMs = kernelMs * instances / entry.Meshes.size();
+
+            glm::vec3 error = glm::max(glm::abs(referenceMin - kernelMin), glm::abs(referenceMax - kernelMax));
+            out << std::fixed << std::setprecision(3)
+                << "BOUNDS::" << file << " " << vertices << " vertices in " << entry.Meshes.size() << " meshes" << std::endl
+                << "  copy + scalar   " << std::setw(9) << referenceMs << " ms" << std::endl
+                << "  sse             " << std::setw(9) << kernelMs << " ms  x" << referenceMs / kernelMs << std::endl
+                << "  sse, " << std::setw(4) << instances << " instances on " << Jobs().Workers() + 1 << " threads "
+                << std::setw(9) << parallelMs << " ms  x" << serialMs / parallelMs << " over one thread" << std::endl
+                << "  max difference " << std::scientific << std::max(error.x, std::max(error.y, error.z)) << std::endl;
+        }
+    }
+
+    // Vertex and index bytes SceneStream::Step hands to the driver per frame (at least one renderer goes through)
+    static size_t UploadBudget = 16 * 1024 * 1024;
+
+    size_t UploadSize(Mesh& mesh)
+    {
+        return (size_t)mesh.NumVertices() * 2 * sizeof(glm::vec3) + (size_t)mesh.NumIndices() * sizeof(int);
+    }
+
+    // A scene being loaded: Open() parses the file and starts importing the model files on worker threads, Step()
+    // creates the renderers whose meshes are ready, within the upload budget, and grows the bounds one instance at
+    // a time. Finish() waits for everything (headless runs, benchmarks).
+    class SceneStream
+    {
+    private:
+        struct Placement
+        {
+            int Instance;
+            std::string Key;
+            int Submesh;            // -1: every submesh of the file
+            int Next;               // next submesh to create, once the mesh is there
+            TransformHierarchy::Node Node;
+            Material Mat;
+            ShaderBase* Shader;
+            ShaderBase* ShaderNoShadows;
+        };
+
+        std::string _path;
+        std::string _source;
+        Json _scene;
+        std::map<std::string, std::future<CachedMesh>> _loading;
+        std::vector<Placement> _pending;
+        bool _open = false;
+
+        TransformHierarchy _transforms;
+        std::vector<TransformHierarchy::Node> _rendererNodes;   // by renderer, in sceneMeshCollection order
+
+        std::chrono::high_resolution_clock::time_point _start;
+        int _meshes = 0, _imported = 0, _fromDisk = 0, _reused = 0, _renderers = 0, _frames = 0;
+
+        // Moves finished imports into the cache, they are only touched from this thread from then on
+        void Collect(bool wait)
+        {
+            for (auto load = _loading.begin(); load != _loading.end(); )
+            {
+                if (!wait && load->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                {
+                    load++;
+                    continue;
+                }
+
+                Cache[load->first] = load->second.get();
+                _fromDisk += Cache[load->first].FromDisk ? 1 : 0;
+                load = _loading.erase(load);
+            }
+        }
+
+        void Place(Placement& placement, int submesh, std::vector<MeshRenderer>* sceneMeshCollection, BoundingBox* sceneBoundingBox)
+        {
+            CachedMesh& entry = Cache[placement.Key];
+            const glm::mat4& model = _transforms.World(placement.Node);
+
+            MeshRenderer renderer =
+                MeshRenderer(glm::vec3(0, 0, 0), 0.0f, glm::vec3(0, 0, 1), glm::vec3(1, 1, 1),
+                    &entry.Meshes[submesh], placement.Shader, placement.ShaderNoShadows, placement.Mat);
+            renderer.SetModelMatrix(model);
+
+            sceneMeshCollection->push_back(renderer);
+            _rendererNodes.push_back(placement.Node);
+            _renderers++;
+
+            // the 8 transformed corners of the object space box, conservative under rotation and
+            // independent of the vertex count
+            glm::vec3 min = entry.Min[submesh], max = entry.Max[submesh];
+            std::vector<glm::vec3> corners;
+            for (int c = 0; c < 8; c++)
+            {
+                glm::vec3 corner = glm::vec3(c & 1 ? max.x : min.x, c & 2 ? max.y : min.y, c & 4 ? max.z : min.z);
+                corners.push_back(glm::vec3(model * glm::vec4(corner, 1.0f)));
+            }
+            sceneBoundingBox->Update(corners);
+        }
+
+    public:
+        SceneStream() {}
+
+        SceneStream(const SceneStream&) = delete;
+        SceneStream& operator=(const SceneStream&) = delete;
+
+        // Lights found in the file overwrite sceneLights (when given) right away
+        bool Open(std::string path, std::map<std::string, ShaderBase*>* shadersCollection, SceneLights* sceneLights = nullptr)
+        {
+            _start = std::chrono::high_resolution_clock::now();
+            _path = path;
+
+            std::ifstream file(path);
+            if (!file.is_open())
+            {
+                std::cout << "ERROR::SCENE::FILE_NOT_FOUND " << path << std::endl;
+                return false;
+            }
+            std::stringstream text;
+            text << file.rdbuf();
+            _source = text.str();
+
+            JsonParser parser(_source);
+            if (!parser.Parse(_scene) || _scene.Kind != Json::Object)
+            {
+                std::cout << "ERROR::SCENE::PARSE " << path << ": " << (parser.Error().empty() ? "not an object" : parser.Error()) << std::endl;
+                return false;
+            }
+
+            std::map<std::string, Material> materials =
+            {
+                { "ShinyRed",       MaterialsCollection::ShinyRed       },
+                { "PlasticGreen",   MaterialsCollection::PlasticGreen   },
+                { "Copper",         MaterialsCollection::Copper         },
+                { "PureWhite",      MaterialsCollection::PureWhite      },
+                { "MatteGray",      MaterialsCollection::MatteGray      },
+            };
+            if (const Json* declared = _scene.Find("materials"))
+                for (auto& material : declared->Members)
+                    materials[material.first] = MaterialOf(material.second);
+
+            // Mesh names to cache keys; files not cached yet are imported in parallel
+            std::map<std::string, std::string> meshKeys;
+            if (const Json* declared = _scene.Find("meshes"))
+            {
+                for (auto& mesh : declared->Members)
+                {
+                    std::string key = MeshKey(mesh.second);
+                    if (key.empty())
+                    {
+                        std::cout << "ERROR::SCENE::BAD_MESH " << mesh.first << std::endl;
+                        continue;
+                    }
+                    meshKeys[mesh.first] = key;
+
+                    if (Cache.count(key) || _loading.count(key))
+                        _reused++;
+                    else if (mesh.second.Find("file"))
+                    {
+                        std::string file = mesh.second.Str("file", "");
+                        _loading[key] = Jobs().Async<CachedMesh>([file] { return LoadFile(file); });
+                        _imported++;
+                    }
+                    else
+                        Cache[key] = BuildPrimitive(mesh.second);
+                }
+            }
+            _meshes = meshKeys.size();
+
+            const Json* instances = _scene.Find("instances");
+            std::map<std::string, TransformHierarchy::Node> nodes;
+            for (int i = 0; instances && i < instances->Items.size(); i++)
+            {
+                const Json& instance = instances->Items[i];
+
+                TransformHierarchy::Node parent = TransformHierarchy::Root;
+                if (instance.Find("parent"))
+                {
+                    std::string parentName = instance.Str("parent", "");
+                    if (nodes.count(parentName))
+                        parent = nodes[parentName];
+                    else
+                        std::cout << "ERROR::SCENE::UNKNOWN_PARENT " << parentName << " (parents come first)" << std::endl;
+                }
+
+                const Json* then = instance.Find("then");
+                TransformHierarchy::Node node = _transforms.Add(then ? TransformOf(*then) * TransformOf(instance) : TransformOf(instance), parent);
+                if (instance.Find("name"))
+                    nodes[instance.Str("name", "")] = node;
+
+                if (!instance.Find("mesh"))
+                    continue;
+
+                std::string meshName = instance.Str("mesh", "");
+                if (!meshKeys.count(meshName))
+                {
+                    std::cout << "ERROR::SCENE::UNKNOWN_MESH " << meshName << std::endl;
+                    continue;
+                }
+
+                std::string materialName = instance.Str("material", "MatteGray");
+                if (!materials.count(materialName))
+                    std::cout << "ERROR::SCENE::UNKNOWN_MATERIAL " << materialName << std::endl;
+
+                // submeshes past the end of the file are reported by Step, once the file is read
+                int submesh = -1;
+                if (const Json* declared = instance.Find("submesh"))
+                {
+                    if (declared->Kind != Json::Number || declared->Scalar < 0 || declared->Scalar != (int)declared->Scalar)
+                    {
+                        std::cout << "ERROR::SCENE::BAD_SUBMESH " << meshName << " in instance " << i << std::endl;
+                        continue;
+                    }
+                    submesh = (int)declared->Scalar;
+                }
+
+                std::string shaderName = instance.Str("shader", "LIT_WITH_SHADOWS_SSAO");
+                std::string shaderNoShadowsName = instance.Str("shaderNoShadows", "LIT_WITH_SSAO");
+                auto shader = shadersCollection->find(shaderName);
+                auto shaderNoShadows = shadersCollection->find(shaderNoShadowsName);
+                if (shader == shadersCollection->end() || !shader->second)
+                {
+                    std::cout << "ERROR::SCENE::UNKNOWN_SHADER " << shaderName << " in instance " << i << std::endl;
+                    continue;
+                }
+                if (shaderNoShadows == shadersCollection->end() || !shaderNoShadows->second)
+                {
+                    std::cout << "ERROR::SCENE::UNKNOWN_SHADER " << shaderNoShadowsName << " in instance " << i << std::endl;
+                    continue;
+                }
+
+                _pending.push_back({ i, meshKeys[meshName], submesh, std::max(submesh, 0), node,
+                    materials.count(materialName) ? materials[materialName] : MaterialsCollection::MatteGray,
+                    shader->second, shaderNoShadows->second });
+            }
+
+            if (sceneLights)
+                if (const Json* lights = _scene.Find("lights"))
+                    ApplyLights(*lights, sceneLights);
+
+            _open = true;
+            return true;
+        }
+
+        // Once per frame on the thread owning the context, true once the whole scene is in sceneMeshCollection
+        bool Step(std::vector<MeshRenderer>* sceneMeshCollection, BoundingBox* sceneBoundingBox, size_t budget = UploadBudget)
+        {
+            if (Done())
+                return true;
+
+            Collect(false);
+            UpdateTransforms(sceneMeshCollection);  // placed renderers take the world matrices as they are now
+            _frames++;
+
+            size_t spent = 0;
+            for (int i = 0; i < _pending.size() && spent < budget; )
+            {
+                Placement& placement = _pending[i];
+                if (_loading.count(placement.Key))
+                {
+                    i++;    // still importing, later instances may be ready
+                    continue;
+                }
+
+                CachedMesh& entry = Cache[placement.Key];
+                int last = placement.Submesh < 0 ? (int)entry.Meshes.size() - 1 : placement.Submesh;
+                if (last >= (int)entry.Meshes.size())
+                {
+                    std::cout << "ERROR::SCENE::BAD_SUBMESH " << placement.Key << " " << placement.Submesh << std::endl;
+                    last = -1;
+                }
+
+                while (placement.Next <= last && (spent == 0 || spent + UploadSize(entry.Meshes[placement.Next]) <= budget))
+                {
+                    spent += UploadSize(entry.Meshes[placement.Next]);
+                    Place(placement, placement.Next++, sceneMeshCollection, sceneBoundingBox);
+                }
+
+                if (placement.Next > last)
+                    _pending.erase(_pending.begin() + i);
+                else
+                    break;  // out of budget
+            }
+
+            if (Done())
+            {
+                // exact bounds now that every vertex is there, the streamed ones come from the mesh boxes' corners
+                *sceneBoundingBox = SceneBounds(*sceneMeshCollection);
+
+                std::cout << "SCENE::LOADED " << _path << ": " << _renderers << " renderers, " << _meshes << " meshes ("
+                    << _imported << " imported, " << _fromDisk << " of them from " << CacheDirectory << ", " << _reused << " already in memory) in "
+                    << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _start).count() << " ms over "
+                    << _frames << " frames" << std::endl;
+            }
+            return Done();
+        }
+
+        // Blocks until every mesh is imported and uploaded
+        void Finish(std::vector<MeshRenderer>* sceneMeshCollection, BoundingBox* sceneBoundingBox)
+        {
+            Collect(true);
+            Step(sceneMeshCollection, sceneBoundingBox, std::numeric_limits<size_t>::max());
+        }
+
+        bool Done() { return !_open || (_loading.empty() && _pending.empty()); }
+
+        // Node of every instance, in file order; move them with SetLocal and UpdateTransforms
+        TransformHierarchy& Transforms() { return _transforms; }
+
+        // Once per frame before the scene is drawn: world matrices of the moved nodes reach their renderers. The
+        // scene bounds are not grown for moved instances.
+        void UpdateTransforms(std::vector<MeshRenderer>* sceneMeshCollection)
+        {
+            _transforms.Update();
+            Jobs().ParallelFor(_rendererNodes.size(), 1024, [this, sceneMeshCollection](int begin, int end)
+            {
+                for (int i = begin; i < end; i++)
+                    if (_transforms.Changed(_rendererNodes[i]))
+                        (*sceneMeshCollection)[i].SetModelMatrix(_transforms.World(_rendererNodes[i]));
+            });
+        }
+
+        // Renderers created so far over renderers known (submeshes of files still importing count as one)
+        float Progress()
+        {
+            int remaining = 0;
+            for (int i = 0; i < _pending.size(); i++)
+            {
+                bool loaded = !_loading.count(_pending[i].Key);
+                int last = _pending[i].Submesh >= 0 || !loaded ? _pending[i].Next : (int)Cache[_pending[i].Key].Meshes.size() - 1;
+                remaining += std::max(1, last - _pending[i].Next + 1);
+            }
+            return _renderers + remaining == 0 ? 1.0f : _renderers / (float)(_renderers + remaining);
+        }
+    };
+}
+
+#endif
@@ -36,6 +36,8 @@ struct DirectionalLight
 	float Bias=0.001f;
 	float SlopeBias=0.025f;
 	float Softness = 0.025;
+	// PCSS light size is relative to this near plane
+	float ShadowNear = 0.1f;
 };
 
 struct AmbientLight
@@ -47,6 +49,9 @@ struct AmbientLight
 	int aoSamples;
 	int aoSteps;
 	int aoBlurAmount;
+	// Temporal accumulation
+	bool aoTemporal;
+	float aoHistoryWeight;
 	// SSAO
 	unsigned int AoMapId;
 };
@@ -65,11 +70,29 @@ struct Spotlight
 	float OuterRadius;
 };
 
+// Image based lighting, see EnvironmentLighting.h
+struct EnvironmentLight
+{
+	bool Enabled = false;
+
+	// Irradiance SH, already convolved and divided by pi
+	glm::vec3 IrradianceSH[9];
+
+	// Specular, one roughness per mip
+	unsigned int PrefilteredMapId = 0;
+	float MaxLod = 0;
+
+	float Intensity = 1.0f;
+};
+
 struct SceneLights
 {
 	// ambientLight
 	AmbientLight Ambient;
 
+	// environment (skybox)
+	EnvironmentLight Environment;
+
 	// directionalLight
 	DirectionalLight Directional;
 };
@@ -77,6 +100,8 @@ struct SceneLights
 struct DrawParams
 {
 	bool doShadows;
+	// glClipControl(GL_ZERO_TO_ONE) is active, see ReverseZ.h
+	bool depthZeroToOne;
 };
 
 struct SceneParams
@@ -9,11 +9,16 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <chrono>
+#include <string_view>
+
+#include "ProgramBinaryCache.h"
+#include "ShaderAssembler.h"
 
 
 namespace VertexSource_Geometry
 {
-    const std::string EXP_VERTEX =
+    constexpr std::string_view EXP_VERTEX =
         R"(
     #version 330 core
     layout(location = 0) in vec3 position;
@@ -34,43 +39,30 @@ namespace VertexSource_Geometry
     }
     )";
 
-    const std::string DEFS_SHADOWS =
+    constexpr std::string_view DEFS_SHADOWS =
         R"(
     out vec4 posLightSpace;
     uniform mat4 LightSpaceMatrix;
 )";
 
-    const std::string CALC_SHADOWS =
+    constexpr std::string_view CALC_SHADOWS =
         R"(
     posLightSpace = LightSpaceMatrix * model * vec4(position.x, position.y, position.z, 1.0);
 )";
 
-    static std::map<std::string, std::string> Expansions = {
+    constexpr ShaderAssembler::Module ModuleList[] = {
 
         { "DEFS_SHADOWS",  VertexSource_Geometry::DEFS_SHADOWS     },
         { "CALC_SHADOWS",  VertexSource_Geometry::CALC_SHADOWS     },
     };
-
-    std::string Expand(std::string source, std::vector<std::string> expStrings)
-    {
-        std::string result = source;
-
-        for (int i = 0; i < expStrings.size(); i++)
-        {
-            std::string token = "//[" + expStrings[i] + "]";
-            size_t start_pos = result.find(token);
-            std::string expansion = VertexSource_Geometry::Expansions[expStrings[i]];
-            result.replace(start_pos, token.length(), expansion);
-        }
-
-        return result;
-    }
+    constexpr ShaderAssembler::ModuleTable Modules("VertexSource_Geometry", ModuleList);
+    static_assert(ShaderAssembler::SlotsResolved(EXP_VERTEX, Modules), "VertexSource_Geometry::EXP_VERTEX has a slot with no module");
 }
 
 namespace FragmentSource_Geometry
 {
     
-    const std::string DEFS_MATERIAL =
+    constexpr std::string_view DEFS_MATERIAL =
         R"(
     struct Material {
         vec4 Diffuse;
@@ -80,13 +72,13 @@ namespace FragmentSource_Geometry
 
     uniform Material material;
 )";
-    const std::string DEFS_SSAO =
+    constexpr std::string_view DEFS_SSAO =
         R"(
     uniform sampler2D aoMap;
     uniform float aoStrength;
 )";
 
-    const std::string DEFS_SHADOWS =
+    constexpr std::string_view DEFS_SHADOWS =
         R"(
 
     #define BLOCKER_SEARCH_SAMPLES 16
@@ -97,6 +89,8 @@ namespace FragmentSource_Geometry
     uniform float bias;
     uniform float slopeBias;
     uniform float softness;  
+    uniform float shadowNear;
+    uniform bool depthZeroToOne;
 
     vec2 poissonDisk[16] = vec2[](
      vec2( -0.94201624, -0.39906216 ),
@@ -122,9 +116,19 @@ namespace FragmentSource_Geometry
         return poissonDisk[i];
     }
 
+    // Slope scaled against the directional light when the lights are there, constant otherwise
+    float ReceiverBias()
+    {
+    #ifdef HAS_DEFS_LIGHTS
+        return max(bias, slopeBias*(1-abs(dot(worldNormal, lights.Directional.Direction))));
+    #else
+        return bias;
+    #endif
+    }
+
     float SearchWidth(float uvLightSize, float receiverDistance)
     {
-	    return uvLightSize * (receiverDistance - NEAR) / receiverDistance;
+	    return uvLightSize * (receiverDistance - shadowNear) / receiverDistance;
     }
 
     float FindBlockerDistance_DirectionalLight(vec3 shadowCoords, sampler2D shadowMap, float uvLightSize)
@@ -135,7 +139,7 @@ namespace FragmentSource_Geometry
 	    for (int i = 0; i < BLOCKER_SEARCH_SAMPLES; i++)
 	    {
 		    float z = texture(shadowMap, shadowCoords.xy + RandomDirection(i) * searchWidth).r;
-		    if (z + max(bias, slopeBias*(1-abs(dot(worldNormal, lights.Directional.Direction)))) < shadowCoords.z )
+		    if (z + ReceiverBias() < shadowCoords.z )
 		    {
 			    blockers++;
 			    avgBlockerDistance += z;
@@ -156,7 +160,7 @@ namespace FragmentSource_Geometry
 	    {
 		    float closestDepth=texture(shadowMap, shadowCoords.xy + RandomDirection(i)*uvRadius).r;
         
-            sum+= (closestDepth + max(bias, slopeBias*(1-abs(dot(worldNormal, lights.Directional.Direction))))) < shadowCoords.z 
+            sum+= (closestDepth + ReceiverBias()) < shadowCoords.z 
                     ? 0.0 : 1.0;
 	    }
 	    return sum / PCF_SAMPLES;
@@ -173,7 +177,7 @@ namespace FragmentSource_Geometry
 	    float penumbraWidth = (shadowCoords.z - blockerDistance) / blockerDistance;
 
 	    // percentage-close filtering
-	    float uvRadius = penumbraWidth * uvLightSize * NEAR / shadowCoords.z;
+	    float uvRadius = penumbraWidth * uvLightSize * shadowNear / shadowCoords.z;
 	    return PCF_DirectionalLight(shadowCoords, shadowMap, uvRadius);
     }
 
@@ -181,7 +185,10 @@ namespace FragmentSource_Geometry
     {
         vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     
-        projCoords=projCoords*0.5 + vec3(0.5, 0.5, 0.5);
+        // with glClipControl(GL_ZERO_TO_ONE) the depth is already in [0, 1]
+        projCoords.xy=projCoords.xy*0.5 + vec2(0.5, 0.5);
+        if(!depthZeroToOne)
+            projCoords.z=projCoords.z*0.5 + 0.5;
 
         return PCSS_DirectionalLight(projCoords, shadowMap, softness);
         
@@ -189,7 +196,7 @@ namespace FragmentSource_Geometry
     
 )";
 
-    const std::string DEFS_LIGHTS =
+    constexpr std::string_view DEFS_LIGHTS =
         R"(
     struct DirectionalLight
     {
@@ -235,7 +242,7 @@ namespace FragmentSource_Geometry
 
 )";
 
-    const std::string CALC_LIT_MAT =
+    constexpr std::string_view CALC_LIT_MAT =
         R"(
         vec4 baseColor=vec4(material.Diffuse.rgb, 1.0);
         vec4 baseSpecular=vec4(material.Specular.rgb, 1.0);
@@ -249,46 +256,83 @@ namespace FragmentSource_Geometry
 	    directional=computeLight_Directional(lights.Directional, commonData);
 )";
 
-    const std::string CALC_UNLIT_MAT =
+    // Image based lighting, see EnvironmentLighting.h. Replaces the flat ambient term when envEnabled,
+    // needs the lit material's terms: without CALC_LIT_MAT there is nothing to replace.
+    constexpr std::string_view DEFS_IBL =
+        R"(
+    uniform vec3 envIrradianceSH[9];
+    uniform samplerCube envPrefiltered;
+    uniform float envMaxLod;
+    uniform float envIntensity;
+    uniform bool envEnabled;
+
+    vec3 IrradianceSH(vec3 n)
+    {
+        vec3 result = envIrradianceSH[0] * 0.282095
+            + envIrradianceSH[1] * 0.488603 * n.y
+            + envIrradianceSH[2] * 0.488603 * n.z
+            + envIrradianceSH[3] * 0.488603 * n.x
+            + envIrradianceSH[4] * 1.092548 * n.x * n.y
+            + envIrradianceSH[5] * 1.092548 * n.y * n.z
+            + envIrradianceSH[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+            + envIrradianceSH[7] * 1.092548 * n.x * n.z
+            + envIrradianceSH[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+        return max(result, vec3(0.0));
+    }
+)";
+
+    constexpr std::string_view CALC_IBL =
+        R"(
+    #ifdef HAS_CALC_LIT_MAT
+        if (envEnabled)
+        {
+            // Blinn-Phong exponent to GGX alpha, the mips are laid out by perceptual roughness (sqrt(alpha))
+            float envRoughness = sqrt(sqrt(2.0 / (material.Shininess + 2.0)));
+            vec3 envReflected = textureLod(envPrefiltered, reflect(-commonData.eyeDir, commonData.worldNormal), envRoughness * envMaxLod).rgb;
+            ambient = vec4((IrradianceSH(commonData.worldNormal) * baseColor.rgb + envReflected * baseSpecular.rgb) * envIntensity, 1.0);
+        }
+    #endif
+)";
+
+    constexpr std::string_view CALC_UNLIT_MAT =
         R"(
         vec4 baseColor=vec4(material.Diffuse.rgb, 1.0);
         finalColor=baseColor;
 )";
 
-    const std::string DEFS_NORMALS =
+    constexpr std::string_view DEFS_NORMALS =
         R"(
         uniform mat4 view;
 )";
 
-    const std::string CALC_NORMALS =
+    constexpr std::string_view CALC_NORMALS =
         R"(
         vec4 baseColor=vec4(normalize((view * vec4(worldNormal, 0.0)).xyz), 1.0);
         finalColor=baseColor;
 )";
 
-    const std::string CALC_SHADOWS =
+    constexpr std::string_view CALC_SHADOWS =
         R"(
         directional*= ShadowCalculation(posLightSpace);
 )";
 
-    const std::string CALC_SSAO =
+    constexpr std::string_view CALC_SSAO =
         R"(
         vec2 aoMapSize=textureSize(aoMap, 0);
         float aoFac = (1.0-texture(aoMap, gl_FragCoord.xy/aoMapSize).r) * aoStrength;
         ambient*= 1.0-aoFac;
 )";
 
-    const std::string EXP_FRAGMENT =
+    constexpr std::string_view EXP_FRAGMENT =
     R"(
     #version 330 core
     in vec3 fragPosWorld;
     in vec3 worldNormal;
     out vec4 FragColor;
-
-    #define NEAR 0.1
     
     //[DEFS_MATERIAL] 
     //[DEFS_LIGHTS]
+    //[DEFS_IBL]
     //[DEFS_SHADOWS]
     //[DEFS_NORMALS]
     //[DEFS_SSAO]
@@ -300,6 +344,7 @@ namespace FragmentSource_Geometry
 
         //[CALC_LIT_MAT]
         //[CALC_UNLIT_MAT]	
+        //[CALC_IBL]
         //[CALC_SHADOWS]
         //[CALC_NORMALS]
         //[CALC_SSAO]
@@ -307,7 +352,7 @@ namespace FragmentSource_Geometry
     }
     )";
 
-    static std::map<std::string, std::string> Expansions = {
+    constexpr ShaderAssembler::Module ModuleList[] = {
 
         { "DEFS_MATERIAL",  FragmentSource_Geometry::DEFS_MATERIAL     },
         { "DEFS_LIGHTS",    FragmentSource_Geometry::DEFS_LIGHTS       },
@@ -318,28 +363,17 @@ namespace FragmentSource_Geometry
         { "CALC_SHADOWS",   FragmentSource_Geometry::CALC_SHADOWS      },
         { "CALC_SSAO",      FragmentSource_Geometry::CALC_SSAO         },
         { "DEFS_NORMALS",   FragmentSource_Geometry::DEFS_NORMALS      },
-        { "CALC_NORMALS",   FragmentSource_Geometry::CALC_NORMALS      }
+        { "CALC_NORMALS",   FragmentSource_Geometry::CALC_NORMALS      },
+        { "DEFS_IBL",       FragmentSource_Geometry::DEFS_IBL          },
+        { "CALC_IBL",       FragmentSource_Geometry::CALC_IBL          }
     };
-
-    std::string Expand(std::string source, std::vector<std::string> expStrings)
-    {
-        std::string result = source;
-
-        for (int i = 0; i < expStrings.size(); i++)
-        {
-            std::string token = "//[" + expStrings[i] + "]";
-            size_t start_pos = result.find(token);
-            std::string expansion = FragmentSource_Geometry::Expansions[expStrings[i]];
-            result.replace(start_pos, token.length(), expansion);
-        }
-
-        return result;
-    }
+    constexpr ShaderAssembler::ModuleTable Modules("FragmentSource_Geometry", ModuleList);
+    static_assert(ShaderAssembler::SlotsResolved(EXP_FRAGMENT, Modules), "FragmentSource_Geometry::EXP_FRAGMENT has a slot with no module");
 }
 
 namespace VertexSource_PostProcessing
 {
-    const std::string EXP_VERTEX =
+    constexpr std::string_view EXP_VERTEX =
         R"(
     #version 330 core
     layout(location = 0) in vec3 position;
@@ -350,43 +384,52 @@ namespace VertexSource_PostProcessing
     }
     )";
 
-    static std::map<std::string, std::string> Expansions = {
-
-
-    };
-
-    std::string Expand(std::string source, std::vector<std::string> expStrings)
-    {
-        std::string result = source;
-
-        for (int i = 0; i < expStrings.size(); i++)
-        {
-            std::string token = "//[" + expStrings[i] + "]";
-            size_t start_pos = result.find(token);
-            std::string expansion = VertexSource_PostProcessing::Expansions[expStrings[i]];
-            result.replace(start_pos, token.length(), expansion);
-        }
-
-        return result;
-    }
+    constexpr ShaderAssembler::ModuleTable Modules("VertexSource_PostProcessing");
+    static_assert(ShaderAssembler::SlotsResolved(EXP_VERTEX, Modules), "VertexSource_PostProcessing::EXP_VERTEX has a slot with no module");
 }
 namespace FragmentSource_PostProcessing
 {
 
-    const std::string DEFS_BLUR =
+    // Shared by the passes that read a single input texture
+    constexpr std::string_view DEFS_INPUT_TEXTURE =
         R"(
     uniform sampler2D u_texture;
+)";
+
+    constexpr std::string_view DEFS_BLUR =
+        R"(
+    #include "DEFS_INPUT_TEXTURE"
     uniform int u_size;
 )";
-    const std::string DEFS_GAUSSIAN_BLUR =
+    constexpr std::string_view DEFS_GAUSSIAN_BLUR =
         R"(
-    uniform sampler2D u_texture;
+    #include "DEFS_INPUT_TEXTURE"
     uniform usampler2D u_weights_texture;
     uniform int u_radius;
     uniform bool u_hor;
 )";
 
-    const std::string DEFS_AO =
+    constexpr std::string_view DEFS_DISPLAY =
+        R"(
+    #include "DEFS_INPUT_TEXTURE"
+)";
+
+    constexpr std::string_view DEFS_TEMPORAL =
+        R"(
+    #include "DEFS_INPUT_TEXTURE"
+    uniform sampler2D u_historyTexture;
+    uniform sampler2D u_viewPosTexture;
+    uniform mat4 u_invView;
+    uniform mat4 u_prevViewProj;
+    uniform float u_historyWeight;
+    uniform float u_far;
+    uniform bool u_historyValid;
+
+    // history is rejected when its eye depth differs more than this (relative) from the reprojected one
+    #define DEPTH_REJECTION 0.05
+)";
+
+    constexpr std::string_view DEFS_AO =
         R"(
     uniform sampler2D u_depthTexture;
     uniform sampler2D u_viewPosTexture;
@@ -398,7 +441,7 @@ namespace FragmentSource_PostProcessing
     uniform int u_numSteps;
     #define NOISE_SIZE 4
 
-    uniform float u_near;
+    uniform vec2  u_depthParams;
     uniform float u_far;
     uniform mat4  u_proj;
 
@@ -416,13 +459,11 @@ namespace FragmentSource_PostProcessing
         vec2( 0.0,-1.0)
         ); 
 
-    float LinearDepth(float depthValue, float near, float far)
+    // Eye depth from the depth buffer: 1 / zEye = depth * u_depthParams.x + u_depthParams.y,
+    // which covers the standard, reverse-Z and infinite far projections (see ReverseZ::LinearizeParams)
+    float LinearDepth(float depthValue)
 {
-    //http://www.songho.ca/opengl/gl_projectionmatrix.html
-
-    float res = (2.0 * near) / ( far + near - depthValue * ( far - near));
-   
-    return res;
+    return 1.0 / (depthValue * u_depthParams.x + u_depthParams.y);
 }
 
 vec2 TexCoords(vec3 viewCoords, mat4 projMatrix)
@@ -585,7 +626,7 @@ vec3 EyeNormal_dz(vec2 uvCoords, vec3 eyePos)
 
 )";
 
-    const std::string CALC_GAUSSIAN_BLUR =
+    constexpr std::string_view CALC_GAUSSIAN_BLUR =
         R"(
     
         vec2 texSize=textureSize(u_texture, 0);
@@ -615,7 +656,7 @@ vec3 EyeNormal_dz(vec2 uvCoords, vec3 eyePos)
         FragColor=color;
 )";
 
-    const std::string CALC_BLUR =
+    constexpr std::string_view CALC_BLUR =
         R"(
     
         vec2 texSize=textureSize(u_texture, 0);
@@ -632,7 +673,40 @@ vec3 EyeNormal_dz(vec2 uvCoords, vec3 eyePos)
         FragColor=color;
 )";
 
-    const std::string CALC_SSAO =
+    constexpr std::string_view CALC_DISPLAY_RED =
+        R"(
+    
+        vec2 texSize=textureSize(u_texture, 0);
+        FragColor=vec4(texture(u_texture, gl_FragCoord.xy/texSize).rrr, 1.0);
+)";
+
+    constexpr std::string_view CALC_TEMPORAL =
+        R"(
+
+        vec2 texSize=textureSize(u_texture, 0);
+        float value = texture(u_texture, gl_FragCoord.xy/texSize).r;
+        vec3 eyePos = texelFetch(u_viewPosTexture, ivec2(gl_FragCoord.xy), 0).rgb;
+
+        if(u_historyValid && eyePos.z < u_far - 0.001)
+        {
+            // eye positions are stored with a positive z
+            vec4 worldPos = u_invView * vec4(eyePos.xy, -eyePos.z, 1.0);
+            vec4 prevClip = u_prevViewProj * worldPos;
+            vec2 prevUV = (prevClip.xy / prevClip.w) * 0.5 + 0.5;
+
+            if(all(greaterThanEqual(prevUV, vec2(0.0))) && all(lessThanEqual(prevUV, vec2(1.0))))
+            {
+                vec2 history = texture(u_historyTexture, prevUV).rg;
+                if(abs(history.g - prevClip.w) < DEPTH_REJECTION * prevClip.w)
+                    value = mix(value, history.r, u_historyWeight);
+            }
+        }
+
+        // r => accumulated value, g => eye depth used to validate the history next frame
+        FragColor=vec4(value, eyePos.z, 0.0, 1.0);
+)";
+
+    constexpr std::string_view CALC_SSAO =
         R"(
     
     //TODO: please agree on what you consider view space, if you need to debug invert the z when showing the result
@@ -673,7 +747,7 @@ vec3 EyeNormal_dz(vec2 uvCoords, vec3 eyePos)
     FragColor = vec4(1.0, 1.0, 1.0, 1.0) * (1-ao); 
 )";
 
-    const std::string CALC_HBAO =
+    constexpr std::string_view CALC_HBAO =
         R"(
     
     //TODO: please agree on what you consider view space, if you need to debug invert the z when showing the result
@@ -712,14 +786,14 @@ vec3 EyeNormal_dz(vec2 uvCoords, vec3 eyePos)
 
     FragColor = vec4(1.0, 1.0, 1.0, 1.0)*(1.0-ao); 
 )";
-    const std::string CALC_POSITIONS =
+    constexpr std::string_view CALC_POSITIONS =
         R"(
 
     ivec2 texSize=textureSize(u_depthTexture, 0);
 
     float depthValue = texture(u_depthTexture, gl_FragCoord.xy/vec2(texSize) ).r;
-    float zEye =  LinearDepth( depthValue, u_near, u_far );
-    zEye = zEye*(u_far - u_near) + u_near;
+    // the background is at u_far (infinity with an infinite far plane)
+    float zEye = min(LinearDepth(depthValue), u_far);
     vec3 eyePos = EyeCoords(((gl_FragCoord.x/float(texSize.x)) * 2.0)  - 1.0, ((gl_FragCoord.y/float(texSize.y)) * 2.0)  - 1.0, zEye);
 
     
@@ -727,7 +801,13 @@ vec3 EyeNormal_dz(vec2 uvCoords, vec3 eyePos)
 
 )";
 
-    const std::string EXP_FRAGMENT =
+    // Stands in for programs still being compiled: no occlusion, nothing to blur
+    constexpr std::string_view CALC_PLACEHOLDER =
+        R"(
+    FragColor = vec4(1.0, 1.0, 1.0, 1.0);
+)";
+
+    constexpr std::string_view EXP_FRAGMENT =
         R"(
     #version 330 core
     out vec4 FragColor;
@@ -735,6 +815,8 @@ vec3 EyeNormal_dz(vec2 uvCoords, vec3 eyePos)
     //[DEFS_SSAO]
     //[DEFS_BLUR]
     //[DEFS_GAUSSIAN_BLUR]
+    //[DEFS_DISPLAY]
+    //[DEFS_TEMPORAL]
     void main()
     {
         //[CALC_POSITIONS]
@@ -742,12 +824,16 @@ vec3 EyeNormal_dz(vec2 uvCoords, vec3 eyePos)
         //[CALC_HBAO]
         //[CALC_BLUR]
         //[CALC_GAUSSIAN_BLUR]
+        //[CALC_DISPLAY_RED]
+        //[CALC_TEMPORAL]
+        //[CALC_PLACEHOLDER]
     }
     )";
 
-    static std::map<std::string, std::string> Expansions = {
+    constexpr ShaderAssembler::Module ModuleList[] = {
 
        { "DEFS_SSAO",           FragmentSource_PostProcessing::DEFS_AO            },
+       { "DEFS_INPUT_TEXTURE",  FragmentSource_PostProcessing::DEFS_INPUT_TEXTURE   },
        { "DEFS_BLUR",           FragmentSource_PostProcessing::DEFS_BLUR            },
        { "DEFS_GAUSSIAN_BLUR",  FragmentSource_PostProcessing::DEFS_GAUSSIAN_BLUR   },
        { "CALC_POSITIONS",      FragmentSource_PostProcessing::CALC_POSITIONS       },
@@ -755,22 +841,218 @@ vec3 EyeNormal_dz(vec2 uvCoords, vec3 eyePos)
        { "CALC_HBAO",           FragmentSource_PostProcessing::CALC_HBAO            },
        { "CALC_BLUR",           FragmentSource_PostProcessing::CALC_BLUR            },
        { "CALC_GAUSSIAN_BLUR",  FragmentSource_PostProcessing::CALC_GAUSSIAN_BLUR   },
-
+       { "DEFS_DISPLAY",        FragmentSource_PostProcessing::DEFS_DISPLAY         },
+       { "CALC_DISPLAY_RED",    FragmentSource_PostProcessing::CALC_DISPLAY_RED     },
+       { "DEFS_TEMPORAL",       FragmentSource_PostProcessing::DEFS_TEMPORAL        },
+       { "CALC_TEMPORAL",       FragmentSource_PostProcessing::CALC_TEMPORAL        },
+       { "CALC_PLACEHOLDER",    FragmentSource_PostProcessing::CALC_PLACEHOLDER     },
     };
+    constexpr ShaderAssembler::ModuleTable Modules("FragmentSource_PostProcessing", ModuleList);
+    static_assert(ShaderAssembler::SlotsResolved(EXP_FRAGMENT, Modules), "FragmentSource_PostProcessing::EXP_FRAGMENT has a slot with no module");
+}
+
+namespace ComputeSource_PostProcessing
+{
+    constexpr std::string_view DEFS_HBAO =
+        R"(
+    #define TILE_SIZE 16
+    #define APRON 16
+    #define SHARED_SIZE (TILE_SIZE + 2 * APRON)
+    #define MAX_DIRECTIONS 64
+    #define NOISE_SIZE 4
+    #define ANGLE_BIAS 0.1
+
+    layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+    layout(r16f, binding = 0) uniform writeonly image2D u_aoImage;
+
+    uniform sampler2D u_viewPosTexture;
+    uniform sampler2D u_rotVecs;
+    uniform vec2  u_directions[MAX_DIRECTIONS];
+    uniform float u_radius;
+    uniform int   u_numSamples;
+    uniform int   u_numSteps;
+    uniform float u_far;
+    uniform mat4  u_proj;
+
+    // eye depth of the work group tile plus an APRON pixels border
+    shared float s_depth[SHARED_SIZE * SHARED_SIZE];
+
+    float TileDepth(ivec2 tileCoords)
+    {
+        return s_depth[tileCoords.y * SHARED_SIZE + tileCoords.x];
+    }
+
+    //http://www.songho.ca/opengl/gl_projectionmatrix.html
+    vec3 EyeCoords(ivec2 pixel, float zEye, vec2 texSize)
+    {
+        vec2 ndc = ((vec2(pixel) + 0.5) / texSize) * 2.0 - 1.0;
+        float xEye = (ndc.x * zEye - u_proj[0][2] * zEye) / u_proj[0][0];
+        float yEye = (ndc.y * zEye - u_proj[1][2] * zEye) / u_proj[1][1];
+        return vec3(xEye, yEye, zEye);
+    }
+
+    vec3 EyeCoordsFromTile(ivec2 pixel, ivec2 tileCoords, ivec2 center, vec2 texSize)
+    {
+        return EyeCoords(pixel + (tileCoords - center), TileDepth(tileCoords), texSize);
+    }
+)";
+
+    constexpr std::string_view CALC_HBAO =
+        R"(
+    ivec2 texSize = textureSize(u_viewPosTexture, 0);
+
+    // Load the depth tile + apron in shared memory ====================================================
+    ivec2 tileOrigin = ivec2(gl_WorkGroupID.xy) * TILE_SIZE - APRON;
+    for (int i = int(gl_LocalInvocationIndex); i < SHARED_SIZE * SHARED_SIZE; i += TILE_SIZE * TILE_SIZE)
+    {
+        ivec2 texel = clamp(tileOrigin + ivec2(i % SHARED_SIZE, i / SHARED_SIZE), ivec2(0), texSize - 1);
+        s_depth[i] = texelFetch(u_viewPosTexture, texel, 0).b;
+    }
+    memoryBarrierShared();
+    barrier();
+
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (pixel.x >= texSize.x || pixel.y >= texSize.y)
+        return;
 
-    std::string Expand(std::string source, std::vector<std::string> expStrings)
+    ivec2 center = ivec2(gl_LocalInvocationID.xy) + APRON;
+    float zEye = TileDepth(center);
+
+    // Projected radius in pixels, clamped to the apron so that every step stays in shared memory
+    // and at most one step per pixel of it: small radii take fewer steps instead of none
+    float radiusPx = u_radius * u_proj[0][0] * 0.5 * float(texSize.x) / zEye;
+    float reachPx = min(radiusPx, float(APRON));
+    int numSteps = clamp(u_numSteps, 1, max(1, int(floor(reachPx))));
+    float stepPx = reachPx / float(numSteps);
+
+    if (zEye > u_far - 0.001)
+    {
+        imageStore(u_aoImage, pixel, vec4(1.0));
+        return;
+    }
+
+    vec3 p = EyeCoords(pixel, zEye, vec2(texSize));
+
+    // Normal from the smallest depth differences (same as EyeNormal_dz) =================================
+    vec3 px = EyeCoordsFromTile(pixel, center + ivec2(1, 0), center, vec2(texSize)) - p;
+    vec3 mx = p - EyeCoordsFromTile(pixel, center - ivec2(1, 0), center, vec2(texSize));
+    vec3 py = EyeCoordsFromTile(pixel, center + ivec2(0, 1), center, vec2(texSize)) - p;
+    vec3 my = p - EyeCoordsFromTile(pixel, center - ivec2(0, 1), center, vec2(texSize));
+    vec3 normal = normalize(cross(abs(px.z) < abs(mx.z) ? px : mx, abs(py.z) < abs(my.z) ? py : my));
+    normal = normal.z > 0.0 ? -normal : normal; // facing the eye (eye space z grows away from it)
+
+    // Per pixel rotation + step jitter from the noise texture
+    vec3 noise = texelFetch(u_rotVecs, pixel % NOISE_SIZE, 0).rgb;
+    vec2 rotation = normalize(noise.xy + vec2(0.0001));
+    float jitter = abs(noise.x);
+
+    float radius2 = u_radius * u_radius;
+    float ao = 0.0;
+
+    //https://developer.download.nvidia.com/presentations/2008/SIGGRAPH/HBAO_SIG08b.pdf
+    //horizon and tangent elevations are kept as sines, so the integral (sin(h) - sin(t)) needs no atan
+    for (int k = 0; k < u_numSamples; k++)
     {
-        std::string result = source;
+        vec2 direction = vec2(
+            rotation.x * u_directions[k].x - rotation.y * u_directions[k].y,
+            rotation.y * u_directions[k].x + rotation.x * u_directions[k].y);
+
+        vec3 tangent = vec3(direction, 0.0) - normal * dot(vec3(direction, 0.0), normal);
+        float sinT = -tangent.z * inversesqrt(dot(tangent, tangent) + 0.000001) + ANGLE_BIAS;
+
+        float sinH = sinT;
+        float horizonDist2 = 0.0;
+        vec2 stepVec = direction * stepPx;
+
+        for (int i = 1; i <= numSteps; i++)
+        {
+            ivec2 tileCoords = clamp(center + ivec2(round(stepVec * (float(i) - 0.5 + jitter * 0.5))), ivec2(0), ivec2(SHARED_SIZE - 1));
+            vec3 D = EyeCoordsFromTile(pixel, tileCoords, center, vec2(texSize)) - p;
+
+            // Ignore samples outside radius
+            float l2 = dot(D, D);
+            if (l2 > radius2 || l2 < 0.000001)
+                continue;
+
+            float sinS = -D.z * inversesqrt(l2);
+            if (sinS > sinH)
+            {
+                sinH = sinS;
+                horizonDist2 = l2;
+            }
+        }
+
+        ao += (sinH - sinT) * max(0.0, 1.0 - horizonDist2 / radius2);
+    }
+    ao /= u_numSamples;
+
+    imageStore(u_aoImage, pixel, vec4(1.0 - ao));
+)";
+
+    constexpr std::string_view EXP_COMPUTE =
+        R"(
+    #version 430 core
+
+    //[DEFS_HBAO]
+    void main()
+    {
+        //[CALC_HBAO]
+    }
+    )";
+
+    constexpr ShaderAssembler::Module ModuleList[] = {
+
+       { "DEFS_HBAO",           ComputeSource_PostProcessing::DEFS_HBAO            },
+       { "CALC_HBAO",           ComputeSource_PostProcessing::CALC_HBAO            },
+    };
+    constexpr ShaderAssembler::ModuleTable Modules("ComputeSource_PostProcessing", ModuleList);
+    static_assert(ShaderAssembler::SlotsResolved(EXP_COMPUTE, Modules), "ComputeSource_PostProcessing::EXP_COMPUTE has a slot with no module");
+}
+
+// Parallel compile ================================================================================================================ //
+/*
+* GL_KHR_parallel_shader_compile lets the driver compile and link on its own threads. Programs are then
+* polled with GL_COMPLETION_STATUS_KHR, which never blocks, instead of GL_COMPILE_STATUS/GL_LINK_STATUS, which do.
+* Without the extension the status queries simply block, as they always did.
+*/
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace ParallelShaderCompile
+{
+    typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+    static bool Supported = false;
 
-        for (int i = 0; i < expStrings.size(); i++)
+    bool HasExtension(std::string name)
+    {
+        int count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (int i = 0; i < count; i++)
         {
-            std::string token = "//[" + expStrings[i] + "]";
-            size_t start_pos = result.find(token);
-            std::string expansion = FragmentSource_PostProcessing::Expansions[expStrings[i]];
-            result.replace(start_pos, token.length(), expansion);
+            const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (extension && name == extension)
+                return true;
         }
+        return false;
+    }
+
+    // getProcAddress is the same loader handed to glad (glfwGetProcAddress)
+    void Initialize(GLADloadproc getProcAddress)
+    {
+        PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads = nullptr;
 
-        return result;
+        if (HasExtension("GL_KHR_parallel_shader_compile"))
+            maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)getProcAddress("glMaxShaderCompilerThreadsKHR");
+        else if (HasExtension("GL_ARB_parallel_shader_compile"))
+            maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)getProcAddress("glMaxShaderCompilerThreadsARB");
+
+        Supported = maxShaderCompilerThreads != nullptr;
+        if (Supported)
+            maxShaderCompilerThreads(0xFFFFFFFF); // let the driver pick the thread count
+
+        std::cout << "SHADER::PARALLEL_COMPILE " << (Supported ? "enabled" : "not available") << std::endl;
     }
 }
 
@@ -782,40 +1064,167 @@ public:
     ShaderCode()
     {
         ID = 0;
+        _stageCount = 0;
+        _pending = false;
     }
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    ShaderCode(const std::string vShaderCode, std::string fShaderCode)
-    {
-               
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-
-        const char* vsc = vShaderCode.data();
-        glShaderSource(vertex, 1, &vsc, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment ShaderCode
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-
-        const char* fsc = fShaderCode.data();
-        glShaderSource(fragment, 1, &fsc, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
+    ShaderCode(const std::string vShaderCode, std::string fShaderCode) : ShaderCode()
+    {
+        Begin(vShaderCode, fShaderCode);
+        Finish();
+    }
+
+    // compute shader program
+    // ------------------------------------------------------------------------
+    ShaderCode(const std::string cShaderCode) : ShaderCode()
+    {
+        Begin(cShaderCode);
+        Finish();
+    }
+
+    // Starts compiling and linking without querying any status, see Poll()/Finish()
+    // ------------------------------------------------------------------------
+    static ShaderCode Submit(const std::string vShaderCode, std::string fShaderCode)
+    {
+        ShaderCode shaderCode;
+        shaderCode.Begin(vShaderCode, fShaderCode);
+        return shaderCode;
+    }
+
+    static ShaderCode Submit(const std::string cShaderCode)
+    {
+        ShaderCode shaderCode;
+        shaderCode.Begin(cShaderCode);
+        return shaderCode;
+    }
+
+    // True once the program can be used. Never blocks when parallel compile is supported.
+    // ------------------------------------------------------------------------
+    bool Poll()
+    {
+        if (!_pending)
+            return true;
+
+        if (ParallelShaderCompile::Supported)
+        {
+            int done = 0;
+            glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done)
+                return false;
+        }
+
+        Finish();
+        return true;
+    }
+
+    // Waits for the program, checks the logs and releases the shader objects
+    // ------------------------------------------------------------------------
+    void Finish()
+    {
+        if (!_pending)
+            return;
+
+        for (int i = 0; i < _stageCount; i++)
+            checkCompileErrors(_stages[i], StageName(_stageTypes[i]));
         checkCompileErrors(ID, "PROGRAM");
+
+        ProgramBinaryCache::Store(ID, _cacheKey);
+
         // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        for (int i = 0; i < _stageCount; i++)
+        {
+            glDetachShader(ID, _stages[i]);
+            glDeleteShader(_stages[i]);
+        }
+        _stageCount = 0;
+        _pending = false;
+    }
+
+    bool Linked()
+    {
+        int success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        return success;
     }
-  
+
+    // Deletes the program, also valid while it is still compiling
+    void Release()
+    {
+        for (int i = 0; i < _stageCount; i++)
+            glDeleteShader(_stages[i]);
+        if (ID)
+            glDeleteProgram(ID);
+
+        ID = 0;
+        _stageCount = 0;
+        _pending = false;
+    }
+
 private:
+    unsigned int _stages[2];
+    unsigned int _stageTypes[2];
+    int _stageCount;
+    bool _pending;
+    std::string _cacheKey;
+
+    void Begin(const std::string vShaderCode, std::string fShaderCode)
+    {
+        // 1. try the binary cache first
+        ID = glCreateProgram();
+        _cacheKey = ProgramBinaryCache::Key({ vShaderCode, fShaderCode });
+        if (ProgramBinaryCache::Load(ID, _cacheKey))
+            return;
+
+        // 2. compile shaders, the status is only checked in Finish()
+        AddStage(GL_VERTEX_SHADER, vShaderCode);
+        AddStage(GL_FRAGMENT_SHADER, fShaderCode);
+        Link();
+    }
+
+    void Begin(const std::string cShaderCode)
+    {
+        ID = glCreateProgram();
+        _cacheKey = ProgramBinaryCache::Key({ cShaderCode });
+        if (ProgramBinaryCache::Load(ID, _cacheKey))
+            return;
+
+        AddStage(GL_COMPUTE_SHADER, cShaderCode);
+        Link();
+    }
+
+    void AddStage(unsigned int type, const std::string& code)
+    {
+        unsigned int shader = glCreateShader(type);
+
+        const char* sc = code.data();
+        glShaderSource(shader, 1, &sc, NULL);
+        glCompileShader(shader);
+        glAttachShader(ID, shader);
+
+        _stages[_stageCount] = shader;
+        _stageTypes[_stageCount] = type;
+        _stageCount++;
+    }
+
+    void Link()
+    {
+        ProgramBinaryCache::PrepareProgram(ID);
+        glLinkProgram(ID);
+        _pending = true;
+    }
+
+    static std::string StageName(unsigned int type)
+    {
+        switch (type)
+        {
+        case GL_VERTEX_SHADER:   return "VERTEX";
+        case GL_FRAGMENT_SHADER: return "FRAGMENT";
+        case GL_COMPUTE_SHADER:  return "COMPUTE";
+        default:                 return "UNKNOWN";
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(unsigned int shader, std::string type)
@@ -847,6 +1256,8 @@ class RenderableBasic
 {
 public:
     virtual std::vector<glm::vec3> GetPositions() { return std::vector<glm::vec3>(1); };
+    virtual const glm::vec3* PositionData() { return nullptr; };  // GetPositions() without the copy
+    virtual int PositionCount() { return 0; };
     virtual std::vector<glm::vec3> GetNormals() { return std::vector<glm::vec3>(0); };
     virtual std::vector<int> GetIndices() { return std::vector<int>(0); };
 };
@@ -857,22 +1268,151 @@ private:
     ShaderCode _shaderCode;
     std::string _vertexCode;
     std::string _fragmentCode;
+    std::string _computeCode;
+
+    // Programs are submitted on first use (or by Submit()), not when the ShaderBase is created.
+    // Until the driver reports them ready the placeholder, if any, is used in their place.
+    bool _submitted;
+    bool _compiled;
+    double _compileTimeMs;
+    std::string _name;
+    ShaderBase* _placeholder;
+    std::chrono::high_resolution_clock::time_point _submitTime;
+
+    // Hot reload: the new program compiles next to the current one, which stays in use until Poll() swaps them
+    ShaderCode _reloadCode;
+    bool _reloading;
+    std::chrono::high_resolution_clock::time_point _reloadSubmitTime;
+
+    void OnCompiled()
+    {
+        _compiled = true;
+        _compileTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _submitTime).count();
 
+        if (!_name.empty())
+            std::cout << "SHADER::COMPILED " << _name << " in " << _compileTimeMs << " ms" << std::endl;
+    }
+
+    // Program to use right now: only Poll() and Compile() switch away from the placeholder,
+    // so the id stays the same between a glUseProgram and the following uniform queries.
+    unsigned int ActiveId()
+    {
+        Submit();
+        if (_compiled)
+            return _shaderCode.ID;
+        if (_placeholder)
+            return _placeholder->ShaderCodeId();
+
+        Compile();
+        return _shaderCode.ID;
+    }
     
 public:
-    ShaderBase()
+    ShaderBase() : _submitted(false), _compiled(false), _compileTimeMs(0), _placeholder(nullptr), _reloading(false)
     {
 
     }
     ShaderBase( std::string vertexSource, std::string fragmentSource) :
-        _vertexCode(vertexSource), _fragmentCode(fragmentSource), _shaderCode(vertexSource, fragmentSource)
+        _vertexCode(vertexSource), _fragmentCode(fragmentSource), _submitted(false), _compiled(false), _compileTimeMs(0), _placeholder(nullptr), _reloading(false)
+    {
+    }
+    ShaderBase(std::string computeSource) :
+        _computeCode(computeSource), _submitted(false), _compiled(false), _compileTimeMs(0), _placeholder(nullptr), _reloading(false)
+    {
+    }
+
+    void SetCurrent() { glUseProgram(ActiveId()); }
+    int UniformLocation(std::string name) { return glGetUniformLocation(ActiveId(), name.c_str()); };
+
+    unsigned int ShaderCodeId() { return ActiveId(); };
+
+    // Starts the compilation without waiting for it
+    void Submit()
+    {
+        if (_submitted)
+            return;
+
+        _submitted = true;
+        _submitTime = std::chrono::high_resolution_clock::now();
+
+        if (!_computeCode.empty())
+            _shaderCode = ShaderCode::Submit(_computeCode);
+        else if (!_vertexCode.empty())
+            _shaderCode = ShaderCode::Submit(_vertexCode, _fragmentCode);
+        else
+            _compiled = true;
+    }
+
+    // True once the program is ready. Call at frame boundaries: this is where the placeholder, or the program
+    // being replaced by a reload, gets swapped out.
+    bool Poll()
+    {
+        Submit();
+        if (!_compiled && _shaderCode.Poll())
+            OnCompiled();
+
+        if (_reloading && _compiled && _reloadCode.Poll())
+        {
+            _reloading = false;
+            if (_reloadCode.Linked())
+            {
+                _shaderCode.Release();
+                _shaderCode = _reloadCode;
+                _submitTime = _reloadSubmitTime;
+                OnCompiled();
+            }
+            else
+            {
+                // keep drawing with the last program that worked
+                std::cout << "SHADER::RELOAD_FAILED " << _name << std::endl;
+                _reloadCode.Release();
+            }
+        }
+
+        return _compiled;
+    }
+
+    // Replaces the sources. Programs already in use keep drawing until the new one is ready.
+    void Reload(std::string vertexSource, std::string fragmentSource, std::string computeSource)
     {
+        _vertexCode = vertexSource;
+        _fragmentCode = fragmentSource;
+        _computeCode = computeSource;
+
+        if (!_submitted)
+            return;
+
+        if (_reloading)
+            _reloadCode.Release();
+
+        _reloading = true;
+        _reloadSubmitTime = std::chrono::high_resolution_clock::now();
+        _reloadCode = !_computeCode.empty() ? ShaderCode::Submit(_computeCode) : ShaderCode::Submit(_vertexCode, _fragmentCode);
     }
 
-    void SetCurrent() { glUseProgram(_shaderCode.ID); }
-    int UniformLocation(std::string name) { return glGetUniformLocation(_shaderCode.ID, name.c_str()); };
+    // Assembles the sources again (module overrides may have changed) and reloads if they differ, see ShaderHotReload.h
+    virtual bool Refresh() { return false; };
+
+    // Blocks until the program is ready, e.g. to warm up a permutation before it is needed
+    void Compile()
+    {
+        Submit();
+        if (_compiled)
+            return;
+
+        _shaderCode.Finish();
+        OnCompiled();
+    }
 
-    unsigned int ShaderCodeId() { return _shaderCode.ID; };
+    void SetPlaceholder(ShaderBase* placeholder) { _placeholder = placeholder != this ? placeholder : nullptr; };
+    bool IsCompiled() { return _compiled; };
+    // Submission to completion, with parallel compile this includes the frames spent waiting for Poll()
+    double CompileTimeMs() { return _compileTimeMs; };
+    void SetName(std::string name) { _name = name; };
+    std::string Name() { return _name; };
+    std::string VertexCode() { return _vertexCode; };
+    std::string FragmentCode() { return _fragmentCode; };
+    std::string ComputeCode() { return _computeCode; };
 
     virtual  int PositionLayout() { return 0; };
     virtual  int NormalLayout() { return 1; };
@@ -898,43 +1438,111 @@ public:
     virtual std::string UniformName_Bias() { return "bias"; };
     virtual std::string UniformName_SlopeBias() { return "slopeBias"; };
     virtual std::string UniformName_Softness() { return "softness"; };
+    virtual std::string UniformName_ShadowNear() { return "shadowNear"; };
+    virtual std::string UniformName_DepthZeroToOne() { return "depthZeroToOne"; };
+    virtual std::string UniformName_EnvIrradianceSH() { return "envIrradianceSH"; };
+    virtual std::string UniformName_EnvPrefilteredSamplerCube() { return "envPrefiltered"; };
+    virtual std::string UniformName_EnvMaxLod() { return "envMaxLod"; };
+    virtual std::string UniformName_EnvIntensity() { return "envIntensity"; };
+    virtual std::string UniformName_EnvEnabled() { return "envEnabled"; };
 
 };
 
 class BasicShader : public ShaderBase
 {
+private:
+    std::vector<std::string> _vertexExpansions;
+    std::vector<std::string> _fragmentExpansions;
+
 public:
     BasicShader(std::vector<std::string> vertexExpansions, std::vector<std::string> fragmentExpansions) :
         ShaderBase(
 
-            VertexSource_Geometry::Expand(
+            ShaderAssembler::Assemble(
                 VertexSource_Geometry::EXP_VERTEX,
+                VertexSource_Geometry::Modules,
                 vertexExpansions),
 
-            FragmentSource_Geometry::Expand(
+            ShaderAssembler::Assemble(
                 FragmentSource_Geometry::EXP_FRAGMENT,
-                fragmentExpansions)) {};
+                FragmentSource_Geometry::Modules,
+                fragmentExpansions)),
+        _vertexExpansions(vertexExpansions), _fragmentExpansions(fragmentExpansions) {};
 
     virtual int PositionLayout() { return 0; }; 
     virtual int NormalLayout() { return 1; };
 
+    virtual bool Refresh()
+    {
+        BasicShader refreshed(_vertexExpansions, _fragmentExpansions);
+        if (refreshed.VertexCode() == VertexCode() && refreshed.FragmentCode() == FragmentCode())
+            return false;
 
+        Reload(refreshed.VertexCode(), refreshed.FragmentCode(), "");
+        return true;
+    }
 };
 
 class PostProcessingShader : public ShaderBase
 {
+private:
+    std::vector<std::string> _vertexExpansions;
+    std::vector<std::string> _fragmentExpansions;
+
 public:
     PostProcessingShader(std::vector<std::string> vertexExpansions, std::vector<std::string> fragmentExpansions) :
         ShaderBase(
 
-            VertexSource_PostProcessing::Expand(
+            ShaderAssembler::Assemble(
                 VertexSource_PostProcessing::EXP_VERTEX,
+                VertexSource_PostProcessing::Modules,
                 vertexExpansions),
 
-            FragmentSource_PostProcessing::Expand(
+            ShaderAssembler::Assemble(
                 FragmentSource_PostProcessing::EXP_FRAGMENT,
-                fragmentExpansions)) {};
+                FragmentSource_PostProcessing::Modules,
+                fragmentExpansions)),
+        _vertexExpansions(vertexExpansions), _fragmentExpansions(fragmentExpansions) {};
 
     virtual int PositionLayout() { return 0; };
+
+    virtual bool Refresh()
+    {
+        PostProcessingShader refreshed(_vertexExpansions, _fragmentExpansions);
+        if (refreshed.VertexCode() == VertexCode() && refreshed.FragmentCode() == FragmentCode())
+            return false;
+
+        Reload(refreshed.VertexCode(), refreshed.FragmentCode(), "");
+        return true;
+    }
+};
+
+class PostProcessingComputeShader : public ShaderBase
+{
+private:
+    std::vector<std::string> _computeExpansions;
+
+public:
+    PostProcessingComputeShader(std::vector<std::string> computeExpansions) :
+        ShaderBase(
+
+            ShaderAssembler::Assemble(
+                ComputeSource_PostProcessing::EXP_COMPUTE,
+                ComputeSource_PostProcessing::Modules,
+                computeExpansions)),
+        _computeExpansions(computeExpansions) {};
+
+    // Must match local_size_x/local_size_y of the shader
+    static const int TileSize = 16;
+
+    virtual bool Refresh()
+    {
+        PostProcessingComputeShader refreshed(_computeExpansions);
+        if (refreshed.ComputeCode() == ComputeCode())
+            return false;
+
+        Reload("", "", refreshed.ComputeCode());
+        return true;
+    }
 };
 #endif
\ No newline at end of file
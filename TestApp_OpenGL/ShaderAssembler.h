@@ -0,0 +1,218 @@
+#ifndef SHADERASSEMBLER_H
+#define SHADERASSEMBLER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iostream>
+#include <map>
+
+/*
+* Builds GLSL sources out of a template and a table of named modules.
+*
+* - The template marks insertion points with //[NAME] slots. Requested modules are written in their slot,
+*   the other slots are dropped.
+* - Each requested module also gets a "#define HAS_NAME" right after the #version line, so shared code
+*   can test for features with #ifdef.
+* - A module can pull in another module of the same table with a line #include "NAME". Each module is
+*   included at most once per source.
+*
+* Tables are constexpr, so the slots of a template can be checked against them with a static_assert.
+* Module sources can still be replaced at runtime through Overrides.
+* Requests for unknown modules, modules without a slot and unresolved includes are reported at runtime.
+*/
+namespace ShaderAssembler
+{
+    struct Module
+    {
+        std::string_view Name;
+        std::string_view Source;
+    };
+
+    struct ModuleTable
+    {
+        std::string_view Name;
+        const Module* Begin;
+        size_t Count;
+
+        constexpr ModuleTable(std::string_view name) : Name(name), Begin(nullptr), Count(0) {}
+
+        template <size_t N>
+        constexpr ModuleTable(std::string_view name, const Module(&modules)[N]) : Name(name), Begin(modules), Count(N) {}
+
+        constexpr const Module* Find(std::string_view name) const
+        {
+            for (size_t i = 0; i < Count; i++)
+                if (Begin[i].Name == name)
+                    return &Begin[i];
+
+            return nullptr;
+        }
+    };
+
+    // Sources loaded at runtime (see ShaderHotReload.h), keyed by "<table>/<module>", they take precedence over the built-in ones
+    static std::map<std::string, std::string> Overrides;
+
+    std::string OverrideKey(std::string_view table, std::string_view module)
+    {
+        return std::string(table) + "/" + std::string(module);
+    }
+
+    std::string_view SourceOf(ModuleTable modules, const Module* module)
+    {
+        if (Overrides.empty())
+            return module->Source;
+
+        auto overridden = Overrides.find(OverrideKey(modules.Name, module->Name));
+        return overridden != Overrides.end() ? std::string_view(overridden->second) : module->Source;
+    }
+
+    constexpr std::string_view SlotBegin = "//[";
+    constexpr std::string_view SlotEnd = "]";
+    constexpr std::string_view IncludeDirective = "#include \"";
+
+    // Name of the slot starting at pos (pos points to SlotBegin), empty if the slot is not closed
+    constexpr std::string_view SlotName(std::string_view source, size_t pos)
+    {
+        size_t end = source.find(SlotEnd, pos + SlotBegin.size());
+        if (end == std::string_view::npos)
+            return std::string_view();
+
+        return source.substr(pos + SlotBegin.size(), end - pos - SlotBegin.size());
+    }
+
+    // Every slot of the template names a module of the table
+    constexpr bool SlotsResolved(std::string_view source, ModuleTable modules)
+    {
+        size_t pos = source.find(SlotBegin);
+        while (pos != std::string_view::npos)
+        {
+            std::string_view name = SlotName(source, pos);
+            if (name.empty() || !modules.Find(name))
+                return false;
+
+            pos = source.find(SlotBegin, pos + SlotBegin.size() + name.size());
+        }
+        return true;
+    }
+
+    constexpr bool HasSlot(std::string_view source, std::string_view name)
+    {
+        size_t pos = source.find(SlotBegin);
+        while (pos != std::string_view::npos)
+        {
+            if (SlotName(source, pos) == name)
+                return true;
+
+            pos = source.find(SlotBegin, pos + SlotBegin.size());
+        }
+        return false;
+    }
+
+    namespace Detail
+    {
+        bool Contains(const std::vector<const Module*>& modules, const Module* module)
+        {
+            for (int i = 0; i < modules.size(); i++)
+                if (modules[i] == module)
+                    return true;
+
+            return false;
+        }
+
+        void AppendModule(std::string& result, ModuleTable modules, const Module* module, std::vector<const Module*>& included)
+        {
+            included.push_back(module);
+
+            std::string_view source = SourceOf(modules, module);
+            size_t cursor = 0;
+            size_t pos = source.find(IncludeDirective);
+            while (pos != std::string_view::npos)
+            {
+                result.append(source.substr(cursor, pos - cursor));
+
+                size_t nameBegin = pos + IncludeDirective.size();
+                size_t nameEnd = source.find('"', nameBegin);
+                size_t lineEnd = source.find('\n', pos);
+                std::string_view name = source.substr(nameBegin, nameEnd - nameBegin);
+
+                const Module* dependency = modules.Find(name);
+                if (!dependency)
+                    std::cout << "ERROR::SHADER_ASSEMBLER::UNRESOLVED_INCLUDE " << name << " in " << module->Name << std::endl;
+                else if (!Contains(included, dependency))
+                    AppendModule(result, modules, dependency, included);
+
+                cursor = lineEnd == std::string_view::npos ? source.size() : lineEnd;
+                pos = source.find(IncludeDirective, cursor);
+            }
+            result.append(source.substr(cursor));
+        }
+    }
+
+    std::string Assemble(std::string_view source, ModuleTable modules, const std::vector<std::string>& requested)
+    {
+        std::vector<const Module*> enabled;
+        size_t size = source.size();
+
+        for (int i = 0; i < requested.size(); i++)
+        {
+            const Module* module = modules.Find(requested[i]);
+            if (!module)
+            {
+                std::cout << "ERROR::SHADER_ASSEMBLER::UNKNOWN_MODULE " << requested[i] << std::endl;
+                continue;
+            }
+            if (!HasSlot(source, module->Name))
+            {
+                std::cout << "ERROR::SHADER_ASSEMBLER::NO_SLOT_FOR " << requested[i] << std::endl;
+                continue;
+            }
+            if (Detail::Contains(enabled, module))
+                continue;
+
+            enabled.push_back(module);
+            size += SourceOf(modules, module).size() + module->Name.size() + 16;
+        }
+
+        std::string result;
+        result.reserve(size);
+
+        // feature flags go right after #version, which must stay the first directive
+        size_t cursor = 0;
+        size_t version = source.find("#version");
+        if (version != std::string_view::npos)
+        {
+            size_t lineEnd = source.find('\n', version);
+            cursor = lineEnd == std::string_view::npos ? source.size() : lineEnd + 1;
+            result.append(source.substr(0, cursor));
+
+            for (int i = 0; i < enabled.size(); i++)
+            {
+                result.append("#define HAS_");
+                result.append(enabled[i]->Name);
+                result.append("\n");
+            }
+        }
+
+        // single pass over the template, slots are filled in place
+        std::vector<const Module*> included;
+        size_t pos = source.find(SlotBegin, cursor);
+        while (pos != std::string_view::npos)
+        {
+            result.append(source.substr(cursor, pos - cursor));
+
+            std::string_view name = SlotName(source, pos);
+            const Module* module = modules.Find(name);
+            if (module && Detail::Contains(enabled, module) && !Detail::Contains(included, module))
+                Detail::AppendModule(result, modules, module, included);
+
+            cursor = pos + SlotBegin.size() + name.size() + SlotEnd.size();
+            pos = source.find(SlotBegin, cursor);
+        }
+        result.append(source.substr(cursor));
+
+        return result;
+    }
+}
+
+#endif
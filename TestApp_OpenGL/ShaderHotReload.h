@@ -0,0 +1,246 @@
+#ifndef SHADERHOTRELOAD_H
+#define SHADERHOTRELOAD_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "ShaderAssembler.h"
+
+/*
+* Shader modules can be edited as files: Directory/<table>/<module>.glsl, e.g.
+* ./Shaders/FragmentSource_PostProcessing/CALC_HBAO.glsl. A file replaces the built-in source of
+* the module with the same name (see ShaderAssembler::Overrides). Export() writes the built-in
+* sources out as a starting point.
+*
+* ShaderFileWatcher only collects the paths of changed files on its own thread. Loading them and
+* refreshing the programs happens on the render thread, at the start of a frame; programs are then
+* swapped by ShaderBase::Poll() once the new version has compiled.
+*/
+namespace ShaderHotReload
+{
+    static std::string Directory = "./Shaders/";
+    static const std::string Extension = ".glsl";
+
+    // "<table>/<module>" from Directory/<table>/<module>.glsl, empty for anything else
+    std::string OverrideKeyFromPath(std::filesystem::path path)
+    {
+        if (path.extension() != Extension || !path.has_parent_path())
+            return "";
+
+        return ShaderAssembler::OverrideKey(path.parent_path().filename().string(), path.stem().string());
+    }
+
+    bool LoadModule(std::filesystem::path path)
+    {
+        std::string key = OverrideKeyFromPath(path);
+        if (key.empty())
+            return false;
+
+        std::ifstream file(path);
+        if (!file)
+            return false;
+
+        std::stringstream source;
+        source << file.rdbuf();
+
+        ShaderAssembler::Overrides[key] = source.str();
+        std::cout << "SHADER::HOT_RELOAD::LOADED " << key << std::endl;
+        return true;
+    }
+
+    // Loads every module file found in Directory, call before the shaders are assembled
+    int LoadAll()
+    {
+        int loaded = 0;
+        std::error_code error;
+        for (auto& entry : std::filesystem::recursive_directory_iterator(Directory, error))
+            if (entry.is_regular_file() && LoadModule(entry.path()))
+                loaded++;
+
+        return loaded;
+    }
+
+    int Apply(std::vector<std::string> changedPaths)
+    {
+        int loaded = 0;
+        for (int i = 0; i < changedPaths.size(); i++)
+            if (LoadModule(changedPaths[i]))
+                loaded++;
+
+        return loaded;
+    }
+
+    // Writes the built-in sources of a table, files that already exist are left alone
+    void Export(ShaderAssembler::ModuleTable modules)
+    {
+        std::filesystem::path directory = std::filesystem::path(Directory) / std::string(modules.Name);
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+
+        for (size_t i = 0; i < modules.Count; i++)
+        {
+            std::filesystem::path path = directory / (std::string(modules.Begin[i].Name) + Extension);
+            if (std::filesystem::exists(path, error))
+                continue;
+
+            std::ofstream file(path);
+            file << ShaderAssembler::SourceOf(modules, &modules.Begin[i]);
+        }
+    }
+}
+
+class ShaderFileWatcher
+{
+private:
+    std::string _directory;
+    std::thread _thread;
+    std::atomic<bool> _running;
+
+    std::mutex _mutex;
+    std::set<std::string> _changed;
+
+    void Push(std::string path)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _changed.insert(path);
+    }
+
+#ifdef __linux__
+    void Run()
+    {
+        int fd = inotify_init1(IN_NONBLOCK);
+        if (fd < 0)
+        {
+            std::cout << "SHADER::HOT_RELOAD::INOTIFY_FAILED" << std::endl;
+            return;
+        }
+
+        std::map<int, std::string> watches;
+        auto watch = [&](std::string directory)
+        {
+            int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            if (wd >= 0)
+                watches[wd] = directory;
+        };
+
+        std::error_code error;
+        watch(_directory);
+        for (auto& entry : std::filesystem::recursive_directory_iterator(_directory, error))
+            if (entry.is_directory())
+                watch(entry.path().string());
+
+        alignas(inotify_event) char buffer[4096];
+        while (_running)
+        {
+            // short timeout so Stop() does not wait long
+            pollfd descriptor = { fd, POLLIN, 0 };
+            if (poll(&descriptor, 1, 200) <= 0)
+                continue;
+
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            for (char* ptr = buffer; length > 0 && ptr < buffer + length; )
+            {
+                const inotify_event* event = (const inotify_event*)ptr;
+                ptr += sizeof(inotify_event) + event->len;
+
+                if (!event->len || !watches.count(event->wd))
+                    continue;
+
+                std::string path = (std::filesystem::path(watches[event->wd]) / event->name).string();
+                if (event->mask & IN_ISDIR)
+                {
+                    if (event->mask & IN_CREATE)
+                        watch(path);
+                }
+                else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                    Push(path);
+            }
+        }
+
+        close(fd);
+    }
+#else
+    // No inotify: compare write times every 250 ms
+    std::map<std::string, std::filesystem::file_time_type> Scan()
+    {
+        std::map<std::string, std::filesystem::file_time_type> times;
+        std::error_code error;
+        for (auto& entry : std::filesystem::recursive_directory_iterator(_directory, error))
+            if (entry.is_regular_file())
+                times[entry.path().string()] = entry.last_write_time(error);
+
+        return times;
+    }
+
+    void Run()
+    {
+        std::map<std::string, std::filesystem::file_time_type> times = Scan();
+        while (_running)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+
+            std::map<std::string, std::filesystem::file_time_type> current = Scan();
+            for (auto& file : current)
+            {
+                auto previous = times.find(file.first);
+                if (previous == times.end() || previous->second != file.second)
+                    Push(file.first);
+            }
+            times = current;
+        }
+    }
+#endif
+
+public:
+    ShaderFileWatcher(std::string directory) : _directory(directory), _running(false) {}
+    ~ShaderFileWatcher() { Stop(); }
+
+    ShaderFileWatcher(const ShaderFileWatcher&) = delete;
+    ShaderFileWatcher& operator=(const ShaderFileWatcher&) = delete;
+
+    void Start()
+    {
+        if (_running)
+            return;
+
+        std::error_code error;
+        std::filesystem::create_directories(_directory, error);
+
+        _running = true;
+        _thread = std::thread(&ShaderFileWatcher::Run, this);
+    }
+
+    void Stop()
+    {
+        _running = false;
+        if (_thread.joinable())
+            _thread.join();
+    }
+
+    // Paths changed since the last call, each one once
+    std::vector<std::string> TakeChanged()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<std::string> changed(_changed.begin(), _changed.end());
+        _changed.clear();
+        return changed;
+    }
+};
+
+#endif
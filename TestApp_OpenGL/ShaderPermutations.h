@@ -0,0 +1,238 @@
+#ifndef SHADERPERMUTATIONS_H
+#define SHADERPERMUTATIONS_H
+
+#include <string>
+#include <string_view>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "Shader.h"
+
+// Feature bits ===================================================================================================================== //
+namespace ShaderFeatures
+{
+    enum Geometry : unsigned int
+    {
+        LIT         = 1 << 0,
+        UNLIT       = 1 << 1,
+        SHADOWS     = 1 << 2,
+        SSAO        = 1 << 3,
+        VIEWNORMALS = 1 << 4,
+        IBL         = 1 << 5,
+    };
+
+    // Post processing programs are not combined, each bit selects one program
+    enum PostProcessing : unsigned int
+    {
+        PP_POSITIONS     = 1 << 0,
+        PP_SSAO          = 1 << 1,
+        PP_HBAO          = 1 << 2,
+        PP_BLUR          = 1 << 3,
+        PP_GAUSSIAN_BLUR = 1 << 4,
+        PP_DISPLAY_RED   = 1 << 5,
+        PP_TEMPORAL      = 1 << 6,
+        PP_PLACEHOLDER   = 1 << 7,
+    };
+
+    // Unused entries of the expansion lists are left empty
+    static constexpr size_t MaxExpansions = 4;
+
+    struct FeatureExpansions
+    {
+        unsigned int Feature;
+        std::string_view VertexExpansions[MaxExpansions];
+        std::string_view FragmentExpansions[MaxExpansions];
+    };
+
+    constexpr FeatureExpansions GeometryTable[] =
+    {
+        { LIT,          { },                                { "DEFS_LIGHTS", "DEFS_MATERIAL", "CALC_LIT_MAT" }  },
+        { UNLIT,        { },                                { "DEFS_MATERIAL", "CALC_UNLIT_MAT" }               },
+        { SHADOWS,      { "DEFS_SHADOWS", "CALC_SHADOWS" }, { "DEFS_SHADOWS", "CALC_SHADOWS" }                  },
+        { SSAO,         { },                                { "DEFS_SSAO", "CALC_SSAO" }                        },
+        { VIEWNORMALS,  { },                                { "DEFS_NORMALS", "CALC_NORMALS" }                  },
+        { IBL,          { },                                { "DEFS_IBL", "CALC_IBL" }                          },
+    };
+
+    constexpr FeatureExpansions PostProcessingTable[] =
+    {
+        { PP_POSITIONS,     { }, { "DEFS_SSAO", "CALC_POSITIONS" }              },
+        { PP_SSAO,          { }, { "DEFS_SSAO", "CALC_SSAO" }                   },
+        { PP_HBAO,          { }, { "DEFS_SSAO", "CALC_HBAO" }                   },
+        { PP_BLUR,          { }, { "DEFS_BLUR", "CALC_BLUR" }                   },
+        { PP_GAUSSIAN_BLUR, { }, { "DEFS_GAUSSIAN_BLUR", "CALC_GAUSSIAN_BLUR" } },
+        { PP_DISPLAY_RED,   { }, { "DEFS_DISPLAY", "CALC_DISPLAY_RED" }         },
+        { PP_TEMPORAL,      { }, { "DEFS_TEMPORAL", "CALC_TEMPORAL" }           },
+        { PP_PLACEHOLDER,   { }, { "CALC_PLACEHOLDER" }                         },
+    };
+
+    // Every expansion of the table names a module of the vertex / fragment module table
+    template <size_t N>
+    constexpr bool ExpansionsResolved(const FeatureExpansions(&table)[N], ShaderAssembler::ModuleTable vertexModules, ShaderAssembler::ModuleTable fragmentModules)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            for (size_t e = 0; e < MaxExpansions; e++)
+            {
+                if (!table[i].VertexExpansions[e].empty() && !vertexModules.Find(table[i].VertexExpansions[e]))
+                    return false;
+                if (!table[i].FragmentExpansions[e].empty() && !fragmentModules.Find(table[i].FragmentExpansions[e]))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    static_assert(ExpansionsResolved(GeometryTable, VertexSource_Geometry::Modules, FragmentSource_Geometry::Modules),
+        "ShaderFeatures::GeometryTable expands a module that does not exist");
+    static_assert(ExpansionsResolved(PostProcessingTable, VertexSource_PostProcessing::Modules, FragmentSource_PostProcessing::Modules),
+        "ShaderFeatures::PostProcessingTable expands a module that does not exist");
+}
+
+// Permutation cache ================================================================================================================ //
+/*
+* Hands out one program per feature mask. Nothing is compiled here: the ShaderBase compiles itself the first
+* time it is used, so only the permutations that are actually drawn cost compile time.
+* Masks that expand to the same sources share the same program.
+* TShader must be constructible from (vertexExpansions, fragmentExpansions), like BasicShader and PostProcessingShader.
+*/
+template <class TShader>
+class ShaderPermutations
+{
+private:
+    std::string _name;
+    std::vector<ShaderFeatures::FeatureExpansions> _features;
+
+    // expanded vertex + fragment source => program
+    std::map<std::string, TShader> _programs;
+
+    // feature mask => program
+    std::map<unsigned int, ShaderBase*> _permutations;
+
+    ShaderBase* _placeholder;
+
+    std::string PermutationName(unsigned int features)
+    {
+        std::stringstream name;
+        name << _name << "[0x" << std::hex << std::setw(4) << std::setfill('0') << features << "]";
+        return name.str();
+    }
+
+public:
+    template <size_t N>
+    ShaderPermutations(std::string name, const ShaderFeatures::FeatureExpansions(&features)[N])
+        : _name(name), _features(features, features + N), _placeholder(nullptr)
+    {}
+
+    ShaderBase* Get(unsigned int features)
+    {
+        auto cached = _permutations.find(features);
+        if (cached != _permutations.end())
+            return cached->second;
+
+        std::vector<std::string> vertexExpansions, fragmentExpansions;
+        for (int i = 0; i < _features.size(); i++)
+        {
+            if (!(features & _features[i].Feature))
+                continue;
+
+            // features may share blocks (e.g. DEFS_MATERIAL), each token can only be expanded once
+            for (std::string_view e : _features[i].VertexExpansions)
+                if (!e.empty() && std::find(vertexExpansions.begin(), vertexExpansions.end(), e) == vertexExpansions.end())
+                    vertexExpansions.emplace_back(e);
+
+            for (std::string_view e : _features[i].FragmentExpansions)
+                if (!e.empty() && std::find(fragmentExpansions.begin(), fragmentExpansions.end(), e) == fragmentExpansions.end())
+                    fragmentExpansions.emplace_back(e);
+        }
+
+        TShader shader(vertexExpansions, fragmentExpansions);
+        std::string key = shader.VertexCode() + '\0' + shader.FragmentCode();
+
+        auto program = _programs.find(key);
+        if (program == _programs.end())
+        {
+            shader.SetName(PermutationName(features));
+            program = _programs.insert({ key, shader }).first;
+        }
+
+        program->second.SetPlaceholder(_placeholder);
+        _permutations[features] = &program->second;
+        return &program->second;
+    }
+
+    // Permutations that are not compiled yet draw with the placeholder, which is compiled right away
+    void SetPlaceholder(ShaderBase* placeholder)
+    {
+        _placeholder = placeholder;
+        _placeholder->Compile();
+
+        for (auto& p : _programs)
+            p.second.SetPlaceholder(_placeholder);
+    }
+
+    // Starts compiling every permutation requested so far, all at once so the driver can overlap them
+    void SubmitAll()
+    {
+        for (auto& p : _programs)
+            p.second.Submit();
+    }
+
+    // Reassembles every program after a module changed, only those whose sources differ are recompiled.
+    // Programs keep their original key: a later Get() with a new source simply adds a program.
+    int RefreshAll()
+    {
+        int reloaded = 0;
+        for (auto& p : _programs)
+            if (p.second.Refresh())
+                reloaded++;
+
+        return reloaded;
+    }
+
+    // Non blocking with parallel compile, returns the number of programs still compiling
+    int PollAll()
+    {
+        int pending = 0;
+        for (auto& p : _programs)
+            if (!p.second.Poll())
+                pending++;
+
+        return pending;
+    }
+
+    // True for programs of this set, which RefreshAll / PollAll already take care of
+    bool Owns(ShaderBase* shader)
+    {
+        for (auto& p : _programs)
+            if (&p.second == shader)
+                return true;
+        return false;
+    }
+
+    int PermutationsCount() { return _permutations.size(); }
+    int ProgramsCount() { return _programs.size(); }
+
+    void Report(std::ostream& out)
+    {
+        double total = 0;
+        for (auto& p : _permutations)
+        {
+            out << PermutationName(p.first) << " => " << p.second->Name() << " : ";
+            if (p.second->IsCompiled())
+                out << p.second->CompileTimeMs() << " ms" << std::endl;
+            else
+                out << "not compiled" << std::endl;
+        }
+        for (auto& p : _programs)
+        {
+            total += p.second.CompileTimeMs();
+        }
+        out << _name << ": " << _permutations.size() << " permutations, " << _programs.size() << " programs, " << total << " ms" << std::endl;
+    }
+};
+
+#endif
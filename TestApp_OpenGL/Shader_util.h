@@ -11,6 +11,8 @@
 #include <sstream>
 #include <iostream>
 
+#include "ProgramBinaryCache.h"
+
 class Shader
 {
 public:
@@ -59,9 +61,15 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
         }
+        // 2. try the binary cache first
+        ID = glCreateProgram();
+        std::string cacheKey = ProgramBinaryCache::Key({ vertexCode, fragmentCode, geometryCode });
+        if (ProgramBinaryCache::Load(ID, cacheKey))
+            return;
+
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 3. compile shaders
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -84,13 +92,14 @@ public:
             checkCompileErrors(geometry, "GEOMETRY");
         }
         // shader Program
-        ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
         if (geometryPath != nullptr)
             glAttachShader(ID, geometry);
+        ProgramBinaryCache::PrepareProgram(ID);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        ProgramBinaryCache::Store(ID, cacheKey);
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
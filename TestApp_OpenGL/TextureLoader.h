@@ -0,0 +1,482 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <future>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <cstring>
+#include <climits>
+
+#include "stb_image.h"
+#include "JobSystem.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+/*
+* Images are decoded on the job system (JobSystem.h), get a full mip chain and, when the driver exposes
+* GL_EXT_texture_compression_s3tc, are compressed to BC1. Compressed chains are cached in CacheDirectory so
+* the next run skips decoding and compression entirely.
+* The GL side (texture creation and the PBO upload) stays on the thread owning the context.
+*/
+namespace TextureLoader
+{
+    // Set by the application once the context exists, e.g. from glfwExtensionSupported("GL_EXT_texture_compression_s3tc")
+    static bool Compression = false;
+    static std::string CacheDirectory = "./TextureCache/";
+
+    double ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    struct MipLevel
+    {
+        int Width;
+        int Height;
+        std::vector<unsigned char> Data;
+    };
+
+    struct Image
+    {
+        std::string Path;
+        bool Compressed;
+        std::vector<MipLevel> Levels;
+
+        // decode side of the timing breakdown, the upload is timed by the Load functions
+        bool FromCache;
+        double DecodeMs;
+
+        bool Valid() { return !Levels.empty(); };
+        size_t Size()
+        {
+            size_t size = 0;
+            for (int i = 0; i < Levels.size(); i++)
+                size += Levels[i].Data.size();
+            return size;
+        }
+    };
+
+    // Mips ================================================================================================================= //
+    // 2x2 box filter on RGB8, odd sizes clamp the last row/column
+    MipLevel Downsample(const MipLevel& level)
+    {
+        MipLevel result;
+        result.Width = std::max(1, level.Width / 2);
+        result.Height = std::max(1, level.Height / 2);
+        result.Data.resize(result.Width * result.Height * 3);
+
+        for (int y = 0; y < result.Height; y++)
+            for (int x = 0; x < result.Width; x++)
+            {
+                int x0 = std::min(x * 2, level.Width - 1), x1 = std::min(x * 2 + 1, level.Width - 1);
+                int y0 = std::min(y * 2, level.Height - 1), y1 = std::min(y * 2 + 1, level.Height - 1);
+
+                for (int c = 0; c < 3; c++)
+                {
+                    int sum =
+                        level.Data[(y0 * level.Width + x0) * 3 + c] + level.Data[(y0 * level.Width + x1) * 3 + c] +
+                        level.Data[(y1 * level.Width + x0) * 3 + c] + level.Data[(y1 * level.Width + x1) * 3 + c];
+                    result.Data[(y * result.Width + x) * 3 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+
+        return result;
+    }
+
+    // BC1 ================================================================================================================== //
+    unsigned short To565(const unsigned char* rgb)
+    {
+        return (unsigned short)(((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3));
+    }
+
+    void From565(unsigned short c, int* rgb)
+    {
+        rgb[0] = ((c >> 11) & 31) * 255 / 31;
+        rgb[1] = ((c >> 5) & 63) * 255 / 63;
+        rgb[2] = (c & 31) * 255 / 31;
+    }
+
+    // Endpoints are the extremes of the block along the diagonal of its color bounding box
+    void CompressBlockBC1(const unsigned char block[16][3], unsigned char* out)
+    {
+        int minC[3] = { 255, 255, 255 }, maxC[3] = { 0, 0, 0 };
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 3; c++)
+            {
+                minC[c] = std::min(minC[c], (int)block[i][c]);
+                maxC[c] = std::max(maxC[c], (int)block[i][c]);
+            }
+
+        int axis[3] = { maxC[0] - minC[0], maxC[1] - minC[1], maxC[2] - minC[2] };
+        int minP = INT_MAX, maxP = INT_MIN, minI = 0, maxI = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int p = block[i][0] * axis[0] + block[i][1] * axis[1] + block[i][2] * axis[2];
+            if (p < minP) { minP = p; minI = i; }
+            if (p > maxP) { maxP = p; maxI = i; }
+        }
+
+        unsigned short c0 = To565(block[maxI]), c1 = To565(block[minI]);
+        unsigned int indices = 0;
+
+        // c0 > c1 selects the 4 colors mode, equal endpoints leave all indices at 0
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        if (c0 != c1)
+        {
+            int palette[4][3];
+            From565(c0, palette[0]);
+            From565(c1, palette[1]);
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0, bestDistance = INT_MAX;
+                for (int p = 0; p < 4; p++)
+                {
+                    int dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+                    int distance = dr * dr + dg * dg + db * db;
+                    if (distance < bestDistance) { bestDistance = distance; best = p; }
+                }
+                indices |= best << (2 * i);
+            }
+        }
+
+        out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+        out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+        out[4] = indices & 0xFF; out[5] = (indices >> 8) & 0xFF; out[6] = (indices >> 16) & 0xFF; out[7] = indices >> 24;
+    }
+
+    MipLevel CompressBC1(const MipLevel& level)
+    {
+        int blocksX = (level.Width + 3) / 4, blocksY = (level.Height + 3) / 4;
+
+        MipLevel result;
+        result.Width = level.Width;
+        result.Height = level.Height;
+        result.Data.resize(blocksX * blocksY * 8);
+
+        unsigned char block[16][3];
+        for (int by = 0; by < blocksY; by++)
+            for (int bx = 0; bx < blocksX; bx++)
+            {
+                // partial blocks repeat their last pixels
+                for (int i = 0; i < 16; i++)
+                {
+                    int x = std::min(bx * 4 + i % 4, level.Width - 1);
+                    int y = std::min(by * 4 + i / 4, level.Height - 1);
+                    memcpy(block[i], &level.Data[(y * level.Width + x) * 3], 3);
+                }
+                CompressBlockBC1(block, &result.Data[(by * blocksX + bx) * 8]);
+            }
+
+        return result;
+    }
+
+    // Disk cache =========================================================================================================== //
+    // Keyed by path, size and write time of the source file: editing the image invalidates its entry
+    std::string CachePath(std::string path)
+    {
+        std::error_code error;
+        auto size = std::filesystem::file_size(path, error);
+        auto time = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+
+        size_t hash = std::hash<std::string>()(path + "|" + std::to_string(size) + "|" + std::to_string(time));
+        return CacheDirectory + std::to_string(hash) + ".bc1";
+    }
+
+    // A full BC1 mip chain down to 1x1, every level the size its dimensions call for and inside the file; anything
+    // else (truncated or foreign file) is treated as a miss and the cache entry gets rebuilt
+    bool ReadCache(std::string cachePath, Image* image)
+    {
+        std::ifstream file(cachePath, std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+        long long remaining = (long long)file.tellg();
+        file.seekg(0);
+
+        int levels = 0;
+        file.read((char*)&levels, sizeof(levels));
+        remaining -= sizeof(levels);
+        bool valid = file && levels > 0 && levels <= 32;
+        for (int i = 0; i < levels && valid; i++)
+        {
+            MipLevel level;
+            int size = 0;
+            file.read((char*)&level.Width, sizeof(level.Width));
+            file.read((char*)&level.Height, sizeof(level.Height));
+            file.read((char*)&size, sizeof(size));
+            remaining -= 3 * sizeof(int);
+
+            bool chained = i == 0 ? level.Width > 0 && level.Height > 0 :
+                level.Width == std::max(1, image->Levels.back().Width / 2) && level.Height == std::max(1, image->Levels.back().Height / 2);
+            valid = file && chained && size == ((level.Width + 3) / 4) * ((level.Height + 3) / 4) * 8 && size <= remaining;
+            if (!valid)
+                break;
+
+            level.Data.resize(size);
+            file.read((char*)level.Data.data(), size);
+            remaining -= size;
+            valid = (bool)file;
+            image->Levels.push_back(level);
+        }
+
+        if (!valid || image->Levels.back().Width > 1 || image->Levels.back().Height > 1)
+        {
+            std::cout << "TEXTURE::CACHE_INVALID " << cachePath << ", rebuilding" << std::endl;
+            image->Levels.clear();
+            return false;
+        }
+
+        image->Compressed = true;
+        return true;
+    }
+
+    void WriteCache(std::string cachePath, Image& image)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(CacheDirectory, error);
+
+        std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return;
+
+        int levels = image.Levels.size();
+        file.write((char*)&levels, sizeof(levels));
+        for (int i = 0; i < levels; i++)
+        {
+            int size = image.Levels[i].Data.size();
+            file.write((char*)&image.Levels[i].Width, sizeof(int));
+            file.write((char*)&image.Levels[i].Height, sizeof(int));
+            file.write((char*)&size, sizeof(size));
+            file.write((char*)image.Levels[i].Data.data(), size);
+        }
+    }
+
+    // Decode =============================================================================================================== //
+    // CPU only, safe to run on any thread. Uncompressed decodes keep RGB8 levels readable on the CPU.
+    Image Decode(std::string path, bool compress)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        Image image;
+        image.Path = path;
+        image.Compressed = false;
+        image.FromCache = false;
+        image.DecodeMs = 0;
+
+        std::string cachePath = CachePath(path);
+        if (compress && ReadCache(cachePath, &image))
+        {
+            image.FromCache = true;
+            image.DecodeMs = ElapsedMs(start);
+            return image;
+        }
+
+        MipLevel level;
+        int channels;
+        unsigned char* data = stbi_load(path.c_str(), &level.Width, &level.Height, &channels, 3);
+        if (!data)
+        {
+            std::cout << "TEXTURE::DECODE_FAILED " << path << std::endl;
+            return image;
+        }
+        level.Data.assign(data, data + level.Width * level.Height * 3);
+        stbi_image_free(data);
+
+        image.Levels.push_back(level);
+        while (image.Levels.back().Width > 1 || image.Levels.back().Height > 1)
+            image.Levels.push_back(Downsample(image.Levels.back()));
+
+        if (compress)
+        {
+            for (int i = 0; i < image.Levels.size(); i++)
+                image.Levels[i] = CompressBC1(image.Levels[i]);
+
+            image.Compressed = true;
+            WriteCache(cachePath, image);
+        }
+
+        image.DecodeMs = ElapsedMs(start);
+        return image;
+    }
+
+    // On the engine job pool. stb_image keeps no global state while decoding (the flip flag is never set here),
+    // so decodes run concurrently.
+    std::future<Image> DecodeAsync(std::string path, bool compress = Compression)
+    {
+        return Jobs().Async<Image>([path, compress] { return Decode(path, compress); });
+    }
+
+    // Upload =============================================================================================================== //
+    // Copies all the images in one pixel unpack buffer, then lets the driver pull every level out of it
+    void Upload(std::vector<Image>& images, std::vector<unsigned int> targets)
+    {
+        size_t size = 0;
+        for (int i = 0; i < images.size(); i++)
+            size += images[i].Size();
+        if (size == 0)
+            return;
+
+        unsigned int pbo;
+        glGenBuffers(1, &pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+
+        unsigned char* mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        size_t offset = 0;
+        for (int i = 0; i < images.size(); i++)
+            for (int l = 0; l < images[i].Levels.size(); l++)
+            {
+                memcpy(mapped + offset, images[i].Levels[l].Data.data(), images[i].Levels[l].Data.size());
+                offset += images[i].Levels[l].Data.size();
+            }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        offset = 0;
+        for (int i = 0; i < images.size(); i++)
+            for (int l = 0; l < images[i].Levels.size(); l++)
+            {
+                MipLevel& level = images[i].Levels[l];
+                if (images[i].Compressed)
+                    glCompressedTexImage2D(targets[i], l, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, level.Width, level.Height, 0, level.Data.size(), (void*)offset);
+                else
+                    glTexImage2D(targets[i], l, GL_RGB8, level.Width, level.Height, 0, GL_RGB, GL_UNSIGNED_BYTE, (void*)offset);
+
+                offset += level.Data.size();
+            }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &pbo); // storage is released once the copies are done
+    }
+
+    void LogTiming(Image& image, double uploadMs)
+    {
+        std::cout << "TEXTURE::LOADED " << image.Path
+            << " decode " << image.DecodeMs << " ms (" << (image.FromCache ? "cache" : image.Compressed ? "stb + mips + BC1" : "stb + mips") << ")"
+            << " upload " << uploadMs << " ms" << std::endl;
+    }
+
+    // Faces in the +X, -X, +Y, -Y, +Z, -Z order. 0 unless all six decode to square images of one size and format:
+    // an incomplete cubemap would sample as black.
+    unsigned int LoadCubemap(std::vector<std::string> faces)
+    {
+        std::vector<std::future<Image>> decoding;
+        for (int i = 0; i < faces.size(); i++)
+            decoding.push_back(DecodeAsync(faces[i]));
+
+        std::vector<Image> images;
+        std::vector<unsigned int> targets;
+        for (int i = 0; i < decoding.size(); i++)
+        {
+            images.push_back(decoding[i].get());
+            targets.push_back(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i);
+        }
+
+        bool complete = images.size() == 6;
+        if (!complete)
+            std::cout << "ERROR::TEXTURE::CUBEMAP_FACES " << images.size() << " given, 6 needed" << std::endl;
+        for (int i = 0; complete && i < images.size(); i++)
+        {
+            complete = images[i].Valid() && images[i].Levels[0].Width == images[i].Levels[0].Height &&
+                images[i].Levels[0].Width == images[0].Levels[0].Width && images[i].Compressed == images[0].Compressed;
+            if (!complete)
+                std::cout << "ERROR::TEXTURE::CUBEMAP_FACE " << (i < faces.size() ? faces[i] : "missing") << std::endl;
+        }
+        if (!complete)
+            return 0;
+        int levels = images[0].Levels.size();
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+
+        Upload(images, targets);
+
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, std::max(0, levels - 1));
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS); // filter across faces, visible on the small mips otherwise
+
+        // the faces share one upload, each gets its share by size
+        double uploadMs = ElapsedMs(start);
+        size_t totalSize = 0;
+        for (int i = 0; i < images.size(); i++)
+            totalSize += images[i].Size();
+        for (int i = 0; i < images.size(); i++)
+            LogTiming(images[i], uploadMs * images[i].Size() / std::max<size_t>(totalSize, 1));
+
+        return textureID;
+    }
+
+    unsigned int UploadTexture2D(Image& image)
+    {
+        std::vector<Image> images = { image };
+        int levels = image.Levels.size();
+
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+
+        Upload(images, { GL_TEXTURE_2D });
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, std::max(0, levels - 1));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+        return textureID;
+    }
+
+    // A whole texture set (e.g. the maps of the materials of a scene): all decoded at once, uploaded in order
+    std::vector<unsigned int> LoadTextures(std::vector<std::string> paths)
+    {
+        std::vector<std::future<Image>> decoding;
+        for (int i = 0; i < paths.size(); i++)
+            decoding.push_back(DecodeAsync(paths[i]));
+
+        std::vector<unsigned int> textures;
+        for (int i = 0; i < decoding.size(); i++)
+        {
+            Image image = decoding[i].get();
+
+            auto start = std::chrono::high_resolution_clock::now();
+            textures.push_back(image.Valid() ? UploadTexture2D(image) : 0);
+            LogTiming(image, ElapsedMs(start));
+        }
+
+        return textures;
+    }
+
+    unsigned int LoadTexture2D(std::string path)
+    {
+        return LoadTextures({ path })[0];
+    }
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef TRANSFORMHIERARCHY_H
+#define TRANSFORMHIERARCHY_H
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+
+/*
+* Flat transform hierarchy: one node per entry of contiguous arrays (parent index, local and world matrix, flags), no
+* node objects. A node's parent is always added before it, so every level is complete before the next one starts.
+*
+*   TransformHierarchy::Node car = transforms.Add(carMatrix);
+*   TransformHierarchy::Node wheel = transforms.Add(wheelOffset, car);
+*   transforms.SetLocal(car, moved);    // marks car dirty
+*   transforms.Update();                // car and wheel get new world matrices, nothing else does
+*
+* Update() walks the levels top-down, each level split over the job system; a node is recomputed when it was set
+* or its parent was recomputed, so moving an assembly costs its subtree. Changed() tells consumers (renderers,
+* bounds) which world matrices the last Update() produced.
+*/
+class TransformHierarchy
+{
+public:
+    typedef int Node;
+    static const Node Root = -1;
+
+private:
+    std::vector<Node> _parents;
+    std::vector<glm::mat4> _locals;
+    std::vector<glm::mat4> _worlds;
+    std::vector<unsigned char> _dirty;      // local set since the last Update
+    std::vector<unsigned char> _changed;    // world recomputed by the last Update
+    std::vector<std::vector<Node>> _levels; // nodes by depth
+
+    int _dirtyCount = 0;
+    bool _anyChanged = false;
+
+public:
+    TransformHierarchy() {}
+
+    // The parent must already be in the hierarchy
+    Node Add(const glm::mat4& local, Node parent = Root)
+    {
+        Node node = _parents.size();
+        if (parent >= node)
+        {
+            std::cout << "ERROR::TRANSFORMS::PARENT_NOT_ADDED " << parent << std::endl;
+            parent = Root;
+        }
+
+        int depth = 0;
+        for (Node p = parent; p != Root; p = _parents[p])
+            depth++;
+        if (depth >= _levels.size())
+            _levels.resize(depth + 1);
+        _levels[depth].push_back(node);
+
+        _parents.push_back(parent);
+        _locals.push_back(local);
+        _worlds.push_back(local);
+        _dirty.push_back(1);
+        _changed.push_back(0);
+        _dirtyCount++;
+        return node;
+    }
+
+    void SetLocal(Node node, const glm::mat4& local)
+    {
+        _locals[node] = local;
+        if (!_dirty[node])
+        {
+            _dirty[node] = 1;
+            _dirtyCount++;
+        }
+    }
+
+    int Size() { return _parents.size(); }
+    Node Parent(Node node) { return _parents[node]; }
+    const glm::mat4& Local(Node node) { return _locals[node]; }
+    const glm::mat4& World(Node node) { return _worlds[node]; }
+    bool Changed(Node node) { return _changed[node]; }
+
+    void Update(int grain = 1024)
+    {
+        if (_dirtyCount == 0)
+        {
+            if (_anyChanged)
+                std::fill(_changed.begin(), _changed.end(), 0);
+            _anyChanged = false;
+            return;
+        }
+
+        for (int depth = 0; depth < _levels.size(); depth++)
+        {
+            const std::vector<Node>& level = _levels[depth];
+            Jobs().ParallelFor(level.size(), grain, [this, &level](int begin, int end)
+            {
+                for (int i = begin; i < end; i++)
+                {
+                    Node node = level[i];
+                    Node parent = _parents[node];
+                    bool update = _dirty[node] || (parent != Root && _changed[parent]);
+
+                    _changed[node] = update;
+                    if (!update)
+                        continue;
+
+                    _worlds[node] = parent != Root ? _worlds[parent] * _locals[node] : _locals[node];
+                    _dirty[node] = 0;
+                }
+            });
+        }
+
+        _dirtyCount = 0;
+        _anyChanged = true;
+    }
+};
+
+#endif
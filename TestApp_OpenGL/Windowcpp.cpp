@@ -12,13 +12,26 @@
 #include "ImGui/imgui_impl_glfw.h"
 #include "ImGui/imgui_impl_opengl3.h"
 #include "Shader.h"
+#include "ShaderPermutations.h"
+#include "ShaderHotReload.h"
 #include "Mesh.h"
 #include "stb_image.h"
+#include "TextureLoader.h"
+#include "EnvironmentLighting.h"
 #include "Camera.h"
 #include "Mesh.h"
 #include "GeometryHelper.h"
 #include "SceneUtils.h"
 #include "FrameBuffer.h"
+#include "RenderTargetPool.h"
+#include "RenderGraph.h"
+#include "Profiler.h"
+#include "Headless.h"
+#include "JobSystem.h"
+#include "CommandBuffer.h"
+#include "Benchmark.h"
+#include "SceneLoader.h"
+#include "ReverseZ.h"
 #include "Shader_util.h"
 
 // CONSTANTS ======================================================
@@ -55,14 +68,41 @@ bool showAO = false;
 bool perspective = true;
 float fov = 45.0f;
 
+// Scene target multisampling, 1 << msaaItem samples
+int msaaItem = 2;
+
+// Transient per-frame targets (SSAO inputs, AO, blur), recycled across passes and frames
+RenderTargetPool renderTargets;
+
+// CPU/GPU timings of the frame scopes, every render graph pass is one
+Profiler profiler;
+
+// Frame passes, declared every frame and run through renderTargets
+RenderGraph renderGraph(renderTargets, profiler);
+
 // Scene Parameters ==========================================================
 SceneParams sceneParams = SceneParams();
 
+// Skybox ==========================================================
+std::vector<std::string> skyboxFaces{
+    "./Assets/Skybox/posx.jpg",
+    "./Assets/Skybox/negx.jpg",
+    "./Assets/Skybox/posy.jpg",
+    "./Assets/Skybox/negy.jpg",
+    "./Assets/Skybox/posz.jpg",
+    "./Assets/Skybox/negz.jpg"
+};
+EnvironmentLighting::ReferenceError environmentError;
+
 // BBox ============================================================
 BoundingBox sceneBB = BoundingBox(std::vector<glm::vec3>{});
 
+// Shaders ==========================================================
+static ShaderPermutations<BasicShader> GeometryPermutations("GEOMETRY", ShaderFeatures::GeometryTable);
+static ShaderPermutations<PostProcessingShader> PostProcessingPermutations("POSTPROCESSING", ShaderFeatures::PostProcessingTable);
+
 // ImGUI ============================================================
-const char* ao_comboBox_items[] = { "SSAO", "HBAO" };
+const char* ao_comboBox_items[] = { "SSAO", "HBAO", "HBAO (Compute)" };
 static const char* ao_comboBox_current_item = "SSAO";
 
 const char* AOShaderFromItem(const char* item)
@@ -71,6 +111,8 @@ const char* AOShaderFromItem(const char* item)
         return "SSAO";
     else if (!strcmp("HBAO", item))
         return "HBAO";
+    else if (!strcmp("HBAO (Compute)", item))
+        return GLAD_GL_VERSION_4_3 ? "HBAO_COMPUTE" : "HBAO"; // compute shaders need a 4.3 context
     else return "SSAO";
 }
 
@@ -85,6 +127,10 @@ void ShowImGUIWindow()
         {
             ImGui::Checkbox("Perspective", &perspective);
             ImGui::SliderFloat("FOV", &fov, 10.0f, 100.0f);
+            if (ReverseZ::Supported)
+                ImGui::Checkbox("Reverse Z", &ReverseZ::Enabled);
+            ImGui::Checkbox("Infinite far plane", &ReverseZ::InfiniteFar);
+            ImGui::Combo("MSAA", &msaaItem, "Off\0" "2x\0" "4x\0" "8x\0");
             ImGui::EndTabItem();
         }
         if (ImGui::BeginTabItem("Lights"))
@@ -112,6 +158,14 @@ void ShowImGUIWindow()
                 ImGui::DragInt("AOSteps", &sceneParams.sceneLights.Ambient.aoSteps, 1, 1, 64);
                 ImGui::DragInt("AOBlur", &sceneParams.sceneLights.Ambient.aoBlurAmount, 1, 0, SSAO_BLUR_MAX_RADIUS - 1);
                 ImGui::DragFloat("AOStrength", &sceneParams.sceneLights.Ambient.aoStrength, 0.1f, 0.0f, 5.0f);
+                ImGui::Checkbox("AOTemporal", &sceneParams.sceneLights.Ambient.aoTemporal);
+                ImGui::DragFloat("AOHistory", &sceneParams.sceneLights.Ambient.aoHistoryWeight, 0.01f, 0.0f, 0.98f);
+            }
+
+            if (ImGui::CollapsingHeader("Environment", ImGuiTreeNodeFlags_None))
+            {
+                ImGui::Checkbox("Enable IBL", &sceneParams.sceneLights.Environment.Enabled);
+                ImGui::DragFloat("Intensity", &sceneParams.sceneLights.Environment.Intensity, 0.01f, 0.0f, 4.0f);
             }
 
             if (ImGui::CollapsingHeader("Directional", ImGuiTreeNodeFlags_None))
@@ -137,416 +191,90 @@ void ShowImGUIWindow()
             ImGui::Checkbox("BoundingBox", &showBoundingBox);
             ImGui::Checkbox("Show Lights", &showLights);
             ImGui::Checkbox("AO Pass", &showAO);
+            if (ImGui::CollapsingHeader("Shader Permutations", ImGuiTreeNodeFlags_None))
+            {
+                std::stringstream report;
+                GeometryPermutations.Report(report);
+                PostProcessingPermutations.Report(report);
+                ImGui::TextUnformatted(report.str().c_str());
+            }
+            if (ImGui::CollapsingHeader("Shader Hot Reload", ImGuiTreeNodeFlags_None))
+            {
+                ImGui::Text("Edit %s<table>/<module>.glsl", ShaderHotReload::Directory.c_str());
+                if (ImGui::Button("Export built-in modules"))
+                {
+                    ShaderHotReload::Export(VertexSource_Geometry::Modules);
+                    ShaderHotReload::Export(FragmentSource_Geometry::Modules);
+                    ShaderHotReload::Export(VertexSource_PostProcessing::Modules);
+                    ShaderHotReload::Export(FragmentSource_PostProcessing::Modules);
+                    ShaderHotReload::Export(ComputeSource_PostProcessing::Modules);
+                }
+            }
+            if (ImGui::CollapsingHeader("Environment Lighting", ImGuiTreeNodeFlags_None))
+            {
+                if (ImGui::Button("Compare with CPU reference"))
+                    environmentError = EnvironmentLighting::CompareWithReference(sceneParams.sceneLights.Environment, skyboxFaces);
+
+                ImGui::Text("Irradiance SH    max %.4f avg %.4f", environmentError.IrradianceMax, environmentError.IrradianceAverage);
+                for (int i = 0; i < environmentError.PrefilterMax.size(); i++)
+                    ImGui::Text("Prefilter mip %d  max %.4f avg %.4f", i, environmentError.PrefilterMax[i], environmentError.PrefilterAverage[i]);
+            }
+            if (ImGui::CollapsingHeader("Profiler", ImGuiTreeNodeFlags_None))
+            {
+                const Profiler::History& frame = profiler.FrameHistory();
+                Profiler::Stats cpuFrame = Profiler::Compute(frame.Cpu, frame.Count);
+                Profiler::Stats gpuFrame = Profiler::Compute(frame.Gpu, frame.Count);
+                char overlay[64];
+                snprintf(overlay, sizeof(overlay), "avg %.2f p95 %.2f max %.2f ms", cpuFrame.Average, cpuFrame.P95, cpuFrame.Max);
+                ImGui::PlotLines("CPU frame", frame.Cpu.data(), frame.Count, frame.Offset, overlay, 0.0f, FLT_MAX, ImVec2(0, 60));
+                snprintf(overlay, sizeof(overlay), "avg %.2f p95 %.2f max %.2f ms", gpuFrame.Average, gpuFrame.P95, gpuFrame.Max);
+                ImGui::PlotLines("GPU frame", frame.Gpu.data(), frame.Count, frame.Offset, overlay, 0.0f, FLT_MAX, ImVec2(0, 60));
+
+                for (auto& scope : profiler.Scopes())
+                {
+                    Profiler::Stats cpu = profiler.CpuStats(scope.first);
+                    Profiler::Stats gpu = profiler.GpuStats(scope.first);
+                    if (ImGui::TreeNode(scope.first.c_str(), "%-14s cpu %6.3f  gpu %6.3f ms", scope.first.c_str(), cpu.Average, gpu.Average))
+                    {
+                        snprintf(overlay, sizeof(overlay), "avg %.3f p95 %.3f max %.3f ms", cpu.Average, cpu.P95, cpu.Max);
+                        ImGui::PlotLines("CPU", scope.second.Cpu.data(), scope.second.Count, scope.second.Offset, overlay, 0.0f, FLT_MAX, ImVec2(0, 40));
+                        snprintf(overlay, sizeof(overlay), "avg %.3f p95 %.3f max %.3f ms", gpu.Average, gpu.P95, gpu.Max);
+                        ImGui::PlotLines("GPU", scope.second.Gpu.data(), scope.second.Count, scope.second.Offset, overlay, 0.0f, FLT_MAX, ImVec2(0, 40));
+                        ImGui::TreePop();
+                    }
+                }
+
+                ImGui::Text("Frames dropped (queries not ready) %d", profiler.DroppedFrames());
+                if (profiler.Capturing())
+                    ImGui::Text("Capturing trace...");
+                else if (ImGui::Button("Export Chrome trace (120 frames)"))
+                    profiler.CaptureTrace("profile_trace.json", 120);
+            }
+            if (ImGui::CollapsingHeader("Render Graph", ImGuiTreeNodeFlags_None))
+            {
+                std::stringstream report;
+                renderGraph.Report(report);
+                ImGui::TextUnformatted(report.str().c_str());
+                if (ImGui::Button("Dump to console"))
+                    renderGraph.Report(std::cout);
+            }
+            if (ImGui::CollapsingHeader("Render Targets", ImGuiTreeNodeFlags_None))
+            {
+                std::stringstream report;
+                renderTargets.Report(report);
+                ImGui::TextUnformatted(report.str().c_str());
+            }
             ImGui::EndTabItem();
         }
         ImGui::EndTabBar();
     }
 }
 
-void LoadScene_Primitives(std::vector<MeshRenderer>* sceneMeshCollection, std::map<std::string, ShaderBase>* shadersCollection, BoundingBox* sceneBoundingBox)
-{
-    Mesh boxMesh = Mesh::Box(1, 1, 1);
-    MeshRenderer box =
-        MeshRenderer(glm::vec3(0, 0, 0), 0.0, glm::vec3(0, 0, 1), glm::vec3(1, 1, 1),
-            &boxMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::ShinyRed);
-
-    sceneMeshCollection->push_back(box);
-
-    Mesh coneMesh = Mesh::Cone(0.8, 1.6, 16);
-    MeshRenderer cone =
-        MeshRenderer(glm::vec3(1, 2, 1), 1.5, glm::vec3(0, -1, 1), glm::vec3(1, 1, 1),
-            &coneMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::PlasticGreen);
-
-    sceneMeshCollection->push_back(cone);
-
-    Mesh cylMesh = Mesh::Cylinder(0.6, 1.6, 16);
-    MeshRenderer cylinder =
-        MeshRenderer(glm::vec3(-1, -0.5, 1), 1.1, glm::vec3(0, 1, 1), glm::vec3(1, 1, 1),
-            &cylMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::Copper);
-
-    sceneMeshCollection->push_back(cylinder);
-
-    Mesh planeMesh = Mesh::Box(1, 1, 1);
-    MeshRenderer plane =
-        MeshRenderer(glm::vec3(-4, -4, -0.25), 0.0, glm::vec3(0, 0, 1), glm::vec3(8, 8, 0.25),
-            &planeMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    sceneMeshCollection->push_back(plane);
-
-    for (int i = 0; i < sceneMeshCollection->size(); i++)
-    {
-        MeshRenderer* mr = &(sceneMeshCollection->data()[i]);
-        sceneBoundingBox->Update(mr->GetTransformedPoints());
-    }
-}
-
-void LoadScene_Monkeys(std::vector<MeshRenderer>* sceneMeshCollection, std::map<std::string, ShaderBase> shadersCollection, BoundingBox* sceneBoundingBox)
-{
-    Mesh planeMesh = Mesh::Box(1, 1, 1);
-    MeshRenderer plane =
-        MeshRenderer(glm::vec3(-4, -4, -0.25), 0.0, glm::vec3(0, 0, 1), glm::vec3(8, 8, 0.25),
-            &planeMesh, &shadersCollection["LIT_WITH_SHADOWS_SSAO"], &shadersCollection["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    sceneMeshCollection->push_back(plane);
-
-    FileReader reader = FileReader("./Assets/Models/suzanne.obj");
-    reader.Load();
-    Mesh monkeyMesh = reader.Meshes()[0];
-    MeshRenderer monkey1 =
-        MeshRenderer(glm::vec3(0, -1.0, 2.0), 1.3, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-            &monkeyMesh, &shadersCollection["LIT_WITH_SHADOWS_SSAO"], &shadersCollection["LIT_WITH_SSAO"], MaterialsCollection::ShinyRed);
-
-    MeshRenderer monkey2 =
-        MeshRenderer(glm::vec3(-2.0, 1.0, 0.8), 1.3, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-            &monkeyMesh, &shadersCollection["LIT_WITH_SHADOWS_SSAO"], &shadersCollection["LIT_WITH_SSAO"], MaterialsCollection::PlasticGreen);
-
-    MeshRenderer monkey3 =
-        MeshRenderer(glm::vec3(2.0, 1.0, 0.8), 1.3, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-            &monkeyMesh, &shadersCollection["LIT_WITH_SHADOWS_SSAO"], &shadersCollection["LIT_WITH_SSAO"], MaterialsCollection::Copper);
-
-    sceneMeshCollection->push_back(monkey1);
-    sceneMeshCollection->push_back(monkey2);
-    sceneMeshCollection->push_back(monkey3);
-
-    for (int i = 0; i < sceneMeshCollection->size(); i++)
-    {
-        MeshRenderer* mr = &(sceneMeshCollection->data()[i]);
-        sceneBoundingBox->Update(mr->GetTransformedPoints());
-    }
-}
-
-void LoadScene_ALotOfMonkeys(std::vector<MeshRenderer>* sceneMeshCollection, std::map<std::string, ShaderBase>* shadersCollection, BoundingBox* sceneBoundingBox)
-{
-    Mesh planeMesh = Mesh::Box(1, 1, 1);
-    MeshRenderer plane =
-        MeshRenderer(glm::vec3(-4, -4, -0.25), 0.0, glm::vec3(0, 0, 1), glm::vec3(8, 8, 0.25),
-            &planeMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    sceneMeshCollection->push_back(plane);
-
-    FileReader reader = FileReader("./Assets/Models/suzanne.obj");
-    reader.Load();
-    Mesh monkeyMesh = reader.Meshes()[0];
-    MeshRenderer monkey1 =
-        MeshRenderer(glm::vec3(-1.0, -1.0, 0.4), 0.9, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-            &monkeyMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::ShinyRed);
-    monkey1.Transform(glm::vec3(0, 0, 0), glm::pi<float>() / 4.0, glm::vec3(0, 0.0, -1.0), glm::vec3(1.0, 1.0, 1.0), true);
-
-    MeshRenderer monkey2 =
-        MeshRenderer(glm::vec3(-1.0, 1.0, 0.4), 0.9, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-            &monkeyMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::PlasticGreen);
-    monkey2.Transform(glm::vec3(-1.5, 1.5, 0), 3.0 * glm::pi<float>() / 4.0, glm::vec3(0, 0.0, -1.0), glm::vec3(1.0, 1.0, 1.0), true);
-
-    MeshRenderer monkey3 =
-        MeshRenderer(glm::vec3(0.0, 0.5, 1.0), 1.2, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-            &monkeyMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::Copper);
-    //monkey3.Transform(glm::vec3(0, 0, 0), 3.0 * glm::pi<float>() / 4.0, glm::vec3(0, 0.0, 1.0), glm::vec3(1.0, 1.0, 1.0), true);
-
-    MeshRenderer monkey4 =
-        MeshRenderer(glm::vec3(1.0, -1.0, 0.4), 0.9, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-            &monkeyMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::PureWhite);
-    monkey4.Transform(glm::vec3(0, 0, 0), glm::pi<float>() / 4.0, glm::vec3(0, 0.0, 1.0), glm::vec3(1.0, 1.0, 1.0), true);
-
-    sceneMeshCollection->push_back(monkey1);
-    sceneMeshCollection->push_back(monkey2);
-    sceneMeshCollection->push_back(monkey3);
-    sceneMeshCollection->push_back(monkey4);
-
-    for (int i = 0; i < sceneMeshCollection->size(); i++)
-    {
-        MeshRenderer* mr = &(sceneMeshCollection->data()[i]);
-        sceneBoundingBox->Update(mr->GetTransformedPoints());
-    }
-}
-
-void LoadScene_Cadillac(std::vector<MeshRenderer>* sceneMeshCollection, std::map<std::string, ShaderBase>* shadersCollection, BoundingBox* sceneBoundingBox)
-{
-    Mesh planeMesh = Mesh::Box(1, 1, 1);
-    MeshRenderer plane =
-        MeshRenderer(glm::vec3(-4, -4, -0.25), 0.0, glm::vec3(0, 0, 1), glm::vec3(8, 8, 0.25),
-            &planeMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    sceneMeshCollection->push_back(plane);
-
-    FileReader reader = FileReader("./Assets/Models/Cadillac.obj");
-    reader.Load();
-    Mesh cadillacMesh0 = reader.Meshes()[0];
-    MeshRenderer cadillac0 =
-        MeshRenderer(glm::vec3(-1.0, -1.0, 0.4), glm::pi<float>() * 0.5, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-            &cadillacMesh0, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::ShinyRed);
-    cadillac0.Transform(glm::vec3(1, 0.5, -0.5), 0.0, glm::vec3(0, 0.0, -1.0), glm::vec3(1.0, 1.0, 1.0), true);
-
-    Mesh cadillacMesh1 = reader.Meshes()[1];
-    MeshRenderer cadillac1 =
-        MeshRenderer(glm::vec3(-1.0, -1.0, 0.4), glm::pi<float>() * 0.5, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-            &cadillacMesh1, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::ShinyRed);
-    cadillac1.Transform(glm::vec3(1, 0.5, -0.5), 0.0, glm::vec3(0, 0.0, -1.0), glm::vec3(1.0, 1.0, 1.0), true);
-
-    Mesh cadillacMesh2 = reader.Meshes()[2];
-    MeshRenderer cadillac2 =
-        MeshRenderer(glm::vec3(-1.0, -1.0, 0.4), glm::pi<float>() * 0.5, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-            &cadillacMesh2, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::ShinyRed);
-    cadillac2.Transform(glm::vec3(1, 0.5, -0.5), 0.0, glm::vec3(0, 0.0, -1.0), glm::vec3(1.0, 1.0, 1.0), true);
-
-
-    sceneMeshCollection->push_back(cadillac0);
-    sceneMeshCollection->push_back(cadillac1);
-    sceneMeshCollection->push_back(cadillac2);
-
-
-    for (int i = 0; i < sceneMeshCollection->size(); i++)
-    {
-        MeshRenderer* mr = &(sceneMeshCollection->data()[i]);
-        sceneBoundingBox->Update(mr->GetTransformedPoints());
-    }
-}
-
-void LoadScene_Dragon(std::vector<MeshRenderer>* sceneMeshCollection, std::map<std::string, ShaderBase>* shadersCollection, BoundingBox* sceneBoundingBox)
-{
-    Mesh planeMesh = Mesh::Box(1, 1, 1);
-    MeshRenderer plane =
-        MeshRenderer(glm::vec3(-4, -4, -0.25), 0.0, glm::vec3(0, 0, 1), glm::vec3(8, 8, 0.25),
-            &planeMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    sceneMeshCollection->push_back(plane);
-
-
-    FileReader reader = FileReader("./Assets/Models/Dragon.obj");
-    reader.Load();
-    Mesh dragonMesh = reader.Meshes()[0];
-    MeshRenderer dragon =
-        MeshRenderer(glm::vec3(0, 0, 0), glm::pi<float>() * 0.0, glm::vec3(0, 1, 0), glm::vec3(1, 1, 1),
-            &dragonMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    sceneMeshCollection->push_back(dragon);
-
-
-
-    for (int i = 0; i < sceneMeshCollection->size(); i++)
-    {
-        MeshRenderer* mr = &(sceneMeshCollection->data()[i]);
-        sceneBoundingBox->Update(mr->GetTransformedPoints());
-    }
-}
-
-void LoadScene_Nefertiti(std::vector<MeshRenderer>* sceneMeshCollection, std::map<std::string, ShaderBase>* shadersCollection, BoundingBox* sceneBoundingBox)
-{
-    Mesh planeMesh = Mesh::Box(1, 1, 1);
-    MeshRenderer plane =
-        MeshRenderer(glm::vec3(-4, -4, -0.25), 0.0, glm::vec3(0, 0, 1), glm::vec3(8, 8, 0.25),
-            &planeMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    sceneMeshCollection->push_back(plane);
-
-    FileReader reader = FileReader("./Assets/Models/Nefertiti.obj");
-    reader.Load();
-    Mesh dragonMesh = reader.Meshes()[0];
-    MeshRenderer dragon =
-        MeshRenderer(glm::vec3(0, 0, 0), glm::pi<float>() * 0.5, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-            &dragonMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    sceneMeshCollection->push_back(dragon);
-
-
-
-    for (int i = 0; i < sceneMeshCollection->size(); i++)
-    {
-        MeshRenderer* mr = &(sceneMeshCollection->data()[i]);
-        sceneBoundingBox->Update(mr->GetTransformedPoints());
-    }
-}
-
-void LoadScene_Knob(std::vector<MeshRenderer>* sceneMeshCollection, std::map<std::string, ShaderBase>* shadersCollection, BoundingBox* sceneBoundingBox)
-{
-    Mesh planeMesh = Mesh::Box(1, 1, 1);
-    MeshRenderer plane =
-        MeshRenderer(glm::vec3(-4, -4, -0.25), 0.0, glm::vec3(0, 0, 1), glm::vec3(8, 8, 0.25),
-            &planeMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    sceneMeshCollection->push_back(plane);
-    sceneBoundingBox->Update((&plane)->GetTransformedPoints());
-
-    FileReader reader = FileReader("./Assets/Models/Knob.obj");
-    reader.Load();
-    for (int i = 0; i < reader.Meshes().size(); i++)
-    {
-        Mesh dragonMesh = reader.Meshes()[i];
-        MeshRenderer dragon =
-            MeshRenderer(glm::vec3(0, 0, 0), glm::pi<float>() * 0.5f, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-                &dragonMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-        sceneMeshCollection->push_back(dragon);
-        sceneBoundingBox->Update((&dragon)->GetTransformedPoints());
-    }
-}
-
-void LoadScene_Bunny(std::vector<MeshRenderer>* sceneMeshCollection, std::map<std::string, ShaderBase>* shadersCollection, BoundingBox* sceneBoundingBox)
-{
-    Mesh planeMesh = Mesh::Box(1, 1, 1);
-    MeshRenderer plane =
-        MeshRenderer(glm::vec3(-4, -4, -0.25), 0.0, glm::vec3(0, 0, 1), glm::vec3(8, 8, 0.25),
-            &planeMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    sceneMeshCollection->push_back(plane);
-
-    FileReader reader = FileReader("./Assets/Models/Bunny.obj");
-    reader.Load();
-    Mesh dragonMesh = reader.Meshes()[0];
-    MeshRenderer dragon =
-        MeshRenderer(glm::vec3(0, 0, 0), glm::pi<float>() * 0, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-            &dragonMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    sceneMeshCollection->push_back(dragon);
-
-
-
-    for (int i = 0; i < sceneMeshCollection->size(); i++)
-    {
-        MeshRenderer* mr = &(sceneMeshCollection->data()[i]);
-        sceneBoundingBox->Update(mr->GetTransformedPoints());
-    }
-}
-
-void LoadScene_Jinx(std::vector<MeshRenderer>* sceneMeshCollection, std::map<std::string, ShaderBase>* shadersCollection, BoundingBox* sceneBoundingBox)
-{
-    Mesh planeMesh = Mesh::Box(1, 1, 1);
-    MeshRenderer plane =
-        MeshRenderer(glm::vec3(-4, -4, -0.25), 0.0, glm::vec3(0, 0, 1), glm::vec3(8, 8, 0.25),
-            &planeMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    //TODO texturize the plane
-    //unsigned int texture;
-    //glGenTextures(1, &texture);
-    //glBindTexture(GL_TEXTURE_2D, texture);
-    //// set the texture wrapping/filtering options (on the currently bound texture object)
-    //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    //// load and generate the texture
-    //int width, height, nrChannels;
-    //unsigned char* data = stbi_load("./Assets/Textures/floor.png", &width, &height, &nrChannels, 0);
-    //if (data)
-    //{
-    //    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    //    glGenerateMipmap(GL_TEXTURE_2D);
-    //}
-    //else
-    //{
-    //    std::cout << "Failed to load texture" << std::endl;
-    //}
-    //stbi_image_free(data);
-
-    //glBindTexture(GL_TEXTURE_2D, texture);
-
-    //// render container
-    //ourShader.use();
-    //glBindVertexArray(VAO);
-
-
-    sceneMeshCollection->push_back(plane);
-    sceneBoundingBox->Update((&plane)->GetTransformedPoints());
-
-    FileReader reader = FileReader("./Assets/Models/Jinx.obj");
-    reader.Load();
-    for (int i = 0; i < reader.Meshes().size(); i++)
-    {
-        Mesh dragonMesh = reader.Meshes()[i];
-        MeshRenderer dragon =
-            MeshRenderer(glm::vec3(0, 0, 0), glm::pi<float>() * 0, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-                &dragonMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-        sceneMeshCollection->push_back(dragon);
-        sceneBoundingBox->Update((&dragon)->GetTransformedPoints());
-    }
-
-}
-
-void LoadScene_Engine(std::vector<MeshRenderer>* sceneMeshCollection, std::map<std::string, ShaderBase>* shadersCollection, BoundingBox* sceneBoundingBox)
+// Scene by name (--scene) from Assets/Scenes, or the path of a scene file
+std::string ScenePath(std::string name)
 {
-    Mesh planeMesh = Mesh::Box(1, 1, 1);
-    MeshRenderer plane =
-        MeshRenderer(glm::vec3(-4, -4, -0.25), 0.0, glm::vec3(0, 0, 1), glm::vec3(8, 8, 0.25),
-            &planeMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    sceneMeshCollection->push_back(plane);
-    sceneBoundingBox->Update((&plane)->GetTransformedPoints());
-
-    FileReader reader = FileReader("./Assets/Models/Engine.obj");
-    reader.Load();
-    for (int i = 0; i < reader.Meshes().size(); i++)
-    {
-        Mesh dragonMesh = reader.Meshes()[i];
-        MeshRenderer dragon =
-            MeshRenderer(glm::vec3(0, 0, 0), glm::pi<float>() * 0, glm::vec3(1, 0, 0), glm::vec3(0.6, 0.6, 0.6),
-                &dragonMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::PureWhite);
-
-        sceneMeshCollection->push_back(dragon);
-        sceneBoundingBox->Update((&dragon)->GetTransformedPoints());
-    }
-
-}
-
-void LoadScene_AoTest(std::vector<MeshRenderer>* sceneMeshCollection, std::map<std::string, ShaderBase>* shadersCollection, BoundingBox* sceneBoundingBox)
-{
-
-    FileReader reader = FileReader("./Assets/Models/aoTest.obj");
-    reader.Load();
-    Mesh dragonMesh = reader.Meshes()[0];
-    MeshRenderer dragon =
-        MeshRenderer(glm::vec3(0, 0, 0), glm::pi<float>() * 0, glm::vec3(1, 0, 0), glm::vec3(1, 1, 1),
-            &dragonMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    sceneMeshCollection->push_back(dragon);
-
-
-
-    for (int i = 0; i < sceneMeshCollection->size(); i++)
-    {
-        MeshRenderer* mr = &(sceneMeshCollection->data()[i]);
-        sceneBoundingBox->Update(mr->GetTransformedPoints());
-    }
-}
-
-void LoadScene_Porsche(std::vector<MeshRenderer>* sceneMeshCollection, std::map<std::string, ShaderBase>* shadersCollection, BoundingBox* sceneBoundingBox)
-{
-    Mesh planeMesh = Mesh::Box(1, 1, 1);
-    MeshRenderer plane =
-        MeshRenderer(glm::vec3(-4, -4, -0.25), 0.0, glm::vec3(0, 0, 1), glm::vec3(8, 8, 0.25),
-            &planeMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::MatteGray);
-
-    sceneMeshCollection->push_back(plane);
-    sceneBoundingBox->Update((&plane)->GetTransformedPoints());
-
-    FileReader reader = FileReader("./Assets/Models/Porsche911.obj");
-    reader.Load();
-    for (int i = 0; i < reader.Meshes().size(); i++)
-    {
-        Mesh dragonMesh = reader.Meshes()[i];
-        MeshRenderer dragon =
-            MeshRenderer(glm::vec3(0, 0, 0), glm::pi<float>() * 0, glm::vec3(1, 0, 0), glm::vec3(0.6, 0.6, 0.6),
-                &dragonMesh, &(*shadersCollection)["LIT_WITH_SHADOWS_SSAO"], &(*shadersCollection)["LIT_WITH_SSAO"], MaterialsCollection::PureWhite);
-
-        sceneMeshCollection->push_back(dragon);
-        sceneBoundingBox->Update((&dragon)->GetTransformedPoints());
-    }
-
-}
-
-void SetupScene(std::vector<MeshRenderer>* sceneMeshCollection, std::map<std::string, ShaderBase>* shadersCollection, BoundingBox* sceneBoundingBox)
-{
-    //LoadScene_ALotOfMonkeys(sceneMeshCollection, shadersCollection, sceneBoundingBox);
-    //LoadScene_Primitives(sceneMeshCollection, shadersCollection, sceneBoundingBox);
-    //LoadScene_Cadillac(sceneMeshCollection, shadersCollection, sceneBoundingBox);
-    //LoadScene_Dragon(sceneMeshCollection, shadersCollection, sceneBoundingBox);
-    //LoadScene_Nefertiti(sceneMeshCollection, shadersCollection, sceneBoundingBox);
-    //LoadScene_Bunny(sceneMeshCollection, shadersCollection, sceneBoundingBox);
-    LoadScene_Jinx(sceneMeshCollection, shadersCollection, sceneBoundingBox);
-    //LoadScene_Engine(sceneMeshCollection, shadersCollection, sceneBoundingBox);
-    //LoadScene_Knob(sceneMeshCollection, shadersCollection, sceneBoundingBox);
-    //LoadScene_AoTest(sceneMeshCollection, shadersCollection, sceneBoundingBox);
-    //LoadScene_Porsche(sceneMeshCollection, shadersCollection, sceneBoundingBox);
-
+    bool isPath = name.size() > 5 && name.substr(name.size() - 5) == ".json";
+    return isPath ? name : "./Assets/Scenes/" + name + ".json";
 }
 
 std::vector<std::vector<int>> ComputePascalOddRows(int maxLevel)
@@ -616,225 +344,146 @@ float Lerp(float a, float b, float t)
 }
 
 
-std::map<std::string, ShaderBase> InitializeShaders()
+std::map<std::string, ShaderBase*> InitializeShaders()
 {
-    BasicShader basicLit(
-        std::vector<std::string>({/* NO VERTEX_SHADER EXPANSIONS */ }),
-        std::vector<std::string>(
-            {
-            "DEFS_LIGHTS",
-            "DEFS_MATERIAL",
-            "CALC_LIT_MAT"
-            }
-    ));
-
-    BasicShader basicLit_withShadows(
-        std::vector<std::string>(
-            {
-            "DEFS_SHADOWS",
-            "CALC_SHADOWS"
-            }
-            ),
-        std::vector<std::string>(
-            {
-            "DEFS_LIGHTS",
-            "DEFS_MATERIAL",
-            "DEFS_SHADOWS",
-            "CALC_LIT_MAT",
-            "CALC_SHADOWS",
-            }
-    ));
-
-    BasicShader basicLit_withShadows_ssao(
-        std::vector<std::string>(
-            {
-            "DEFS_SHADOWS",
-            "CALC_SHADOWS",
-            }
-            ),
-        std::vector<std::string>(
-            {
-            "DEFS_LIGHTS",
-            "DEFS_MATERIAL",
-            "DEFS_SHADOWS",
-            "DEFS_SSAO",
-            "CALC_LIT_MAT",
-            "CALC_SHADOWS",
-            "CALC_SSAO",
-            }
-    ));
-
-    BasicShader basicLit_withSsao(
-        std::vector<std::string>({/* NO VERTEX_SHADER EXPANSIONS */ }),
-        std::vector<std::string>(
-            {
-            "DEFS_LIGHTS",
-            "DEFS_MATERIAL",
-            "DEFS_SSAO",
-            "CALC_LIT_MAT",
-            "CALC_SSAO",
-            }
-    ));
-
-    BasicShader basicUnlit(
-        std::vector<std::string>({/* NO VERTEX_SHADER EXPANSIONS */ }),
-        std::vector<std::string>(
-            {
-            "DEFS_MATERIAL",
-            "CALC_UNLIT_MAT"
-            }
-    ));
-
-    BasicShader viewNormals(
-        std::vector<std::string>({/* NO VERTEX_SHADER EXPANSIONS */ }),
-        std::vector<std::string>(
-            {
-            "DEFS_NORMALS",
-            "CALC_NORMALS"
-            }
-    ));
+    using namespace ShaderFeatures;
 
     return
     {
 
-        { "LIT",                    basicLit                   },
-        { "LIT_WITH_SSAO",          basicLit_withSsao          },
-        { "UNLIT",                  basicUnlit                 },
-        { "LIT_WITH_SHADOWS",       basicLit_withShadows       },
-        { "LIT_WITH_SHADOWS_SSAO",  basicLit_withShadows_ssao  },
-        { "VIEWNORMALS",            viewNormals                }
+        { "LIT",                    GeometryPermutations.Get(LIT | IBL)                   },
+        { "LIT_WITH_SSAO",          GeometryPermutations.Get(LIT | IBL | SSAO)            },
+        { "UNLIT",                  GeometryPermutations.Get(UNLIT)                       },
+        { "LIT_WITH_SHADOWS",       GeometryPermutations.Get(LIT | IBL | SHADOWS)         },
+        { "LIT_WITH_SHADOWS_SSAO",  GeometryPermutations.Get(LIT | IBL | SHADOWS | SSAO)  },
+        { "VIEWNORMALS",            GeometryPermutations.Get(VIEWNORMALS)           }
 
     };
 }
 
-std::map<std::string, ShaderBase> InitializePostProcessingShaders()
+std::map<std::string, ShaderBase*> InitializePostProcessingShaders()
 {
-    PostProcessingShader hbaoShader(
-        std::vector<std::string>({/* NO VERTEX_SHADER EXPANSIONS */ }),
-        std::vector<std::string>(
-            {
-            "DEFS_SSAO",
-            "CALC_HBAO"
-            }
-    ));
-
-    PostProcessingShader ssaoShader(
-        std::vector<std::string>({/* NO VERTEX_SHADER EXPANSIONS */ }),
-        std::vector<std::string>(
-            {
-            "DEFS_SSAO",
-            "CALC_SSAO"
-            }
-    ));
-
-    PostProcessingShader ssaoViewPos(
-        std::vector<std::string>({/* NO VERTEX_SHADER EXPANSIONS */ }),
-        std::vector<std::string>(
-            {
-            "DEFS_SSAO",
-            "CALC_POSITIONS"
-            }
-    ));
+    using namespace ShaderFeatures;
 
-    PostProcessingShader blur(
-        std::vector<std::string>({/* NO VERTEX_SHADER EXPANSIONS */ }),
-        std::vector<std::string>(
-            {
-            "DEFS_BLUR",
-            "CALC_BLUR"
-            }
-    ));
-    PostProcessingShader gaussianBlur(
-        std::vector<std::string>({/* NO VERTEX_SHADER EXPANSIONS */ }),
-        std::vector<std::string>(
-            {
-            "DEFS_GAUSSIAN_BLUR",
-            "CALC_GAUSSIAN_BLUR"
-            }
-    ));
+    std::map<std::string, ShaderBase*> shaders =
+    {
 
+       { "SSAO",                PostProcessingPermutations.Get(PP_SSAO)           },
+       { "HBAO",                PostProcessingPermutations.Get(PP_HBAO)           },
+       { "SSAO_VIEWPOS",        PostProcessingPermutations.Get(PP_POSITIONS)      },
+       { "BLUR",                PostProcessingPermutations.Get(PP_BLUR)           },
+       { "GAUSSIAN_BLUR",       PostProcessingPermutations.Get(PP_GAUSSIAN_BLUR)  },
+       { "DISPLAY_RED",         PostProcessingPermutations.Get(PP_DISPLAY_RED)    },
+       { "TEMPORAL",            PostProcessingPermutations.Get(PP_TEMPORAL)       },
+    };
 
-    return
+    if (GLAD_GL_VERSION_4_3)
     {
+        static PostProcessingComputeShader hbaoComputeShader(
+            std::vector<std::string>(
+                {
+                "DEFS_HBAO",
+                "CALC_HBAO"
+                }
+        ));
+        hbaoComputeShader.SetName("HBAO_COMPUTE");
 
-       { "SSAO",                ssaoShader            },
-       { "HBAO",                hbaoShader            },
-       { "SSAO_VIEWPOS",        ssaoViewPos           },
-       { "BLUR",                blur                  },
-       { "GAUSSIAN_BLUR",       gaussianBlur          },
-    };
+        shaders.insert({ "HBAO_COMPUTE", &hbaoComputeShader });
+    }
+
+    return shaders;
 }
 
 
 
-unsigned int loadCubemap(std::vector<std::string> faces)
+int main(int argc, char** argv)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
+    Headless::Options headless = Headless::Parse(argc, argv);
+    Benchmark::Options benchmark = Benchmark::Parse(argc, argv);
+    if (benchmark.Jobs)
     {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-            );
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap tex failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
+        JobSystem::Scalability(std::cout);
+        return 0;
+    }
+    if (benchmark.Bounds)
+    {
+        SceneLoader::BoundsBenchmark(std::cout, { "./Assets/Models/Dragon.obj", "./Assets/Models/Nefertiti.obj" });
+        return 0;
+    }
+    Benchmark::Recorder benchmarkRecorder(benchmark);
+    if (benchmark.Enabled)
+    {
+        headless.Enabled = true;
+        headless.Hashes = false;
+        headless.Frames = benchmarkRecorder.TotalFrames();
     }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
-}
 
+    // Headless: surfaceless EGL when available, an invisible window otherwise
+    GLFWwindow* window = NULL;
+    GLADloadproc getProcAddress = (GLADloadproc)glfwGetProcAddress;
+    if (headless.Enabled && Headless::CreateContext())
+        getProcAddress = (GLADloadproc)Headless::GetProcAddress;
+    else
+    {
+        glfwInit();
+        if (headless.Enabled)
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
+        // Ask for 4.3 first (compute shaders), fall back to 3.3
+        const int contextVersions[][2] = { { 4, 3 }, { 3, 3 } };
+        for (int i = 0; i < 2 && window == NULL; i++)
+        {
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, contextVersions[i][0]);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, contextVersions[i][1]);
+            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+            //glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
-int main()
-{
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    //glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+            window = glfwCreateWindow(800, 800, "ESIEE_OpenGL", NULL, NULL);
+        }
 
-    GLFWwindow* window = glfwCreateWindow(800, 800, "ESIEE_OpenGL", NULL, NULL);
 
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+    }
 
-    if (window == NULL)
+    if (!gladLoadGLLoader(getProcAddress))
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
+        std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
-    glfwMakeContextCurrent(window);
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    ParallelShaderCompile::Initialize(getProcAddress);
+    ReverseZ::Initialize(getProcAddress);
+    ReverseZ::Apply();
+
+    if (window != NULL)
     {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, mouse_scroll_callback);
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
     }
 
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, mouse_scroll_callback);
-    glfwSetMouseButtonCallback(window, mouse_button_callback);
 
+    // Module files edited in a previous session replace the built-in sources from the start
+    ShaderHotReload::LoadAll();
+    static ShaderFileWatcher shaderWatcher(ShaderHotReload::Directory);
+    shaderWatcher.Start();
+
+    static std::map<std::string, ShaderBase*> Shaders = InitializeShaders();
 
-    static std::map<std::string, ShaderBase> Shaders = InitializeShaders();
+    static std::map<std::string, ShaderBase*> PostProcessingShaders = InitializePostProcessingShaders();
 
-    static std::map<std::string, ShaderBase> PostProcessingShaders = InitializePostProcessingShaders();
+    // Only the placeholders are compiled up front, everything else compiles while the first frames are drawn
+    GeometryPermutations.SetPlaceholder(GeometryPermutations.Get(ShaderFeatures::UNLIT));
+    PostProcessingPermutations.SetPlaceholder(PostProcessingPermutations.Get(ShaderFeatures::PP_PLACEHOLDER));
+    GeometryPermutations.SubmitAll();
+    PostProcessingPermutations.SubmitAll();
 
     glEnable(GL_DEPTH_TEST);
 
@@ -846,22 +495,15 @@ int main()
     // Scene View and Projection matrices
     glm::mat4 view = glm::mat4(1);
     float near = 0.1f, far = 50.0f;
-    glm::mat4 proj = glm::perspective(glm::radians(45.0f), height / (float)width, near, far);
+    glm::mat4 proj = ReverseZ::Perspective(glm::radians(45.0f), height / (float)width, near, far);
 
     // Shadow map View and Projection matrices
     glm::mat4 viewShadow, projShadow;
 
-    std::vector<std::string> faces{
-        "./Assets/Skybox/posx.jpg",
-        "./Assets/Skybox/negx.jpg",
-        "./Assets/Skybox/posy.jpg",
-        "./Assets/Skybox/negy.jpg",
-        "./Assets/Skybox/posz.jpg",
-        "./Assets/Skybox/negz.jpg"
-    };
-
     // Skybox first
-    unsigned int cubemapTexture = loadCubemap(faces);
+    TextureLoader::Compression = ParallelShaderCompile::HasExtension("GL_EXT_texture_compression_s3tc");
+    unsigned int cubemapTexture = TextureLoader::LoadCubemap(skyboxFaces);
+    sceneParams.sceneLights.Environment = EnvironmentLighting::Load(skyboxFaces, cubemapTexture);
 
     Shader skyboxShader("skybox.vs", "skybox.fs");
 
@@ -928,62 +570,88 @@ int main()
 
 
     std::vector<MeshRenderer> sceneMeshCollection;
+    CommandBuffer sceneCommands;
     sceneBB =
         BoundingBox(std::vector<glm::vec3>{});
 
-    SetupScene(&sceneMeshCollection, &Shaders, &sceneBB);
+    // Lights, the scene file may override them
+    sceneParams.sceneLights.Ambient.Ambient = glm::vec4(1, 1, 1, 0.6);
+    sceneParams.sceneLights.Ambient.aoRadius = 0.2;
+    sceneParams.sceneLights.Ambient.aoSamples = 16;
+    sceneParams.sceneLights.Ambient.aoSteps = 16;
+    sceneParams.sceneLights.Ambient.aoBlurAmount = 3;
+    sceneParams.sceneLights.Ambient.aoTemporal = true;
+    sceneParams.sceneLights.Ambient.aoHistoryWeight = 0.85f;
+    sceneParams.sceneLights.Directional.Direction = glm::vec3(1, 1, -1);
+    sceneParams.sceneLights.Directional.Diffuse = glm::vec4(1.0, 1.0, 1.0, 0.75);
+    sceneParams.sceneLights.Directional.Specular = glm::vec4(1.0, 1.0, 1.0, 0.75);
 
-    camera.CameraOrigin = sceneBB.Center();
+    // Meshes are imported on worker threads and show up as the main loop uploads them;
+    // headless runs (and benchmarks) render the complete scene from the first frame instead
+    SceneLoader::SceneStream sceneStream;
+    if (!sceneStream.Open(ScenePath(benchmark.Scene), &Shaders, &sceneParams.sceneLights))
+        return -1;
+    if (headless.Enabled)
+        sceneStream.Finish(&sceneMeshCollection, &sceneBB);
+    else
+        sceneStream.Step(&sceneMeshCollection, &sceneBB);
+
+    if (!sceneBB.Empty())
+        camera.CameraOrigin = sceneBB.Center();
     camera.ProcessMouseMovement(0, 0);
 
     // DEBUG
     MeshRenderer lightMesh =
         MeshRenderer(glm::vec3(0, 0, 0), 0, glm::vec3(0, 1, 1), glm::vec3(0.3, 0.3, 0.3),
-            &Mesh::Arrow(0.3, 1, 0.5, 0.5, 16), &Shaders["LIT"], &Shaders["LIT"], MaterialsCollection::PureWhite);
+            &Mesh::Arrow(0.3, 1, 0.5, 0.5, 16), Shaders["LIT"], Shaders["LIT"], MaterialsCollection::PureWhite);
 
     LinesRenderer grid =
         LinesRenderer(glm::vec3(0, 0, 0), 0.0f, glm::vec3(1, 1, 1), glm::vec3(1, 1, 1), Wire::Grid(glm::vec2(-5, -5), glm::vec2(5, 5), 1.0f),
-            &Shaders["LIT"], glm::vec4(0.5, 0.5, 0.5, 1.0));
+            Shaders["LIT"], glm::vec4(0.5, 0.5, 0.5, 1.0));
 
 
     std::vector<glm::vec3> bboxLines = sceneBB.GetLines();
     Wire bbWire = Wire(bboxLines.data(), bboxLines.size());
     LinesRenderer bbRenderer =
         LinesRenderer(glm::vec3(0, 0, 0), 0.0f, glm::vec3(1, 1, 1), glm::vec3(1, 1, 1), bbWire,
-            &Shaders["LIT"], glm::vec4(1.0, 0.0, 1.0, 1.0));
+            Shaders["LIT"], glm::vec4(1.0, 0.0, 1.0, 1.0));
 
-    bool showWindow = true;
+    bool showWindow = !headless.Enabled;
 
-    //Setup Dear ImGui context
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO(); (void)io;
-    io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
-    io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
+    if (showWindow)
+    {
+        //Setup Dear ImGui context
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGuiIO& io = ImGui::GetIO(); (void)io;
+        io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
+        io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
+
+        //Setup Dear ImGui style
+        ImGui::StyleColorsDark();
+        ImGui::StyleColorsClassic();
+
+        //Setup Platform/Renderer backends
+        ImGui_ImplGlfw_InitForOpenGL(window, true);
+        ImGui_ImplOpenGL3_Init(glsl_version);
+    }
 
-    //Setup Dear ImGui style
-    ImGui::StyleColorsDark();
-    ImGui::StyleColorsClassic();
+    if (benchmark.Enabled)
+        Benchmark::Apply(sceneParams);
 
-    //Setup Platform/Renderer backends
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init(glsl_version);
+    // ShadowMap
+    FrameBuffer shadowFBO = FrameBuffer(FrameBufferDesc(shadowMapResolution, shadowMapResolution).WithDepth(GL_DEPTH_COMPONENT32F));
 
-    // Lights
-    sceneParams.sceneLights.Ambient.Ambient = glm::vec4(1, 1, 1, 0.6);
-    sceneParams.sceneLights.Ambient.aoRadius = 0.2;
-    sceneParams.sceneLights.Ambient.aoSamples = 16;
-    sceneParams.sceneLights.Ambient.aoSteps = 16;
-    sceneParams.sceneLights.Ambient.aoBlurAmount = 3;
-    sceneParams.sceneLights.Directional.Direction = glm::vec3(1, 1, -1);
-    sceneParams.sceneLights.Directional.Diffuse = glm::vec4(1.0, 1.0, 1.0, 0.75);
-    sceneParams.sceneLights.Directional.Specular = glm::vec4(1.0, 1.0, 1.0, 0.75);
+    // SSAO inputs (eye positions, view normals, depth), AO result and blur targets come from renderTargets every frame
 
-    // ShadowMap
-    FrameBuffer shadowFBO = FrameBuffer(shadowMapResolution, shadowMapResolution, false, 0, true);
+    // AO temporal accumulation: attachment 0 holds last frame result (r => ao, g => eye depth), attachment 1 is the resolve target
+    FrameBuffer aoHistoryFBO = FrameBuffer(FrameBufferDesc(width, height).AddColor(GL_RG16F).AddColor(GL_RG16F));
 
-    // SSAO
-    FrameBuffer ssaoFBO = FrameBuffer(width, height, true, 2, true);
+    // Opaque + debug geometry, multisampled and never sampled: renderbuffers, resolved to the window at the end of the frame
+    auto sceneDesc = [&]() { return FrameBufferDesc(width, height, 1 << msaaItem).AddColor(GL_RGBA8, true).WithDepth(GL_DEPTH_COMPONENT32F, true); };
+    FrameBuffer sceneFBO = FrameBuffer(sceneDesc());
+    bool aoHistoryValid = false;
+    glm::mat4 prevViewProj = glm::mat4(1.0f);
 
     // ssao random rotation texture
     unsigned int ssaoNoiseTexture;
@@ -998,6 +666,8 @@ int main()
             0.0f);
         ssaoNoise.push_back(noise);
     }
+    std::vector<glm::vec3> ssaoNoiseBase = ssaoNoise;
+    unsigned int frameIndex = 0;
     glGenTextures(1, &ssaoNoiseTexture);
     glBindTexture(GL_TEXTURE_2D, ssaoNoiseTexture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, 4, 4, 0, GL_RGB, GL_FLOAT, &ssaoNoise[0]);
@@ -1037,6 +707,14 @@ int main()
         ssaoSamples.push_back(noise);
     }
 
+    // hbao (compute) directions, evenly spaced on the unit circle and rotated per pixel in the shader
+    std::vector<glm::vec2> hbaoDirections;
+    for (unsigned int i = 0; i < SSAO_MAX_SAMPLES; i++)
+    {
+        hbaoDirections.push_back(glm::vec2(0.0f, 0.0f));
+    }
+    int hbaoDirectionsCount = 0;
+
     // FullScreen Quad....all nice and hardCoded...TODO: improve code
     unsigned int ppQuad_vbo = 0;
     unsigned int ppQuad_vao = 0;
@@ -1051,15 +729,64 @@ int main()
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     MeshRenderer::CheckOGLErrors();
 
+    // Headless: frames are compared by hash, none of them may be drawn with a placeholder program
+    Headless::Recorder headlessRecorder(headless);
+    FrameBuffer* headlessTarget = NULL;
+    int headlessFrame = 0;
+    if (headless.Enabled)
+    {
+        width = headless.Width;
+        height = headless.Height;
+        headlessTarget = new FrameBuffer(FrameBufferDesc(width, height).AddColor(GL_RGBA8));
+
+        bool compiling = true;
+        while (compiling)
+        {
+            compiling = GeometryPermutations.PollAll() + PostProcessingPermutations.PollAll() > 0;
+            for (auto& shader : PostProcessingShaders)
+                compiling |= !shader.second->Poll();
+
+            if (compiling)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
     //this is the render loop
-    while (!glfwWindowShouldClose(window))
+    while (headless.Enabled ? headlessFrame < headless.Frames : !glfwWindowShouldClose(window))
     {
-        glfwMakeContextCurrent(window);
+        if (window != NULL)
+            glfwMakeContextCurrent(window);
+        profiler.BeginFrame();
+        auto frameStart = std::chrono::high_resolution_clock::now();
+        DrawStats::Reset();
+
+        // Hot reload: reassemble everything, only programs whose sources changed are recompiled
+        if (ShaderHotReload::Apply(shaderWatcher.TakeChanged()) > 0)
+        {
+            GeometryPermutations.RefreshAll();
+            PostProcessingPermutations.RefreshAll();
+            for (auto& shader : PostProcessingShaders)
+                if (!PostProcessingPermutations.Owns(shader.second)) // the HBAO compute shader
+                    shader.second->Refresh();
+        }
+
+        // Work other threads handed back to the context owner
+        Jobs().RunMainThreadJobs();
+
+        // Swap in the programs that finished compiling since the last frame
+        GeometryPermutations.PollAll();
+        PostProcessingPermutations.PollAll();
+        for (auto& shader : PostProcessingShaders)
+            if (!PostProcessingPermutations.Owns(shader.second))
+                shader.second->Poll();
 
         // Input procesing
-        processInput(window);
+        if (window != NULL)
+        {
+            processInput(window);
 
-        glfwPollEvents();
+            glfwPollEvents();
+        }
 
         if (showWindow)
         {
@@ -1069,195 +796,353 @@ int main()
             ImGui::NewFrame();
         }
 
-        glfwGetFramebufferSize(window, &width, &height);
+        if (!headless.Enabled)
+            glfwGetFramebufferSize(window, &width, &height);
 
-        // SHADOW PASS ////////////////////////////////////////////////////////////////////////////////////////////////
+        ReverseZ::Apply();
+        sceneParams.drawParams.depthZeroToOne = ReverseZ::ZeroToOne();
 
-        Utils::GetShadowMatrices(sceneParams.sceneLights.Directional.Position, sceneParams.sceneLights.Directional.Direction, sceneBB.GetPoints(), viewShadow, projShadow);
-        sceneParams.sceneLights.Directional.LightSpaceMatrix = projShadow * viewShadow;
-        sceneParams.sceneLights.Directional.Position = sceneBB.Center() - (glm::normalize(sceneParams.sceneLights.Directional.Direction) * sceneBB.Size() * 0.5f);
-
-        if (sceneParams.drawParams.doShadows)
+        // Scene still streaming in: upload what is ready, bounds (and the camera origin once done) follow
+        if (!sceneStream.Done())
         {
-            shadowFBO.Bind(true, true);
+            Profiler::Scope scope(profiler, "SceneUpload");
+            if (sceneStream.Step(&sceneMeshCollection, &sceneBB))
+            {
+                camera.CameraOrigin = sceneBB.Center();
+                std::vector<glm::vec3> lines = sceneBB.GetLines();
+                bbRenderer = LinesRenderer(glm::vec3(0, 0, 0), 0.0f, glm::vec3(1, 1, 1), glm::vec3(1, 1, 1), Wire(lines.data(), lines.size()),
+                    Shaders["LIT"], glm::vec4(1.0, 0.0, 1.0, 1.0));
+            }
+        }
 
-            glViewport(0, 0, shadowMapResolution, shadowMapResolution);
-            glClear(GL_DEPTH_BUFFER_BIT);
+        sceneStream.UpdateTransforms(&sceneMeshCollection);
 
-            MeshRenderer::CheckOGLErrors();
+        // Scene draws are recorded on the job system while the graph is built, the passes replay them
+        sceneCommands.Record(sceneMeshCollection, sceneParams.drawParams.doShadows);
 
-            for (MeshRenderer mr : sceneMeshCollection)
-            {
-                // TODO: DrawForShadows()
-                mr.Draw(viewShadow, projShadow, camera.Position, sceneParams);
-            }
-            sceneParams.sceneLights.Directional.ShadowMapId = shadowFBO.DepthTextureId();
-            shadowFBO.Unbind();
+        // Shadow and camera matrices are known up front, every pass below captures them
+        view = camera.GetViewMatrix();
+        if (!sceneBB.Empty())
+        {
+            Utils::GetShadowMatrices(sceneParams.sceneLights.Directional.Position, sceneParams.sceneLights.Directional.Direction, sceneBB.GetPoints(), viewShadow, projShadow);
+            projShadow = ReverseZ::ToClipRange(projShadow);
+            sceneParams.sceneLights.Directional.LightSpaceMatrix = projShadow * viewShadow;
+            sceneParams.sceneLights.Directional.Position = sceneBB.Center() - (glm::normalize(sceneParams.sceneLights.Directional.Direction) * sceneBB.Size() * 0.5f);
+
+            Utils::GetTightNearFar(sceneBB.GetPoints(), view, near, far);
         }
+        near = std::max(near, 0.1f); // negative when the camera is inside the scene bounds
+        far = std::max(far, near * 2.0f);
+        proj = ReverseZ::Perspective(glm::radians(fov), width / (float)height, near, far);
+        glm::vec2 depthParams = ReverseZ::LinearizeParams(near, far);
 
-        // SSAO PASS ////////////////////////////////////////////////////////////////////////////////////////////////
-        if (ssaoFBO.Height() != height || ssaoFBO.Width() != width)
+        if (aoHistoryFBO.Height() != height || aoHistoryFBO.Width() != width)
         {
-            ssaoFBO.FreeUnmanagedResources();
-            ssaoFBO = FrameBuffer(width, height, true, 2, true);
+            aoHistoryFBO.Resize(width, height);
+            sceneFBO.Resize(width, height);
+            aoHistoryValid = false;
+        }
+        if (sceneFBO.Desc().Samples != 1 << msaaItem)
+        {
+            sceneFBO.FreeUnmanagedResources();
+            sceneFBO = FrameBuffer(sceneDesc());
         }
 
-        ssaoFBO.Bind(true, true);
-        glDrawBuffer(GL_COLOR_ATTACHMENT0 + 1);
-        glViewport(0, 0, width, height);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        const char* aoType = AOShaderFromItem(ao_comboBox_current_item);
+        bool aoCompute = !strcmp(aoType, "HBAO_COMPUTE");
+        bool aoTemporal = sceneParams.sceneLights.Ambient.aoTemporal;
+        bool aoUsed = sceneParams.sceneLights.Ambient.aoStrength > 0.0f || showAO;
+        bool aoTemporalRan = false;
+
+        // RESOURCES ////////////////////////////////////////////////////////////////////////////////////////////////
+        renderGraph.Reset();
+
+        RenderGraph::Resource shadowMap = renderGraph.Import("ShadowMap", shadowFBO, RenderGraph::DepthAttachment);
+        RenderGraph::Resource scene = renderGraph.Import("Scene", sceneFBO);
+        RenderGraph::Resource aoHistory = renderGraph.Import("AOHistory", aoHistoryFBO);
+        RenderGraph::Resource noise = renderGraph.Import("SSAONoise", ssaoNoiseTexture);
+        RenderGraph::Resource gaussianWeights = renderGraph.Import("GaussianWeights", gaussianKernelValuesTexture);
+
+        // eye positions (full precision, they are reconstructed from) + view normals, depth is sampled to rebuild the positions
+        RenderGraph::Resource viewNormals = renderGraph.Create("ViewNormals", width, height, GL_RGB16F);
+        RenderGraph::Resource viewDepth = renderGraph.Create("ViewDepth", width, height, GL_DEPTH_COMPONENT32F);
+        RenderGraph::Resource viewPositions = renderGraph.Create("ViewPositions", width, height, GL_RGB32F);
+        RenderGraph::Resource ao = renderGraph.Create("AO", width, height, GL_R16F);
+        RenderGraph::Resource aoBlurH = renderGraph.Create("AOBlurH", width, height, GL_R16F);
+        RenderGraph::Resource aoBlurred = renderGraph.Create("AOBlurred", width, height, GL_R16F);
 
+        // SHADOW PASS ////////////////////////////////////////////////////////////////////////////////////////////////
+        renderGraph.AddPass("Shadow").Write(shadowMap).Execute([&](RenderGraph::Context& ctx)
+        {
+            ReverseZ::BeginPass(false);
+            glClear(GL_DEPTH_BUFFER_BIT);
 
-        view = camera.GetViewMatrix();
-        Utils::GetTightNearFar(sceneBB.GetPoints(), view, near, far);
-        near = 0.1f;
-        proj = glm::perspective(glm::radians(fov), width / (float)height, 0.1f, far); //TODO: near is brutally hard coded in PCSS calculations (#define NEAR 0.1)
+            MeshRenderer::CheckOGLErrors();
+
+            // TODO: DrawForShadows()
+            sceneCommands.Replay(viewShadow, projShadow, camera.Position, sceneParams);
+            sceneParams.sceneLights.Directional.ShadowMapId = ctx.Texture(shadowMap);
+        });
 
-        for (MeshRenderer mr : sceneMeshCollection)
+        // SSAO PASS ////////////////////////////////////////////////////////////////////////////////////////////////
+        renderGraph.AddPass("ViewNormals").Write(viewNormals).Write(viewDepth).Execute([&](RenderGraph::Context& ctx)
         {
-            //mr.Draw(view, proj, camera.Position, lights);
-            mr.DrawCustom(view, proj, &Shaders["VIEWNORMALS"]);
-        }
+            ReverseZ::BeginPass(true);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glDrawBuffer(GL_COLOR_ATTACHMENT0);
-        ssaoFBO.Unbind();
+            sceneCommands.ReplayCustom(view, proj, Shaders["VIEWNORMALS"]);
+        });
 
         // Extract view positions from depth
-        ssaoFBO.Bind(false, true);
-        glDepthMask(GL_FALSE);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, ssaoFBO.DepthTextureId());
-        glUseProgram((&PostProcessingShaders["SSAO_VIEWPOS"])->ShaderCodeId());
-        glUniform1i((&PostProcessingShaders["SSAO_VIEWPOS"])->UniformLocation("u_depthTexture"), 0);
-        glUniform1f((&PostProcessingShaders["SSAO_VIEWPOS"])->UniformLocation("u_near"), near);
-        glUniform1f((&PostProcessingShaders["SSAO_VIEWPOS"])->UniformLocation("u_far"), far);
-        glUniformMatrix4fv((&PostProcessingShaders["SSAO_VIEWPOS"])->UniformLocation("u_proj"), 1, GL_FALSE, glm::value_ptr(proj));
-        glBindVertexArray(ppQuad_vao);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        glBindVertexArray(0);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        ssaoFBO.Unbind();
-
-        // Compute SSAO
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, ssaoFBO.ColorTextureId());     // eye fragment positions => 0
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, ssaoFBO.ColorTextureId(1));    // normals                => 1
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, ssaoNoiseTexture);             // random rotation        => 2
+        renderGraph.AddPass("ViewPositions").Sample(viewDepth).Write(viewPositions).Execute([&](RenderGraph::Context& ctx)
+        {
+            glDepthMask(GL_FALSE);
+            glUseProgram((PostProcessingShaders["SSAO_VIEWPOS"])->ShaderCodeId());
+            glUniform1i((PostProcessingShaders["SSAO_VIEWPOS"])->UniformLocation("u_depthTexture"), ctx.Unit(viewDepth));
+            glUniform2fv((PostProcessingShaders["SSAO_VIEWPOS"])->UniformLocation("u_depthParams"), 1, glm::value_ptr(depthParams));
+            glUniform1f((PostProcessingShaders["SSAO_VIEWPOS"])->UniformLocation("u_far"), far);
+            glUniformMatrix4fv((PostProcessingShaders["SSAO_VIEWPOS"])->UniformLocation("u_proj"), 1, GL_FALSE, glm::value_ptr(proj));
+            glBindVertexArray(ppQuad_vao);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            glBindVertexArray(0);
+            glDepthMask(GL_TRUE);
+        });
 
+        // Compute SSAO => ao, the compute variant writes it as an image
+        RenderGraph::Pass& ssaoPass = renderGraph.AddPass("SSAO").Sample(viewPositions).Sample(viewNormals).Sample(noise);
+        if (aoCompute)
+            ssaoPass.WriteImage(ao);
+        else
+            ssaoPass.Write(ao);
 
-        const char* aoType = AOShaderFromItem(ao_comboBox_current_item);
+        ssaoPass.Execute([&](RenderGraph::Context& ctx)
+        {
+            // With temporal accumulation the noise rotates every frame (golden angle), so that history gathers new samples
+            if (aoTemporal)
+            {
+                float angle = 2.39996323f * (frameIndex % 1024);
+                float c = glm::cos(angle), s = glm::sin(angle);
+                for (int i = 0; i < ssaoNoise.size(); i++)
+                {
+                    ssaoNoise[i] = glm::vec3(
+                        c * ssaoNoiseBase[i].x - s * ssaoNoiseBase[i].y,
+                        s * ssaoNoiseBase[i].x + c * ssaoNoiseBase[i].y,
+                        0.0f);
+                }
+                glActiveTexture(GL_TEXTURE0 + ctx.Unit(noise));
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 4, 4, GL_RGB, GL_FLOAT, &ssaoNoise[0]);
+                glActiveTexture(GL_TEXTURE0);
+            }
+
+            if (aoCompute)
+            {
+                if (hbaoDirectionsCount != sceneParams.sceneLights.Ambient.aoSamples)
+                {
+                    hbaoDirectionsCount = sceneParams.sceneLights.Ambient.aoSamples;
+                    for (int i = 0; i < hbaoDirectionsCount; i++)
+                    {
+                        float angle = (2.0f * glm::pi<float>() * i) / hbaoDirectionsCount;
+                        hbaoDirections[i] = glm::vec2(glm::cos(angle), glm::sin(angle));
+                    }
+                }
 
-        glUseProgram((&PostProcessingShaders[aoType])->ShaderCodeId());
-        glUniform1f((&PostProcessingShaders[aoType])->UniformLocation("u_ssao_radius"), sceneParams.sceneLights.Ambient.aoRadius);
-        glUniform1i((&PostProcessingShaders[aoType])->UniformLocation("u_viewPosTexture"), 0);
-        glUniform1i((&PostProcessingShaders[aoType])->UniformLocation("u_viewNormalsTexture"), 1);
-        glUniform1i((&PostProcessingShaders[aoType])->UniformLocation("u_rotVecs"), 2);
-        glUniform3fv((&PostProcessingShaders[aoType])->UniformLocation("u_rays"), sceneParams.sceneLights.Ambient.aoSamples, (float*)&ssaoSamples[0]);
-        glUniform1i((&PostProcessingShaders[aoType])->UniformLocation("u_numSamples"), sceneParams.sceneLights.Ambient.aoSamples);
-        glUniform1i((&PostProcessingShaders[aoType])->UniformLocation("u_numSteps"), sceneParams.sceneLights.Ambient.aoSteps);
-        glUniform1f((&PostProcessingShaders[aoType])->UniformLocation("u_radius"), sceneParams.sceneLights.Ambient.aoRadius);
-        glUniform1f((&PostProcessingShaders[aoType])->UniformLocation("u_near"), near);
-        glUniform1f((&PostProcessingShaders[aoType])->UniformLocation("u_far"), far);
-        glUniformMatrix4fv((&PostProcessingShaders[aoType])->UniformLocation("u_proj"), 1, GL_FALSE, glm::value_ptr(proj));
-        glBindVertexArray(ppQuad_vao);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        glBindVertexArray(0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, 0);
-
-        // Blur pass
-        ssaoFBO.CopyFromOtherFbo(0, true, 0, false, glm::vec2(0.0, 0.0), glm::vec2(width, height));
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, ssaoFBO.ColorTextureId());
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, gaussianKernelValuesTexture);
-        glUseProgram((&PostProcessingShaders["GAUSSIAN_BLUR"])->ShaderCodeId());
-        glUniform1i((&PostProcessingShaders["GAUSSIAN_BLUR"])->UniformLocation("u_texture"), 0);
-        glUniform1i((&PostProcessingShaders["GAUSSIAN_BLUR"])->UniformLocation("u_weights_texture"), 1);
-        glUniform1i((&PostProcessingShaders["GAUSSIAN_BLUR"])->UniformLocation("u_radius"), sceneParams.sceneLights.Ambient.aoBlurAmount);
-
-        glUniform1i((&PostProcessingShaders["GAUSSIAN_BLUR"])->UniformLocation("u_hor"), 1); // => HORIZONTAL PASS
-        glBindVertexArray(ppQuad_vao);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        ssaoFBO.CopyFromOtherFbo(0, true, 0, false, glm::vec2(0.0, 0.0), glm::vec2(width, height));
-
-        glUniform1i((&PostProcessingShaders["GAUSSIAN_BLUR"])->UniformLocation("u_hor"), 0); // => VERTICAL PASS
-        glBindVertexArray(ppQuad_vao);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        glBindVertexArray(0);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glDepthMask(GL_TRUE);
-        ssaoFBO.CopyFromOtherFbo(0, true, 0, false, glm::vec2(0.0, 0.0), glm::vec2(width, height));
-
-        sceneParams.sceneLights.Ambient.AoMapId = ssaoFBO.ColorTextureId();
+                ShaderBase* hbaoCompute = PostProcessingShaders["HBAO_COMPUTE"];
+                glUseProgram(hbaoCompute->ShaderCodeId());
+                glUniform1i(hbaoCompute->UniformLocation("u_viewPosTexture"), ctx.Unit(viewPositions));
+                glUniform1i(hbaoCompute->UniformLocation("u_rotVecs"), ctx.Unit(noise));
+                glUniform2fv(hbaoCompute->UniformLocation("u_directions"), hbaoDirectionsCount, (float*)&hbaoDirections[0]);
+                glUniform1i(hbaoCompute->UniformLocation("u_numSamples"), sceneParams.sceneLights.Ambient.aoSamples);
+                glUniform1i(hbaoCompute->UniformLocation("u_numSteps"), sceneParams.sceneLights.Ambient.aoSteps);
+                glUniform1f(hbaoCompute->UniformLocation("u_radius"), sceneParams.sceneLights.Ambient.aoRadius);
+                glUniform1f(hbaoCompute->UniformLocation("u_far"), far);
+                glUniformMatrix4fv(hbaoCompute->UniformLocation("u_proj"), 1, GL_FALSE, glm::value_ptr(proj));
+
+                int tileSize = PostProcessingComputeShader::TileSize;
+                glDispatchCompute((width + tileSize - 1) / tileSize, (height + tileSize - 1) / tileSize, 1);
+            }
+            else
+            {
+                glDepthMask(GL_FALSE);
+                glUseProgram((PostProcessingShaders[aoType])->ShaderCodeId());
+                glUniform1f((PostProcessingShaders[aoType])->UniformLocation("u_ssao_radius"), sceneParams.sceneLights.Ambient.aoRadius);
+                glUniform1i((PostProcessingShaders[aoType])->UniformLocation("u_viewPosTexture"), ctx.Unit(viewPositions));
+                glUniform1i((PostProcessingShaders[aoType])->UniformLocation("u_viewNormalsTexture"), ctx.Unit(viewNormals));
+                glUniform1i((PostProcessingShaders[aoType])->UniformLocation("u_rotVecs"), ctx.Unit(noise));
+                glUniform3fv((PostProcessingShaders[aoType])->UniformLocation("u_rays"), sceneParams.sceneLights.Ambient.aoSamples, (float*)&ssaoSamples[0]);
+                glUniform1i((PostProcessingShaders[aoType])->UniformLocation("u_numSamples"), sceneParams.sceneLights.Ambient.aoSamples);
+                glUniform1i((PostProcessingShaders[aoType])->UniformLocation("u_numSteps"), sceneParams.sceneLights.Ambient.aoSteps);
+                glUniform1f((PostProcessingShaders[aoType])->UniformLocation("u_radius"), sceneParams.sceneLights.Ambient.aoRadius);
+                glUniform1f((PostProcessingShaders[aoType])->UniformLocation("u_far"), far);
+                glUniformMatrix4fv((PostProcessingShaders[aoType])->UniformLocation("u_proj"), 1, GL_FALSE, glm::value_ptr(proj));
+                glBindVertexArray(ppQuad_vao);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                glBindVertexArray(0);
+                glDepthMask(GL_TRUE);
+            }
+        });
+
+        // Temporal pass: blend with the reprojected history, the result becomes next frame history
+        RenderGraph::Resource blurInput = ao;
+        if (aoTemporal)
+        {
+            renderGraph.AddPass("AOTemporal").Sample(ao).Sample(aoHistory).Sample(viewPositions).Write(aoHistory).Execute([&](RenderGraph::Context& ctx)
+            {
+                aoHistoryFBO.DrawTo(1);
+                glDepthMask(GL_FALSE);
+
+                ShaderBase* temporalShader = PostProcessingShaders["TEMPORAL"];
+                glUseProgram(temporalShader->ShaderCodeId());
+                glUniform1i(temporalShader->UniformLocation("u_texture"), ctx.Unit(ao));
+                glUniform1i(temporalShader->UniformLocation("u_historyTexture"), ctx.Unit(aoHistory));
+                glUniform1i(temporalShader->UniformLocation("u_viewPosTexture"), ctx.Unit(viewPositions));
+                glUniformMatrix4fv(temporalShader->UniformLocation("u_invView"), 1, GL_FALSE, glm::value_ptr(glm::inverse(view)));
+                glUniformMatrix4fv(temporalShader->UniformLocation("u_prevViewProj"), 1, GL_FALSE, glm::value_ptr(prevViewProj));
+                glUniform1f(temporalShader->UniformLocation("u_historyWeight"), sceneParams.sceneLights.Ambient.aoHistoryWeight);
+                glUniform1f(temporalShader->UniformLocation("u_far"), far);
+                glUniform1i(temporalShader->UniformLocation("u_historyValid"), aoHistoryValid);
+                glBindVertexArray(ppQuad_vao);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                glBindVertexArray(0);
+
+                glDepthMask(GL_TRUE);
+                aoHistoryFBO.SwapColorAttachments(0, 1);
+                aoHistoryFBO.DrawTo(0);
+                aoTemporalRan = true;
+            });
+            blurInput = aoHistory;
+        }
+
+        // Blur pass: horizontal into aoBlurH, vertical into aoBlurred
+        for (int hor = 1; hor >= 0; hor--) // => HORIZONTAL PASS, then VERTICAL PASS
+        {
+            RenderGraph::Resource blurOutput = hor ? aoBlurH : aoBlurred;
+            renderGraph.AddPass(hor ? "AOBlurH" : "AOBlurV").Sample(blurInput).Sample(gaussianWeights).Write(blurOutput).Execute([&, hor, blurInput](RenderGraph::Context& ctx)
+            {
+                glDepthMask(GL_FALSE);
+                glUseProgram((PostProcessingShaders["GAUSSIAN_BLUR"])->ShaderCodeId());
+                glUniform1i((PostProcessingShaders["GAUSSIAN_BLUR"])->UniformLocation("u_texture"), ctx.Unit(blurInput));
+                glUniform1i((PostProcessingShaders["GAUSSIAN_BLUR"])->UniformLocation("u_weights_texture"), ctx.Unit(gaussianWeights));
+                glUniform1i((PostProcessingShaders["GAUSSIAN_BLUR"])->UniformLocation("u_radius"), sceneParams.sceneLights.Ambient.aoBlurAmount);
+                glUniform1i((PostProcessingShaders["GAUSSIAN_BLUR"])->UniformLocation("u_hor"), hor);
+                glBindVertexArray(ppQuad_vao);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                glBindVertexArray(0);
+                glDepthMask(GL_TRUE);
+            });
+            blurInput = blurOutput;
+        }
 
         // OPAQUE PASS /////////////////////////////////////////////////////////////////////////////////////////////////////
-        glViewport(0, 0, width, height);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // AO is only read (and so only computed) when it has an effect, the shadow map only when shadows are on
+        RenderGraph::Pass& opaquePass = renderGraph.AddPass("Opaque").Write(scene);
+        if (aoUsed)
+            opaquePass.Read(aoBlurred);
+        if (sceneParams.drawParams.doShadows)
+            opaquePass.Read(shadowMap);
 
-        if (showAO)
-            ssaoFBO.CopyToOtherFbo(0, true, 10, false, glm::vec2(0.0, 0.0), glm::vec2(width, height));
-        else
+        opaquePass.Execute([&](RenderGraph::Context& ctx)
         {
-            for (MeshRenderer mr : sceneMeshCollection)
+            sceneParams.sceneLights.Ambient.AoMapId = aoUsed ? ctx.Texture(aoBlurred) : 0;
+
+            ReverseZ::BeginPass(true);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            if (showAO)
             {
-                mr.Draw(view, proj, camera.Position, sceneParams);
+                glDepthMask(GL_FALSE);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, ctx.Texture(aoBlurred));
+                glUseProgram((PostProcessingShaders["DISPLAY_RED"])->ShaderCodeId());
+                glUniform1i((PostProcessingShaders["DISPLAY_RED"])->UniformLocation("u_texture"), 0);
+                glBindVertexArray(ppQuad_vao);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                glBindVertexArray(0);
+                glBindTexture(GL_TEXTURE_2D, 0);
+                glDepthMask(GL_TRUE);
             }
+            else
+            {
+                sceneCommands.Replay(view, proj, camera.Position, sceneParams);
+            }
+        });
+
+        if (!showAO)
+        {
+            renderGraph.AddPass("Skybox").Write(scene).Execute([&](RenderGraph::Context& ctx)
+            {
+                glDepthFunc(ReverseZ::DepthFunc(GL_LEQUAL));
 
-            glDepthFunc(GL_LEQUAL);
+                skyboxShader.use();
+                skyboxShader.setBool("reverseZ", ReverseZ::ZeroToOne());
 
-            skyboxShader.use();
+                skyboxShader.setInt("skybox", 0);
+                skyboxShader.setMat4("view", camera.GetViewMatrix());
+                skyboxShader.setMat4("projection", proj);
+                skyboxShader.setInt("skybox", 0);
 
-            skyboxShader.setInt("skybox", 0);
-            skyboxShader.setMat4("view", camera.GetViewMatrix());
-            skyboxShader.setMat4("projection", proj);
-            skyboxShader.setInt("skybox", 0);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+                glBindVertexArray(skyboxVAO);
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+                glBindVertexArray(0);
 
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-            glBindVertexArray(skyboxVAO);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-            glBindVertexArray(0);
+                glDepthFunc(ReverseZ::DepthFunc(GL_LESS));
+            });
+        }
 
-            glDepthFunc(GL_LESS);
+        // UI /////////////////////////////////////////////////////////////////////////////////////////////////////
+        if (showLights || showGrid || showBoundingBox)
+        {
+            renderGraph.AddPass("Debug").Write(scene).Execute([&](RenderGraph::Context& ctx)
+            {
+                if (showLights)
+                {
+                    glm::quat orientation = glm::quatLookAt(-normalize(sceneParams.sceneLights.Directional.Direction), glm::vec3(0, 0, 1));
+                    lightMesh.Transform(sceneParams.sceneLights.Directional.Position, glm::angle(orientation), glm::axis(orientation), glm::vec3(0.3, 0.3, 0.3), false);
+                    lightMesh.Draw(camera.GetViewMatrix(), proj, camera.Position, sceneParams);
+                }
+                if (showGrid)
+                    grid.Draw(camera.GetViewMatrix(), proj, camera.Position, sceneParams.sceneLights);
+                if (showBoundingBox)
+                    bbRenderer.Draw(camera.GetViewMatrix(), proj, camera.Position, sceneParams.sceneLights);
+            });
         }
 
+        // Scene target => window (or the headless target), the only pass with an effect outside of the graph
+        renderGraph.AddPass("Resolve").Read(scene).SideEffect().Execute([&](RenderGraph::Context& ctx)
+        {
+            sceneFBO.ResolveTo(headlessTarget, 0, 0, false);
+        });
 
+        renderGraph.Execute();
 
-        // UI /////////////////////////////////////////////////////////////////////////////////////////////////////
-        if (showLights)
+        if (headless.Enabled)
         {
-            glm::quat orientation = glm::quatLookAt(-normalize(sceneParams.sceneLights.Directional.Direction), glm::vec3(0, 0, 1));
-            lightMesh.Transform(sceneParams.sceneLights.Directional.Position, glm::angle(orientation), glm::axis(orientation), glm::vec3(0.3, 0.3, 0.3), false);
-            lightMesh.Draw(camera.GetViewMatrix(), proj, camera.Position, sceneParams);
+            Profiler::Scope scope(profiler, "Readback");
+            if (headless.Hashes)
+                headlessRecorder.Capture(*headlessTarget, headlessFrame);
+            camera.Orbit(Headless::OrbitStep(headless), 0.0f);
+            headlessFrame++;
         }
-        if (showGrid)
-            grid.Draw(camera.GetViewMatrix(), proj, camera.Position, sceneParams.sceneLights);
-        if (showBoundingBox)
-            bbRenderer.Draw(camera.GetViewMatrix(), proj, camera.Position, sceneParams.sceneLights);
+
+        aoHistoryValid = aoTemporalRan;
+        prevViewProj = proj * view;
+        frameIndex++;
 
 
         // WINDOW /////////////////////////////////////////////////////////////////////////////////////////////////////
         if (showWindow)
         {
+            Profiler::Scope scope(profiler, "UI");
             ShowImGUIWindow();
+            if (!sceneStream.Done())
+            {
+                ImGui::Begin("Loading");
+                ImGui::ProgressBar(sceneStream.Progress(), ImVec2(200, 0));
+                ImGui::End();
+            }
 
-        }
-
-        // Rendering
-        if (showWindow)
-        {
+            // Rendering
             ImGui::Render();
             int display_w, display_h;
             //glfwGetFramebufferSize(window, &display_w, &display_h);
@@ -1266,18 +1151,51 @@ int main()
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         }
         // Front and back buffers swapping
-        glfwSwapBuffers(window);
+        if (window != NULL)
+        {
+            Profiler::Scope scope(profiler, "Swap");
+            glfwSwapBuffers(window);
+        }
+        profiler.EndFrame();
+
+        if (benchmark.Enabled)
+            benchmarkRecorder.Frame(profiler, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count(), DrawStats::DrawCalls, DrawStats::Triangles);
     }
 
-    glfwTerminate();
+    if (benchmark.Enabled)
+    {
+        Benchmark::Memory memory;
+        memory.RenderTargetsPeak = renderTargets.PeakBytes();
+        memory.RenderTargetsAllocated = renderTargets.AllocatedBytes();
+        memory.FrameBuffers = shadowFBO.MemorySize() + aoHistoryFBO.MemorySize() + sceneFBO.MemorySize() + headlessTarget->MemorySize();
+        benchmarkRecorder.Write(profiler, sceneParams, AOShaderFromItem(ao_comboBox_current_item), width, height, memory);
+    }
+
+    shaderWatcher.Stop();
+    profiler.FreeUnmanagedResources();
+    renderTargets.FreeUnmanagedResources();
+
+    if (headlessTarget != NULL)
+    {
+        headlessTarget->FreeUnmanagedResources();
+        delete headlessTarget;
+        std::cout << "HEADLESS::DONE " << headlessFrame << " frames in " << headless.OutputDirectory << std::endl;
+    }
 
     // Cleanup
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    if (showWindow)
+    {
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (window != NULL)
+    {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+    Headless::DestroyContext();
 
     return 0;
 }
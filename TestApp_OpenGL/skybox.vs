@@ -5,10 +5,12 @@ out vec3 TexCoords;
 
 uniform mat4 projection;
 uniform mat4 view;
+uniform bool reverseZ;
 
 void main()
 {
     TexCoords = normalize(aPos.xzy);
     vec4 pos = projection * view * vec4(aPos, 1.0);
-    gl_Position = pos.xyww;
+    // always on the far plane: depth 1, or 0 with reverse-Z
+    gl_Position = reverseZ ? vec4(pos.xy, 0.0, pos.w) : pos.xyww;
 }  
\ No newline at end of file